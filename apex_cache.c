@@ -0,0 +1,276 @@
+/*
+ * apex_cache.c
+ * Contains the on-disk result cache
+ *
+ * Hashing the executable instead of listing the parameters keeps the key
+ * right when a latency or a queue size changes, at the price of a cold
+ * cache after every rebuild.
+ */
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+#include "apex_cache.h"
+
+#define CACHE_FNV_OFFSET 14695981039346656037ull
+#define CACHE_FNV_PRIME 1099511628211ull
+
+/* Largest result file: header, registers, every memory word and the hash */
+#define CACHE_MAX_SIZE (sizeof(APEX_CacheHeader) + sizeof(int) * (REG_FILE_SIZE + 2 * DATA_MEMORY_SIZE) + \
+                        sizeof(uint64_t))
+
+static uint64_t
+fnv(uint64_t hash, const void *data, size_t size)
+{
+    const unsigned char *p = data;
+    size_t i;
+
+    for (i = 0; i < size; ++i)
+    {
+        hash ^= p[i];
+        hash *= CACHE_FNV_PRIME;
+    }
+    return hash;
+}
+
+static uint64_t
+fnv_int(uint64_t hash, int value)
+{
+    return fnv(hash, &value, sizeof(value));
+}
+
+/* The executable running, or when it cannot be read the time it was built */
+static uint64_t
+hash_executable(uint64_t hash)
+{
+    unsigned char buf[65536];
+    size_t n;
+    FILE *fp;
+
+    fp = fopen("/proc/self/exe", "rb");
+    if (!fp)
+    {
+        return fnv(hash, __DATE__ " " __TIME__, sizeof(__DATE__ " " __TIME__));
+    }
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+    {
+        hash = fnv(hash, buf, n);
+    }
+    fclose(fp);
+    return hash;
+}
+
+static uint64_t
+hash_stage(uint64_t hash, const CPU_Stage *stage)
+{
+    /* opcode_str follows from code memory */
+    hash = fnv_int(hash, stage->pc);
+    return fnv(hash, &stage->opcode, sizeof(CPU_Stage) - offsetof(CPU_Stage, opcode));
+}
+
+/* Called once the CPU is in the state the run starts from */
+uint64_t
+APEX_cache_key(const APEX_CPU *cpu)
+{
+    const APEX_Instruction *insn;
+    uint64_t hash = CACHE_FNV_OFFSET;
+    int i;
+
+    hash = fnv(hash, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    hash = fnv_int(hash, CACHE_VERSION);
+    hash = hash_executable(hash);
+    hash = fnv_int(hash, cpu->command);
+    hash = fnv_int(hash, cpu->command_2);
+
+    hash = fnv_int(hash, cpu->code_memory_size);
+    for (i = 0; i < cpu->code_memory_size; ++i)
+    {
+        insn = &cpu->code_memory[i];
+        hash = fnv_int(hash, insn->opcode);
+        hash = fnv_int(hash, insn->rd);
+        hash = fnv_int(hash, insn->rs1);
+        hash = fnv_int(hash, insn->rs2);
+        hash = fnv_int(hash, insn->rs3);
+        hash = fnv_int(hash, insn->imm);
+        hash = fnv_int(hash, insn->number);
+    }
+
+    hash = fnv_int(hash, cpu->pc);
+    hash = fnv_int(hash, cpu->clock);
+    hash = fnv_int(hash, cpu->insn_completed);
+    hash = fnv_int(hash, cpu->zero_flag);
+    hash = fnv_int(hash, cpu->fetch_from_next_cycle);
+    hash = fnv_int(hash, cpu->queue_count);
+    for (i = 0; i < cpu->queue_count; ++i)
+    {
+        hash = fnv_int(hash, cpu->instruction_queue[(cpu->Front + i) % QUEUE_SIZE]);
+    }
+    hash = fnv(hash, cpu->regs, sizeof(int) * REG_FILE_SIZE);
+    hash = fnv(hash, cpu->state_regs, sizeof(int) * REG_FILE_SIZE);
+    hash = hash_stage(hash, &cpu->fetch);
+    hash = hash_stage(hash, &cpu->decode);
+    hash = hash_stage(hash, &cpu->integer);
+    hash = hash_stage(hash, &cpu->multiplier);
+    hash = hash_stage(hash, &cpu->load_store);
+    hash = hash_stage(hash, &cpu->writeback);
+    return fnv(hash, cpu->data_memory, sizeof(int) * DATA_MEMORY_SIZE);
+}
+
+static int
+result_path(char *path, size_t size, const char *dir, uint64_t key)
+{
+    return snprintf(path, size, "%s/%016llx.res", dir, (unsigned long long)key) >= (int)size ? -1 : 0;
+}
+
+/* Loads the result of the run with this key into the CPU, 0 on a hit */
+int APEX_cache_lookup(const char *dir, uint64_t key, APEX_CPU *cpu)
+{
+    unsigned char *buf;
+    APEX_CacheHeader header;
+    char path[4096];
+    uint64_t hash;
+    const int *regs, *pairs;
+    size_t size;
+    FILE *fp;
+    int i;
+
+    if (result_path(path, sizeof(path), dir, key))
+    {
+        return -1;
+    }
+    fp = fopen(path, "rb");
+    if (!fp)
+    {
+        return -1;
+    }
+    buf = malloc(CACHE_MAX_SIZE + 1);
+    if (!buf)
+    {
+        fclose(fp);
+        return -1;
+    }
+    size = fread(buf, 1, CACHE_MAX_SIZE + 1, fp);
+    fclose(fp);
+
+    if (size < sizeof(header) + sizeof(int) * REG_FILE_SIZE + sizeof(hash))
+    {
+        goto MISS;
+    }
+    memcpy(&header, buf, sizeof(header));
+    if (memcmp(header.magic, CACHE_MAGIC, sizeof(header.magic)) != 0 || header.version != CACHE_VERSION ||
+        header.key != key || header.memory_words < 0 || header.memory_words > DATA_MEMORY_SIZE ||
+        size != sizeof(header) + sizeof(int) * (REG_FILE_SIZE + 2 * header.memory_words) + sizeof(hash))
+    {
+        goto MISS;
+    }
+    memcpy(&hash, buf + size - sizeof(hash), sizeof(hash));
+    if (hash != fnv(CACHE_FNV_OFFSET, buf, size - sizeof(hash)))
+    {
+        goto MISS;
+    }
+
+    regs = (const int *)(buf + sizeof(header));
+    pairs = regs + REG_FILE_SIZE;
+    for (i = 0; i < header.memory_words; ++i)
+    {
+        if (pairs[2 * i] < 0 || pairs[2 * i] >= DATA_MEMORY_SIZE)
+        {
+            goto MISS;
+        }
+    }
+
+    cpu->clock = header.clock;
+    cpu->insn_completed = header.insn_completed;
+    cpu->pc = header.pc;
+    cpu->zero_flag = header.zero_flag;
+    memcpy(cpu->regs, regs, sizeof(int) * REG_FILE_SIZE);
+    memset(cpu->data_memory, 0, sizeof(int) * DATA_MEMORY_SIZE);
+    for (i = 0; i < header.memory_words; ++i)
+    {
+        cpu->data_memory[pairs[2 * i]] = pairs[2 * i + 1];
+    }
+    free(buf);
+    return 0;
+
+MISS:
+    fprintf(stderr, "APEX_Cache: Ignoring damaged result %s\n", path);
+    free(buf);
+    return -1;
+}
+
+/* Saves the state of a run that halted as the result of key */
+int APEX_cache_store(const char *dir, uint64_t key, const APEX_CPU *cpu)
+{
+    unsigned char *buf;
+    APEX_CacheHeader header;
+    char path[4096], tmp[4096];
+    uint64_t hash;
+    size_t size;
+    FILE *fp;
+    int i, pair[2], failed;
+
+    if (mkdir(dir, 0777) && errno != EEXIST)
+    {
+        return -1;
+    }
+    if (result_path(path, sizeof(path), dir, key) ||
+        snprintf(tmp, sizeof(tmp), "%s.%ld.tmp", path, (long)getpid()) >= (int)sizeof(tmp))
+    {
+        return -1;
+    }
+    buf = malloc(CACHE_MAX_SIZE);
+    if (!buf)
+    {
+        return -1;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+    header.version = CACHE_VERSION;
+    header.key = key;
+    header.clock = cpu->clock;
+    header.insn_completed = cpu->insn_completed;
+    header.pc = cpu->pc;
+    header.zero_flag = cpu->zero_flag;
+    size = sizeof(header) + sizeof(int) * REG_FILE_SIZE;
+    memcpy(buf + sizeof(header), cpu->regs, sizeof(int) * REG_FILE_SIZE);
+    for (i = 0; i < DATA_MEMORY_SIZE; ++i)
+    {
+        if (cpu->data_memory[i] != 0)
+        {
+            pair[0] = i;
+            pair[1] = cpu->data_memory[i];
+            memcpy(buf + size, pair, sizeof(pair));
+            size += sizeof(pair);
+            header.memory_words++;
+        }
+    }
+    memcpy(buf, &header, sizeof(header));
+    hash = fnv(CACHE_FNV_OFFSET, buf, size);
+    memcpy(buf + size, &hash, sizeof(hash));
+    size += sizeof(hash);
+
+    /* Renamed only once it is on disk in full */
+    fp = fopen(tmp, "wb");
+    if (!fp)
+    {
+        free(buf);
+        return -1;
+    }
+    failed = fwrite(buf, 1, size, fp) != size || fflush(fp) || fsync(fileno(fp));
+    failed |= fclose(fp) != 0;
+    free(buf);
+    if (failed || rename(tmp, path))
+    {
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,43 @@
+/*
+ * apex_cache.h
+ * Contains declarations for the on-disk result cache
+ *
+ * A run is keyed by a 64-bit FNV-1a hash of the simulator executable, which
+ * carries every microarchitecture parameter compiled into it, the command,
+ * the decoded program and the CPU state the run starts from, including its
+ * data memory. The result holds the state the run halted with: cycles,
+ * instructions retired, pc, zero flag, registers and the non-zero data
+ * memory words, which is all the output of a run is made of.
+ *
+ * A result file is an APEX_CacheHeader, the registers, the memory words as
+ * address/value pairs and an FNV-1a hash of everything before it, in host
+ * byte order. It is written under a name of its own and renamed into
+ * place, so other processes sharing the directory see either no result or
+ * a whole one; a file that does not check out is treated as a miss.
+ */
+#ifndef _APEX_CACHE_H_
+#define _APEX_CACHE_H_
+
+#include <stdint.h>
+
+#include "apex_cpu.h"
+
+#define CACHE_MAGIC "APEXRES1"
+#define CACHE_VERSION 1
+
+typedef struct APEX_CacheHeader
+{
+    char magic[8];
+    uint32_t version;
+    int32_t memory_words; /* Non-zero data memory words that follow the registers */
+    uint64_t key;
+    int32_t clock;
+    int32_t insn_completed;
+    int32_t pc;
+    int32_t zero_flag;
+} APEX_CacheHeader;
+
+uint64_t APEX_cache_key(const APEX_CPU *cpu);
+int APEX_cache_lookup(const char *dir, uint64_t key, APEX_CPU *cpu);
+int APEX_cache_store(const char *dir, uint64_t key, const APEX_CPU *cpu);
+#endif
@@ -0,0 +1,320 @@
+/*
+ * apex_checker.c
+ * Contains the differential lockstep checker
+ *
+ * The reference state is a private APEX_CPU sharing the code memory of the
+ * simulated one; only its architectural fields are used. The ring indices
+ * are C11 atomics, the simulator only writes head and the checker thread
+ * only writes tail, so neither side takes a lock.
+ */
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+#include "apex_isa.h"
+#include "apex_checker.h"
+
+/* What the pipeline did when an instruction retired */
+typedef struct CK_Retire
+{
+    int clock;
+    int pc;
+    int opcode;
+    int rd;
+    int value;       /* rd after writeback */
+    int mem_address; /* Instructions that write memory only */
+    int mem_value;
+} CK_Retire;
+
+struct APEX_Checker
+{
+    CK_Retire ring[CHECKER_RING_SIZE];
+    atomic_uint head; /* Next entry the simulator writes */
+    atomic_uint tail; /* Next entry the checker reads */
+    atomic_int closing;
+    atomic_int diverged;
+
+    int threaded;
+    pthread_t thread;
+
+    APEX_CPU *ref;
+    int started;
+    long long checked;
+
+    /* First divergence, valid once diverged is set */
+    CK_Retire bad;
+    int expected_pc;
+    int expected_value;
+    int expected_address;
+    int expected_mem_value;
+};
+
+/* Replays one retired instruction on the reference, returns FALSE on divergence */
+static int
+check_one(APEX_Checker *checker, const CK_Retire *rec)
+{
+    APEX_CPU *ref = checker->ref;
+    const APEX_Instruction *ins;
+    int index, address = 0;
+    int ok = TRUE;
+
+    /* The first retirement gives the pc, which also covers a restored run */
+    if (!checker->started)
+    {
+        ref->pc = rec->pc;
+        checker->started = TRUE;
+    }
+
+    checker->expected_pc = ref->pc;
+    if (rec->pc != ref->pc)
+    {
+        ok = FALSE;
+    }
+    else
+    {
+        index = (ref->pc - 4000) / 4;
+        ins = &ref->code_memory[index];
+        if (ins->opcode == OPCODE_STORE)
+        {
+            address = ref->regs[ins->rs2] + ins->imm;
+        }
+        else if (ins->opcode == OPCODE_STR)
+        {
+            address = ref->regs[ins->rs1] + ref->regs[ins->rs2];
+        }
+        else if (ins->opcode == OPCODE_AADD)
+        {
+            address = ref->regs[ins->rs1];
+        }
+        APEX_isa_step(ref);
+
+        /* The cycle count is not modelled, take the pipeline's */
+        if (rec->opcode == OPCODE_RDCYCLE)
+        {
+            ref->regs[rec->rd] = rec->value;
+        }
+
+        checker->expected_value = ref->regs[rec->rd];
+        if (APEX_writes_register(rec->opcode) && rec->value != ref->regs[rec->rd])
+        {
+            ok = FALSE;
+        }
+        if (APEX_writes_memory(rec->opcode))
+        {
+            checker->expected_address = address;
+            checker->expected_mem_value = ref->data_memory[address];
+            if (rec->mem_address != address || rec->mem_value != ref->data_memory[address])
+            {
+                ok = FALSE;
+            }
+        }
+    }
+
+    if (!ok)
+    {
+        checker->bad = *rec;
+        atomic_store_explicit(&checker->diverged, TRUE, memory_order_release);
+        return FALSE;
+    }
+    checker->checked++;
+    return TRUE;
+}
+
+static void *
+checker_thread(void *arg)
+{
+    APEX_Checker *checker = arg;
+    unsigned int tail = atomic_load_explicit(&checker->tail, memory_order_relaxed);
+    unsigned int head;
+
+    while (TRUE)
+    {
+        head = atomic_load_explicit(&checker->head, memory_order_acquire);
+        if (head == tail)
+        {
+            if (atomic_load_explicit(&checker->closing, memory_order_acquire) &&
+                atomic_load_explicit(&checker->head, memory_order_acquire) == tail)
+            {
+                break;
+            }
+            sched_yield();
+            continue;
+        }
+        while (tail != head)
+        {
+            if (!check_one(checker, &checker->ring[tail & (CHECKER_RING_SIZE - 1)]))
+            {
+                return NULL;
+            }
+            tail++;
+        }
+        atomic_store_explicit(&checker->tail, tail, memory_order_release);
+    }
+    return NULL;
+}
+
+APEX_Checker *
+APEX_checker_create(const APEX_CPU *cpu, int threaded)
+{
+    APEX_Checker *checker;
+
+    checker = calloc(1, sizeof(APEX_Checker));
+    if (!checker)
+    {
+        return NULL;
+    }
+    checker->ref = calloc(1, sizeof(APEX_CPU));
+    if (!checker->ref)
+    {
+        free(checker);
+        return NULL;
+    }
+
+    /* Architectural state only, the pipeline of the reference is never run */
+    checker->ref->pc = cpu->pc;
+    checker->ref->clock = cpu->clock;
+    checker->ref->insn_completed = cpu->insn_completed;
+    checker->ref->zero_flag = cpu->zero_flag;
+    checker->ref->regs = checker->ref->threads[0].regs;
+    memcpy(checker->ref->regs, cpu->regs, sizeof(int) * REG_FILE_SIZE);
+    checker->ref->data_memory = checker->ref->memory_store;
+    memcpy(checker->ref->data_memory, cpu->data_memory, sizeof(int) * DATA_MEMORY_SIZE);
+    checker->ref->code_memory = cpu->code_memory;
+    checker->ref->code_memory_size = cpu->code_memory_size;
+
+    atomic_init(&checker->head, 0);
+    atomic_init(&checker->tail, 0);
+    atomic_init(&checker->closing, FALSE);
+    atomic_init(&checker->diverged, FALSE);
+
+    checker->threaded = threaded;
+    if (threaded && pthread_create(&checker->thread, NULL, checker_thread, checker) != 0)
+    {
+        free(checker->ref);
+        free(checker);
+        return NULL;
+    }
+    return checker;
+}
+
+/* Called from writeback after the destination register has been written */
+void APEX_checker_retire(APEX_Checker *checker, const CPU_Stage *stage, int clock, int value)
+{
+    unsigned int head = 0; /* Only used when threaded */
+    CK_Retire *rec, local;
+
+    if (atomic_load_explicit(&checker->diverged, memory_order_relaxed))
+    {
+        return;
+    }
+
+    if (checker->threaded)
+    {
+        head = atomic_load_explicit(&checker->head, memory_order_relaxed);
+
+        /* Wait for room while the checker is behind */
+        while (head - atomic_load_explicit(&checker->tail, memory_order_acquire) == CHECKER_RING_SIZE)
+        {
+            if (atomic_load_explicit(&checker->diverged, memory_order_acquire))
+            {
+                return;
+            }
+            sched_yield();
+        }
+        rec = &checker->ring[head & (CHECKER_RING_SIZE - 1)];
+    }
+    else
+    {
+        rec = &local;
+    }
+
+    rec->clock = clock;
+    rec->pc = stage->pc;
+    rec->opcode = stage->opcode;
+    rec->rd = stage->rd;
+    rec->value = value;
+    rec->mem_address = stage->memory_address;
+    if (stage->opcode == OPCODE_AADD)
+    {
+        rec->mem_value = stage->result_buffer + stage->rs2_value;
+    }
+    else
+    {
+        rec->mem_value = (stage->opcode == OPCODE_STR) ? stage->rs3_value : stage->rs1_value;
+    }
+
+    if (checker->threaded)
+    {
+        atomic_store_explicit(&checker->head, head + 1, memory_order_release);
+    }
+    else
+    {
+        check_one(checker, rec);
+    }
+}
+
+int APEX_checker_diverged(const APEX_Checker *checker)
+{
+    return atomic_load_explicit(&((APEX_Checker *)checker)->diverged, memory_order_acquire);
+}
+
+static void
+print_divergence(const APEX_Checker *checker)
+{
+    const CK_Retire *bad = &checker->bad;
+    int index = (bad->pc - 4000) / 4;
+    CPU_Stage stage;
+    char text[256] = "?";
+
+    if (index >= 0 && index < checker->ref->code_memory_size)
+    {
+        APEX_stage_from_instruction(&stage, &checker->ref->code_memory[index], bad->pc);
+        APEX_format_instruction(&stage, text, sizeof(text));
+    }
+
+    fprintf(stderr, "APEX_Check: divergence after %lld matching instructions\n", checker->checked);
+    fprintf(stderr, "APEX_Check: pc(%d) %s retired in cycle %d\n", bad->pc, text, bad->clock);
+    if (bad->pc != checker->expected_pc)
+    {
+        fprintf(stderr, "APEX_Check:   retired pc(%d), reference executes pc(%d)\n", bad->pc,
+                checker->expected_pc);
+        return;
+    }
+    if (APEX_writes_register(bad->opcode) && bad->value != checker->expected_value)
+    {
+        fprintf(stderr, "APEX_Check:   R%d = %d, reference R%d = %d\n", bad->rd, bad->value, bad->rd,
+                checker->expected_value);
+    }
+    if (APEX_writes_memory(bad->opcode) &&
+        (bad->mem_address != checker->expected_address || bad->mem_value != checker->expected_mem_value))
+    {
+        fprintf(stderr, "APEX_Check:   MEM[%d] = %d, reference MEM[%d] = %d\n", bad->mem_address,
+                bad->mem_value, checker->expected_address, checker->expected_mem_value);
+    }
+}
+
+/* Waits for the checker to catch up and prints its verdict on stderr */
+void APEX_checker_close(APEX_Checker *checker)
+{
+    if (checker->threaded)
+    {
+        atomic_store_explicit(&checker->closing, TRUE, memory_order_release);
+        pthread_join(checker->thread, NULL);
+    }
+
+    if (atomic_load_explicit(&checker->diverged, memory_order_acquire))
+    {
+        print_divergence(checker);
+    }
+    else
+    {
+        fprintf(stderr, "APEX_Check: %lld instructions checked, no divergence\n", checker->checked);
+    }
+    free(checker->ref);
+    free(checker);
+}
@@ -0,0 +1,26 @@
+/*
+ * apex_checker.h
+ * Contains declarations for the differential lockstep checker
+ *
+ * Every instruction retired by APEX_writeback is replayed on the
+ * functional model of apex_isa.c, and its pc, destination register value
+ * and memory write are compared with what the pipeline did. Retired
+ * instructions are passed to a checker thread through a lock-free
+ * single-producer single-consumer ring, or checked in place when the
+ * checker is not threaded. The simulation stops at the first divergence.
+ */
+#ifndef _APEX_CHECKER_H_
+#define _APEX_CHECKER_H_
+
+#include "apex_cpu.h"
+
+/* Entries of the ring between the simulator and the checker thread, a power of two */
+#define CHECKER_RING_SIZE 4096
+
+typedef struct APEX_Checker APEX_Checker;
+
+APEX_Checker *APEX_checker_create(const APEX_CPU *cpu, int threaded);
+void APEX_checker_retire(APEX_Checker *checker, const CPU_Stage *stage, int clock, int value);
+int APEX_checker_diverged(const APEX_Checker *checker);
+void APEX_checker_close(APEX_Checker *checker);
+#endif
@@ -0,0 +1,265 @@
+/*
+ * apex_checkpoint.c
+ * Contains checkpoint and restore of the APEX CPU state
+ *
+ * Options, command line settings and the optional subsystems are not part
+ * of the state, they come from the command line of the run that restores.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+#include "apex_checkpoint.h"
+
+#define CKPT_CPU_FIELDS 9
+#define CKPT_STAGE_FIELDS 18
+
+static uint32_t
+code_hash(const APEX_CPU *cpu)
+{
+    uint32_t hash = 2166136261u;
+    int fields[7];
+    int i, j;
+
+    for (i = 0; i < cpu->code_memory_size; ++i)
+    {
+        fields[0] = cpu->code_memory[i].opcode;
+        fields[1] = cpu->code_memory[i].rd;
+        fields[2] = cpu->code_memory[i].rs1;
+        fields[3] = cpu->code_memory[i].rs2;
+        fields[4] = cpu->code_memory[i].rs3;
+        fields[5] = cpu->code_memory[i].imm;
+        fields[6] = cpu->code_memory[i].number;
+        for (j = 0; j < (int)sizeof(fields); ++j)
+        {
+            hash ^= ((const unsigned char *)fields)[j];
+            hash *= 16777619u;
+        }
+    }
+    return hash;
+}
+
+/* Scalar CPU state, in file order */
+static void
+cpu_fields(APEX_CPU *cpu, int **f)
+{
+    f[0] = &cpu->pc;
+    f[1] = &cpu->clock;
+    f[2] = &cpu->insn_completed;
+    f[3] = &cpu->zero_flag;
+    f[4] = &cpu->fetch_from_next_cycle;
+    f[5] = &cpu->Front;
+    f[6] = &cpu->Rear;
+    f[7] = &cpu->queue_count;
+    f[8] = &cpu->next_seq;
+}
+
+/* Latch state except opcode_str, which is copied back from code memory */
+static void
+stage_fields(CPU_Stage *stage, int **f)
+{
+    f[0] = &stage->pc;
+    f[1] = &stage->opcode;
+    f[2] = &stage->rs1;
+    f[3] = &stage->rs2;
+    f[4] = &stage->rs3;
+    f[5] = &stage->rd;
+    f[6] = &stage->imm;
+    f[7] = &stage->number;
+    f[8] = &stage->rs1_value;
+    f[9] = &stage->rs2_value;
+    f[10] = &stage->rs3_value;
+    f[11] = &stage->result_buffer;
+    f[12] = &stage->memory_address;
+    f[13] = &stage->stall;
+    f[14] = &stage->cycle;
+    f[15] = &stage->issue_cycle;
+    f[16] = &stage->has_insn;
+    f[17] = &stage->seq;
+}
+
+static CPU_Stage *
+cpu_stage(APEX_CPU *cpu, int stage_id)
+{
+    switch (stage_id)
+    {
+    case STAGE_FETCH:
+        return &cpu->fetch;
+    case STAGE_DECODE:
+        return &cpu->decode;
+    case STAGE_INTEGER:
+        return &cpu->integer;
+    case STAGE_MULTIPLIER:
+        return &cpu->multiplier;
+    case STAGE_LOAD_STORE:
+        return &cpu->load_store;
+    }
+    return &cpu->writeback;
+}
+
+int APEX_checkpoint_save(const APEX_CPU *cpu, const char *filename)
+{
+    APEX_CPU *state = (APEX_CPU *)cpu; /* Only read, the field tables take pointers */
+    APEX_CheckpointHeader header;
+    int *fields[CKPT_STAGE_FIELDS];
+    int values[CKPT_STAGE_FIELDS];
+    int pair[2];
+    FILE *fp;
+    int i, s;
+
+    fp = fopen(filename, "wb");
+    if (!fp)
+    {
+        return -1;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+    header.version = CHECKPOINT_VERSION;
+    header.code_memory_size = cpu->code_memory_size;
+    header.code_hash = code_hash(cpu);
+    header.queue_count = cpu->queue_count;
+    for (i = 0; i < DATA_MEMORY_SIZE; ++i)
+    {
+        header.memory_words += (cpu->data_memory[i] != 0);
+    }
+    fwrite(&header, sizeof(header), 1, fp);
+
+    cpu_fields(state, fields);
+    for (i = 0; i < CKPT_CPU_FIELDS; ++i)
+    {
+        values[i] = *fields[i];
+    }
+    fwrite(values, sizeof(int), CKPT_CPU_FIELDS, fp);
+    fwrite(cpu->regs, sizeof(int), REG_FILE_SIZE, fp);
+    fwrite(cpu->state_regs, sizeof(int), REG_FILE_SIZE, fp);
+
+    /* Queue entries from the front, the queue restarts at slot 0 */
+    for (i = 0; i < cpu->queue_count; ++i)
+    {
+        fwrite(&cpu->instruction_queue[(cpu->Front + i) % QUEUE_SIZE], sizeof(int), 1, fp);
+    }
+
+    for (s = 0; s < NUM_STAGES; ++s)
+    {
+        stage_fields(cpu_stage(state, s), fields);
+        for (i = 0; i < CKPT_STAGE_FIELDS; ++i)
+        {
+            values[i] = *fields[i];
+        }
+        fwrite(values, sizeof(int), CKPT_STAGE_FIELDS, fp);
+    }
+
+    for (i = 0; i < DATA_MEMORY_SIZE; ++i)
+    {
+        if (cpu->data_memory[i] != 0)
+        {
+            pair[0] = i;
+            pair[1] = cpu->data_memory[i];
+            fwrite(pair, sizeof(int), 2, fp);
+        }
+    }
+
+    if (ferror(fp))
+    {
+        fclose(fp);
+        return -1;
+    }
+    return fclose(fp) ? -1 : 0;
+}
+
+/* Called after APEX_cpu_init has parsed the same program */
+int APEX_checkpoint_restore(APEX_CPU *cpu, const char *filename)
+{
+    APEX_CheckpointHeader header;
+    int *fields[CKPT_STAGE_FIELDS];
+    int values[CKPT_STAGE_FIELDS];
+    int pair[2];
+    CPU_Stage *stage;
+    FILE *fp;
+    int i, s, index;
+
+    fp = fopen(filename, "rb");
+    if (!fp)
+    {
+        fprintf(stderr, "APEX_Error: Unable to open checkpoint %s\n", filename);
+        return -1;
+    }
+    if (fread(&header, sizeof(header), 1, fp) != 1 ||
+        memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != CHECKPOINT_VERSION ||
+        header.queue_count < 0 || header.queue_count > QUEUE_SIZE ||
+        header.memory_words < 0 || header.memory_words > DATA_MEMORY_SIZE)
+    {
+        fprintf(stderr, "APEX_Error: %s is not an APEX checkpoint\n", filename);
+        fclose(fp);
+        return -1;
+    }
+    if (header.code_memory_size != cpu->code_memory_size || header.code_hash != code_hash(cpu))
+    {
+        fprintf(stderr, "APEX_Error: checkpoint %s was taken from a different program\n", filename);
+        fclose(fp);
+        return -1;
+    }
+
+    if (fread(values, sizeof(int), CKPT_CPU_FIELDS, fp) != CKPT_CPU_FIELDS ||
+        fread(cpu->regs, sizeof(int), REG_FILE_SIZE, fp) != REG_FILE_SIZE ||
+        fread(cpu->state_regs, sizeof(int), REG_FILE_SIZE, fp) != REG_FILE_SIZE)
+    {
+        goto TRUNCATED;
+    }
+    cpu_fields(cpu, fields);
+    for (i = 0; i < CKPT_CPU_FIELDS; ++i)
+    {
+        *fields[i] = values[i];
+    }
+
+    memset(cpu->instruction_queue, 0, sizeof(int) * QUEUE_SIZE);
+    if (fread(cpu->instruction_queue, sizeof(int), header.queue_count, fp) != (size_t)header.queue_count)
+    {
+        goto TRUNCATED;
+    }
+    cpu->queue_count = header.queue_count;
+    cpu->Front = 0;
+    cpu->Rear = header.queue_count - 1;
+
+    for (s = 0; s < NUM_STAGES; ++s)
+    {
+        if (fread(values, sizeof(int), CKPT_STAGE_FIELDS, fp) != CKPT_STAGE_FIELDS)
+        {
+            goto TRUNCATED;
+        }
+        stage = cpu_stage(cpu, s);
+        memset(stage, 0, sizeof(CPU_Stage));
+        stage_fields(stage, fields);
+        for (i = 0; i < CKPT_STAGE_FIELDS; ++i)
+        {
+            *fields[i] = values[i];
+        }
+        index = (stage->pc - 4000) / 4;
+        if (stage->number > 0 && index >= 0 && index < cpu->code_memory_size)
+        {
+            strcpy(stage->opcode_str, cpu->code_memory[index].opcode_str);
+        }
+    }
+
+    memset(cpu->data_memory, 0, sizeof(int) * DATA_MEMORY_SIZE);
+    for (i = 0; i < header.memory_words; ++i)
+    {
+        if (fread(pair, sizeof(int), 2, fp) != 2 || pair[0] < 0 || pair[0] >= DATA_MEMORY_SIZE)
+        {
+            goto TRUNCATED;
+        }
+        cpu->data_memory[pair[0]] = pair[1];
+    }
+
+    fclose(fp);
+    return 0;
+
+TRUNCATED:
+    fprintf(stderr, "APEX_Error: checkpoint %s is truncated\n", filename);
+    fclose(fp);
+    return -1;
+}
@@ -0,0 +1,35 @@
+/*
+ * apex_checkpoint.h
+ * Contains declarations for checkpoint and restore of the APEX CPU state
+ *
+ * A checkpoint file is an APEX_CheckpointHeader followed by the scalar
+ * CPU state, the register file and scoreboard, the live entries of the
+ * instruction queue, every pipeline latch without its opcode string, and
+ * the non-zero data memory words as address/value pairs. Values are stored
+ * in host byte order. Code memory is not saved: the program is parsed from
+ * the input file as usual and must hash to the value in the header.
+ */
+#ifndef _APEX_CHECKPOINT_H_
+#define _APEX_CHECKPOINT_H_
+
+#include <stdint.h>
+
+#include "apex_cpu.h"
+
+/* The digit of the magic follows CHECKPOINT_VERSION */
+#define CHECKPOINT_MAGIC "APEXCKP2"
+#define CHECKPOINT_VERSION 2
+
+typedef struct APEX_CheckpointHeader
+{
+    char magic[8];
+    uint32_t version;
+    int32_t code_memory_size;
+    uint32_t code_hash;    /* FNV-1a of the decoded instructions */
+    int32_t queue_count;   /* Entries of the instruction queue that follow */
+    int32_t memory_words;  /* Non-zero data memory words that follow */
+} APEX_CheckpointHeader;
+
+int APEX_checkpoint_save(const APEX_CPU *cpu, const char *filename);
+int APEX_checkpoint_restore(APEX_CPU *cpu, const char *filename);
+#endif
@@ -6,11 +6,26 @@
  * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
  * State University of New York at Binghamton
  */
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "apex_cpu.h"
+#include "apex_cpu_internal.h"
 #include "apex_macros.h"
+#include "apex_pipeview.h"
+#include "apex_trace.h"
+#include "apex_profile.h"
+#include "apex_depgraph.h"
+#include "apex_memprof.h"
+#include "apex_interval.h"
+#include "apex_live.h"
+#include "apex_energy.h"
+#include "apex_prefetch.h"
+#include "apex_loopbuf.h"
+#include "apex_checkpoint.h"
+#include "apex_checker.h"
+#include "apex_multicore.h"
 
 // static int stall = 0;
 
@@ -24,121 +39,147 @@ get_code_memory_index_from_pc(const int pc)
     return (pc - 4000) / 4;
 }
 
-static void
-print_instruction(const CPU_Stage *stage)
+/* Fills a stage latch with an instruction of code memory as fetch would,
+ * for the tools that format instructions outside the pipeline
+ */
+void APEX_stage_from_instruction(CPU_Stage *stage, const APEX_Instruction *ins, int pc)
+{
+    memset(stage, 0, sizeof(CPU_Stage));
+    stage->pc = pc;
+    strcpy(stage->opcode_str, ins->opcode_str);
+    stage->opcode = ins->opcode;
+    stage->rd = ins->rd;
+    stage->rs1 = ins->rs1;
+    stage->rs2 = ins->rs2;
+    stage->rs3 = ins->rs3;
+    stage->imm = ins->imm;
+    stage->number = ins->number;
+}
+
+/* Formats the instruction held in a stage latch the way the display command
+ * prints it. Returns the number of characters written.
+ */
+int APEX_format_instruction(const CPU_Stage *stage, char *buf, int size)
 {
+    buf[0] = '\0';
+
     switch (stage->opcode)
     {
     case OPCODE_ADD:
     {
-        printf("%s,R%d,R%d,R%d  I%d", stage->opcode_str, stage->rd, stage->rs1, stage->rs2, stage->number);
-        break;
+        return snprintf(buf, size, "%s,R%d,R%d,R%d  I%d", stage->opcode_str, stage->rd, stage->rs1, stage->rs2, stage->number);
     }
     case OPCODE_ADDL:
     {
-        printf("%s,R%d,R%d,#%d  I%d", stage->opcode_str, stage->rd, stage->rs1, stage->imm, stage->number);
-        break;
+        return snprintf(buf, size, "%s,R%d,R%d,#%d  I%d", stage->opcode_str, stage->rd, stage->rs1, stage->imm, stage->number);
     }
     case OPCODE_SUB:
     {
-        printf("%s,R%d,R%d,R%d I%d", stage->opcode_str, stage->rd, stage->rs1, stage->rs2, stage->number);
-        break;
+        return snprintf(buf, size, "%s,R%d,R%d,R%d I%d", stage->opcode_str, stage->rd, stage->rs1, stage->rs2, stage->number);
     }
     case OPCODE_SUBL:
     {
-        printf("%s,R%d,R%d,#%d  I%d", stage->opcode_str, stage->rd, stage->rs1, stage->imm, stage->number);
-        break;
+        return snprintf(buf, size, "%s,R%d,R%d,#%d  I%d", stage->opcode_str, stage->rd, stage->rs1, stage->imm, stage->number);
     }
     case OPCODE_MUL:
     {
-        printf("%s,R%d,R%d,R%d  I%d", stage->opcode_str, stage->rd, stage->rs1, stage->rs2, stage->number);
-        break;
+        return snprintf(buf, size, "%s,R%d,R%d,R%d  I%d", stage->opcode_str, stage->rd, stage->rs1, stage->rs2, stage->number);
     }
     case OPCODE_DIV:
     {
-        printf("%s,R%d,R%d,R%d  I%d", stage->opcode_str, stage->rd, stage->rs1, stage->rs2, stage->number);
-        break;
+        return snprintf(buf, size, "%s,R%d,R%d,R%d  I%d", stage->opcode_str, stage->rd, stage->rs1, stage->rs2, stage->number);
     }
     case OPCODE_AND:
     {
-        printf("%s,R%d,R%d,R%d  I%d", stage->opcode_str, stage->rd, stage->rs1, stage->rs2, stage->number);
-        break;
+        return snprintf(buf, size, "%s,R%d,R%d,R%d  I%d", stage->opcode_str, stage->rd, stage->rs1, stage->rs2, stage->number);
     }
     case OPCODE_OR:
     {
-        printf("%s,R%d,R%d,R%d  I%d", stage->opcode_str, stage->rd, stage->rs1, stage->rs2, stage->number);
-        break;
+        return snprintf(buf, size, "%s,R%d,R%d,R%d  I%d", stage->opcode_str, stage->rd, stage->rs1, stage->rs2, stage->number);
     }
     case OPCODE_XOR:
     {
-        printf("%s,R%d,R%d,R%d  I%d", stage->opcode_str, stage->rd, stage->rs1,
-               stage->rs2, stage->number);
-        break;
+        return snprintf(buf, size, "%s,R%d,R%d,R%d  I%d", stage->opcode_str, stage->rd, stage->rs1,
+                        stage->rs2, stage->number);
     }
 
     case OPCODE_CMP:
     {
-        printf("%s,R%d,R%d  I%d", stage->opcode_str, stage->rs1, stage->rs2, stage->number);
-        break;
+        return snprintf(buf, size, "%s,R%d,R%d  I%d", stage->opcode_str, stage->rs1, stage->rs2, stage->number);
     }
 
     case OPCODE_MOVC:
     {
-        printf("%s,R%d,#%d  I%d", stage->opcode_str, stage->rd, stage->imm, stage->number);
-        break;
+        return snprintf(buf, size, "%s,R%d,#%d  I%d", stage->opcode_str, stage->rd, stage->imm, stage->number);
     }
 
     case OPCODE_LOAD:
     {
-        printf("%s,R%d,R%d,#%d  I%d", stage->opcode_str, stage->rd, stage->rs1,
-               stage->imm, stage->number);
-        break;
+        return snprintf(buf, size, "%s,R%d,R%d,#%d  I%d", stage->opcode_str, stage->rd, stage->rs1,
+                        stage->imm, stage->number);
     }
 
     case OPCODE_STORE:
     {
-        printf("%s,R%d,R%d,#%d I%d", stage->opcode_str, stage->rs1, stage->rs2,
-               stage->imm, stage->number);
-        break;
+        return snprintf(buf, size, "%s,R%d,R%d,#%d I%d", stage->opcode_str, stage->rs1, stage->rs2,
+                        stage->imm, stage->number);
     }
 
     case OPCODE_LDR:
     {
-        printf("%s,R%d,R%d,R%d  I%d", stage->opcode_str, stage->rd, stage->rs1,
-               stage->rs2, stage->number);
-        break;
+        return snprintf(buf, size, "%s,R%d,R%d,R%d  I%d", stage->opcode_str, stage->rd, stage->rs1,
+                        stage->rs2, stage->number);
     }
 
     case OPCODE_STR:
     {
-        printf("%s,R%d,R%d,R%d I%d", stage->opcode_str, stage->rs3, stage->rs1,
-               stage->rs2, stage->number);
-        break;
+        return snprintf(buf, size, "%s,R%d,R%d,R%d I%d", stage->opcode_str, stage->rs3, stage->rs1,
+                        stage->rs2, stage->number);
+    }
+
+    case OPCODE_AADD:
+    {
+        return snprintf(buf, size, "%s,R%d,R%d,R%d  I%d", stage->opcode_str, stage->rd, stage->rs1,
+                        stage->rs2, stage->number);
     }
 
     case OPCODE_BZ:
     {
-        printf("%s,#%d I%d", stage->opcode_str, stage->imm, stage->number);
-        break;
+        return snprintf(buf, size, "%s,#%d I%d", stage->opcode_str, stage->imm, stage->number);
     }
     case OPCODE_BNZ:
     {
-        printf("%s,#%d  I%d", stage->opcode_str, stage->imm, stage->number);
-        break;
+        return snprintf(buf, size, "%s,#%d  I%d", stage->opcode_str, stage->imm, stage->number);
     }
 
     case OPCODE_NOP:
+    case OPCODE_FENCE:
+    {
+        return snprintf(buf, size, "%s I%d", stage->opcode_str, stage->number);
+    }
+
+    case OPCODE_RDCYCLE:
+    case OPCODE_RDINSTRET:
+    case OPCODE_COREID:
     {
-        printf("%s I%d", stage->opcode_str, stage->number);
-        break;
+        return snprintf(buf, size, "%s,R%d  I%d", stage->opcode_str, stage->rd, stage->number);
     }
 
     case OPCODE_HALT:
     {
-        printf("%s I%d", stage->opcode_str, stage->number);
-        break;
+        return snprintf(buf, size, "%s I%d", stage->opcode_str, stage->number);
     }
     }
+    return 0;
+}
+
+static void
+print_instruction(const CPU_Stage *stage)
+{
+    char buf[256];
+
+    APEX_format_instruction(stage, buf, sizeof(buf));
+    printf("%s", buf);
 }
 
 /* Debug function which prints the CPU stage content
@@ -146,13 +187,266 @@ print_instruction(const CPU_Stage *stage)
  * Note: You can edit this function to print in more detail
  */
 static void
-print_stage_content(const char *name, const CPU_Stage *stage)
+print_stage_content(const char *name, const CPU_Stage *stage, int num_threads)
 {
-    printf("%-15s: pc(%d) ", name, stage->pc);
+    if (num_threads > 1)
+    {
+        printf("%-15s: T%d pc(%d) ", name, stage->thread, stage->pc);
+    }
+    else
+    {
+        printf("%-15s: pc(%d) ", name, stage->pc);
+    }
     print_instruction(stage);
     printf("\n");
 }
 
+/* Names used when printing stage contents, indexed by STAGE_* identifier */
+static const char *stage_names[NUM_STAGES] = {
+    "Fetch", "Decode/RF", "Integer FU", "Multiplier FU", "Load/Store FU", "Writeback"};
+
+/* Returns the name of a STAGE_* identifier, "?" for anything else */
+const char *APEX_stage_name(int stage_id)
+{
+    if (stage_id < 0 || stage_id >= NUM_STAGES)
+    {
+        return "?";
+    }
+    return stage_names[stage_id];
+}
+
+/* Called by every stage function for the instruction it worked on in the
+ * current cycle. Prints the stage for the display command and forwards the
+ * event to the pipeline tracers that are enabled.
+ */
+static void
+stage_activity(APEX_CPU *cpu, int stage_id, const CPU_Stage *stage)
+{
+    if ((ENABLE_DEBUG_MESSAGES) || (cpu->command == DISPLAY) || (cpu->command == SINGLE_STEP))
+    {
+        print_stage_content(APEX_stage_name(stage_id), stage, cpu->num_threads);
+    }
+
+    if (cpu->pipeview)
+    {
+        APEX_pipeview_stage(cpu->pipeview, stage_id, stage, cpu->clock);
+    }
+
+    if (cpu->trace)
+    {
+        APEX_trace_record(cpu->trace, cpu->clock, TRACE_STAGE, stage_id, stage->pc, stage->number);
+    }
+}
+
+/* Returns TRUE for instructions that write their destination register */
+int APEX_writes_register(int opcode)
+{
+    switch (opcode)
+    {
+    case OPCODE_STORE:
+    case OPCODE_STR:
+    case OPCODE_CMP:
+    case OPCODE_NOP:
+    case OPCODE_FENCE:
+    case OPCODE_BZ:
+    case OPCODE_BNZ:
+    case OPCODE_HALT:
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/* Returns the STAGE_* identifier of the FU that executes the instruction */
+int APEX_fu_of(int opcode)
+{
+    switch (opcode)
+    {
+    case OPCODE_LOAD:
+    case OPCODE_STORE:
+    case OPCODE_LDR:
+    case OPCODE_STR:
+    case OPCODE_AADD:
+    case OPCODE_FENCE:
+        return STAGE_LOAD_STORE;
+    case OPCODE_MUL:
+        return STAGE_MULTIPLIER;
+    }
+    return STAGE_INTEGER;
+}
+
+/* Returns TRUE for the conditional branches, resolved in the integer FU */
+int APEX_is_branch(int opcode)
+{
+    return (opcode == OPCODE_BZ) || (opcode == OPCODE_BNZ);
+}
+
+/* Returns TRUE for the loads, which read memory into rd */
+int APEX_is_load(int opcode)
+{
+    return (opcode == OPCODE_LOAD) || (opcode == OPCODE_LDR);
+}
+
+/* Returns TRUE for the stores, which write a register to memory */
+int APEX_is_store(int opcode)
+{
+    return (opcode == OPCODE_STORE) || (opcode == OPCODE_STR);
+}
+
+/* Returns TRUE for instructions that read data memory, AADD included */
+int APEX_reads_memory(int opcode)
+{
+    return APEX_is_load(opcode) || (opcode == OPCODE_AADD);
+}
+
+/* Returns TRUE for instructions that write data memory, AADD included */
+int APEX_writes_memory(int opcode)
+{
+    return APEX_is_store(opcode) || (opcode == OPCODE_AADD);
+}
+
+/* Returns how many source registers decode reads, they are rs1, rs2 and rs3 in that order */
+int APEX_reads_registers(int opcode)
+{
+    switch (opcode)
+    {
+    case OPCODE_ADDL:
+    case OPCODE_SUBL:
+    case OPCODE_LOAD:
+        return 1;
+    case OPCODE_ADD:
+    case OPCODE_SUB:
+    case OPCODE_MUL:
+    case OPCODE_DIV:
+    case OPCODE_AND:
+    case OPCODE_OR:
+    case OPCODE_XOR:
+    case OPCODE_CMP:
+    case OPCODE_STORE:
+    case OPCODE_LDR:
+    case OPCODE_AADD:
+        return 2;
+    case OPCODE_STR:
+        return 3;
+    }
+    return 0;
+}
+
+/* Returns TRUE while a BZ/BNZ of the thread waits in the integer FU for its turn */
+static int
+branch_pending(const APEX_CPU *cpu, int thread)
+{
+    return cpu->integer.has_insn && (cpu->integer.thread == thread) && APEX_is_branch(cpu->integer.opcode);
+}
+
+/* Makes the context of thread t the one the stages see through cpu */
+static void
+switch_thread(APEX_CPU *cpu, int t)
+{
+    APEX_Thread *thread;
+
+    if (t == cpu->active_thread)
+    {
+        return;
+    }
+    thread = &cpu->threads[cpu->active_thread];
+    thread->pc = cpu->pc;
+    thread->zero_flag = cpu->zero_flag;
+    thread->Front = cpu->Front;
+    thread->Rear = cpu->Rear;
+    thread->queue_count = cpu->queue_count;
+
+    thread = &cpu->threads[t];
+    cpu->pc = thread->pc;
+    cpu->zero_flag = thread->zero_flag;
+    cpu->Front = thread->Front;
+    cpu->Rear = thread->Rear;
+    cpu->queue_count = thread->queue_count;
+    cpu->regs = thread->regs;
+    cpu->state_regs = thread->state_regs;
+    cpu->instruction_queue = thread->instruction_queue;
+    cpu->active_thread = t;
+}
+
+/* TRUE when the next instruction of thread t would leave decode without
+ * waiting on a register or on a branch of its own */
+static int
+thread_ready(const APEX_CPU *cpu, int t)
+{
+    const APEX_Thread *thread = &cpu->threads[t];
+    const APEX_Instruction *ins;
+    int pc = (t == cpu->active_thread) ? cpu->pc : thread->pc;
+    int index = (pc - 4000) / 4;
+
+    if (index < 0 || index >= cpu->code_memory_size)
+    {
+        return TRUE;
+    }
+    ins = &cpu->code_memory[index];
+    return !(thread->state_regs[ins->rd] || thread->state_regs[ins->rs1] || thread->state_regs[ins->rs2] ||
+             thread->state_regs[ins->rs3] || branch_pending(cpu, t));
+}
+
+/* Thread to fetch from, in turn after the last one. Threads done fetching
+ * are skipped and, with SMT_POLICY_READY, so are threads that are not
+ * ready as long as another one is. */
+static int
+pick_thread(APEX_CPU *cpu)
+{
+    int i, t;
+    int fallback = -1;
+
+    for (i = 1; i <= cpu->num_threads; ++i)
+    {
+        t = (cpu->last_thread + i) % cpu->num_threads;
+        if (cpu->threads[t].fetch_done)
+        {
+            continue;
+        }
+        if (cpu->smt_policy == SMT_POLICY_RR || thread_ready(cpu, t))
+        {
+            cpu->last_thread = t;
+            return t;
+        }
+        cpu->threads[t].skipped++;
+        if (fallback < 0)
+        {
+            fallback = t;
+        }
+    }
+    cpu->last_thread = fallback;
+    return fallback;
+}
+
+static int
+all_halted(const APEX_CPU *cpu)
+{
+    int t;
+
+    for (t = 0; t < cpu->num_threads; ++t)
+    {
+        if (!cpu->threads[t].halted)
+        {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+static int
+all_fetch_done(const APEX_CPU *cpu)
+{
+    int t;
+
+    for (t = 0; t < cpu->num_threads; ++t)
+    {
+        if (!cpu->threads[t].fetch_done)
+        {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
 /* Debug function which prints the register file
  *
  * Note: You are not supposed to edit this function
@@ -204,22 +498,42 @@ print_memory_file(const APEX_CPU *cpu)
     printf("\n");
 }
 
+/* Prints the register file of every thread */
+static void
+print_thread_reg_files(APEX_CPU *cpu)
+{
+    int t;
+
+    if (cpu->num_threads == 1)
+    {
+        print_reg_file(cpu);
+        return;
+    }
+    for (t = 0; t < cpu->num_threads; ++t)
+    {
+        switch_thread(cpu, t);
+        printf("Thread %d:\n", t);
+        print_reg_file(cpu);
+    }
+}
+
+/* The instruction queue is a circular buffer holding the instruction numbers
+ * in program order, so that FUs complete in order */
 static void enqueue(APEX_CPU *cpu, int insert_item)
 {
-    if (cpu->Rear == QUEUE_SIZE - 1)
+    if (cpu->queue_count == QUEUE_SIZE)
         printf("Overflow \n");
     else
     {
-        if (cpu->Front == -1)
-            cpu->Front = 0;
-        cpu->Rear = cpu->Rear + 1;
+        cpu->Rear = (cpu->Rear + 1) % QUEUE_SIZE;
         cpu->instruction_queue[cpu->Rear] = insert_item;
+        cpu->queue_count++;
     }
 }
 
 static void dequeue(APEX_CPU *cpu)
 {
-    if (cpu->Front == -1 || cpu->Front > cpu->Rear)
+    if (cpu->queue_count == 0)
     {
         printf("Underflow \n");
         return;
@@ -230,20 +544,21 @@ static void dequeue(APEX_CPU *cpu)
         {
             printf("Element deleted from the Queue: %d\n", cpu->instruction_queue[cpu->Front]);
         }
-        cpu->Front = cpu->Front + 1;
+        cpu->Front = (cpu->Front + 1) % QUEUE_SIZE;
+        cpu->queue_count--;
     }
 }
 
 static void show(APEX_CPU *cpu)
 {
 
-    if (cpu->Front == -1)
+    if (cpu->queue_count == 0)
         printf("Empty Queue \n");
     else
     {
         printf("Queue: \n");
-        for (int i = cpu->Front; i <= cpu->Rear; i++)
-            printf("%d ", cpu->instruction_queue[i]);
+        for (int i = 0; i < cpu->queue_count; i++)
+            printf("%d ", cpu->instruction_queue[(cpu->Front + i) % QUEUE_SIZE]);
         printf("\n");
     }
 }
@@ -253,7 +568,7 @@ static void show(APEX_CPU *cpu)
  *
  * Note: You are free to edit this function according to your implementation
  */
-static void
+void
 APEX_fetch(APEX_CPU *cpu)
 {
     APEX_Instruction *current_ins;
@@ -270,52 +585,81 @@ APEX_fetch(APEX_CPU *cpu)
         }
         if (cpu->decode.stall == 0)
         {
-            /* Store current PC in fetch latch */
-            cpu->fetch.pc = cpu->pc;
+            if (cpu->num_threads > 1)
+            {
+                switch_thread(cpu, pick_thread(cpu));
+            }
+            cpu->threads[cpu->active_thread].fetched++;
 
-            /* Index into code memory using this pc and copy all instruction fields
-             * into fetch latch  */
+            /* Index into code memory using this pc and fill the fetch latch
+             * with the instruction and the current PC */
             current_ins = &cpu->code_memory[get_code_memory_index_from_pc(cpu->pc)];
-            strcpy(cpu->fetch.opcode_str, current_ins->opcode_str);
-            cpu->fetch.opcode = current_ins->opcode;
-            cpu->fetch.rd = current_ins->rd;
-            cpu->fetch.rs1 = current_ins->rs1;
-            cpu->fetch.rs2 = current_ins->rs2;
-            cpu->fetch.rs3 = current_ins->rs3;
-            cpu->fetch.imm = current_ins->imm;
-            cpu->fetch.number = current_ins->number;
+            APEX_stage_from_instruction(&cpu->fetch, current_ins, cpu->pc);
+            cpu->fetch.has_insn = TRUE;
+            cpu->fetch.thread = cpu->active_thread;
+            /* Ids only have to tell apart the instructions in flight, so they wrap */
+            cpu->next_seq = (cpu->next_seq == INT_MAX) ? 1 : cpu->next_seq + 1;
+            cpu->fetch.seq = cpu->next_seq;
             /* Update PC for next instruction */
             cpu->pc += 4;
             /* Copy data from fetch latch to decode latch*/
             cpu->decode = cpu->fetch;
 
-            if ((ENABLE_DEBUG_MESSAGES) || (cpu->command == DISPLAY) || (cpu->command == SINGLE_STEP))
+            stage_activity(cpu, STAGE_FETCH, &cpu->fetch);
+            if (cpu->loopbuf || cpu->energy)
             {
-                print_stage_content("Fetch", &cpu->fetch);
+                int from_loop_buffer = cpu->loopbuf && APEX_loopbuf_fetch(cpu->loopbuf, cpu->fetch.pc);
+
+                if (cpu->energy)
+                {
+                    APEX_energy_fetch(cpu->energy, from_loop_buffer);
+                }
             }
 
-            /* Stop fetching new instructions if HALT is fetched */
+            /* Stop fetching new instructions once every thread fetched HALT */
             if (cpu->fetch.opcode == OPCODE_HALT)
             {
-                cpu->fetch.has_insn = FALSE;
+                cpu->threads[cpu->active_thread].fetch_done = TRUE;
+                if (all_fetch_done(cpu))
+                {
+                    cpu->fetch.has_insn = FALSE;
+                }
             }
         }
     }
 }
 
+/* What decode did this cycle, from the latch it leaves behind */
+static int
+decode_outcome(const APEX_CPU *cpu, int had_insn)
+{
+    if (!cpu->decode.has_insn)
+    {
+        return had_insn ? INTERVAL_ISSUED : INTERVAL_EMPTY;
+    }
+    if (cpu->decode.stall)
+    {
+        return INTERVAL_STALL_FU;
+    }
+    return branch_pending(cpu, cpu->decode.thread) ? INTERVAL_STALL_BRANCH : INTERVAL_STALL_DATA;
+}
+
 /*
  * Decode Stage of APEX Pipeline
  *
  * Note: You are free to edit this function according to your implementation
  */
-static void
+void
 APEX_decode(APEX_CPU *cpu)
 {
+    int had_insn = cpu->decode.has_insn;
+
     if (cpu->decode.has_insn)
     {
+        switch_thread(cpu, cpu->decode.thread);
         if (cpu->decode.stall)
         {
-            if ((cpu->decode.opcode == OPCODE_STR) || (cpu->decode.opcode == OPCODE_LDR) || (cpu->decode.opcode == OPCODE_LOAD) || (cpu->decode.opcode == OPCODE_STORE))
+            if (APEX_fu_of(cpu->decode.opcode) == STAGE_LOAD_STORE)
             {
                 /*Incase if it's the first time the instruction has entered incase of stall then first decode the instruction*/
                 if (cpu->load_store.stall == 0)
@@ -325,14 +669,14 @@ APEX_decode(APEX_CPU *cpu)
                 }
                 else
                 {
-                    if (((cpu->decode.opcode == OPCODE_LOAD) || (cpu->decode.opcode == OPCODE_LDR)) && (cpu->state_regs[cpu->decode.rd] == 1))
+                    if (APEX_writes_register(cpu->decode.opcode) && (cpu->state_regs[cpu->decode.rd] == 1))
                     {
                         cpu->state_regs[cpu->decode.rd] = 0;
                     }
                     cpu->fetch_from_next_cycle = TRUE;
                 }
             }
-            else if (cpu->decode.opcode == OPCODE_MUL)
+            else if (APEX_fu_of(cpu->decode.opcode) == STAGE_MULTIPLIER)
             {
                 if (cpu->multiplier.stall == 0)
                 {
@@ -341,7 +685,7 @@ APEX_decode(APEX_CPU *cpu)
                 }
                 else
                 {
-                    if (cpu->state_regs[cpu->decode.rd] == 1)
+                    if (APEX_writes_register(cpu->decode.opcode) && (cpu->state_regs[cpu->decode.rd] == 1))
                     {
                         cpu->state_regs[cpu->decode.rd] = 0;
                     }
@@ -357,7 +701,7 @@ APEX_decode(APEX_CPU *cpu)
                 }
                 else
                 {
-                    if (cpu->state_regs[cpu->decode.rd] == 1)
+                    if (APEX_writes_register(cpu->decode.opcode) && (cpu->state_regs[cpu->decode.rd] == 1))
                     {
                         cpu->state_regs[cpu->decode.rd] = 0;
                     }
@@ -370,23 +714,23 @@ APEX_decode(APEX_CPU *cpu)
         ALLOW_DECODE:;
             /*MJXX simple scoreboarding logic*/
             /*set the status of registers which are currently being used as 1*/
-            if (cpu->state_regs[cpu->decode.rd] == 1 || cpu->state_regs[cpu->decode.rs1] == 1 || cpu->state_regs[cpu->decode.rs2] == 1 || cpu->state_regs[cpu->decode.rs3] == 1)
+            /* Nothing is dispatched behind an unresolved branch, the wrong
+             * path could otherwise reach the load/store or multiplier FU */
+            if (cpu->state_regs[cpu->decode.rd] == 1 || cpu->state_regs[cpu->decode.rs1] == 1 || cpu->state_regs[cpu->decode.rs2] == 1 || cpu->state_regs[cpu->decode.rs3] == 1 || branch_pending(cpu, cpu->decode.thread))
             {
+                cpu->threads[cpu->decode.thread].hazard_stalls++;
                 if (ENABLE_DEBUG_MESSAGES)
                 {
                     printf("\nMJXX inside decode:operation has been stalled\n");
                 }
-                if ((ENABLE_DEBUG_MESSAGES) || (cpu->command == DISPLAY) || (cpu->command == SINGLE_STEP))
-                {
-                    print_stage_content("Decode/RF", &cpu->decode);
-                }
+                stage_activity(cpu, STAGE_DECODE, &cpu->decode);
                 cpu->fetch_from_next_cycle = TRUE;
             }
             else
             {
                 /* MJXX simple scoreboarding logic*/
                 /* Set the destination register state indicator till the instruction execution is completed*/
-                if ((cpu->decode.opcode != OPCODE_STORE) && (cpu->decode.opcode != OPCODE_STR) && (cpu->decode.opcode != OPCODE_CMP) && (cpu->decode.opcode != OPCODE_NOP) && (cpu->decode.opcode != OPCODE_BZ) && (cpu->decode.opcode != OPCODE_BNZ))
+                if (APEX_writes_register(cpu->decode.opcode))
                 {
                     cpu->state_regs[cpu->decode.rd] = 1;
                 }
@@ -482,11 +826,39 @@ APEX_decode(APEX_CPU *cpu)
                     /* MOVC doesn't have register operands */
                     break;
                 }
+
+                case OPCODE_AADD:
+                {
+                    cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
+                    cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];
+                    break;
+                }
+
+                case OPCODE_FENCE:
+                {
+                    /* FENCE doesn't have register operands */
+                    break;
+                }
+
+                case OPCODE_RDCYCLE:
+                case OPCODE_RDINSTRET:
+                case OPCODE_COREID:
+                {
+                    /* Counters are read in the integer FU once all older
+                     * instructions have left the queue */
+                    break;
+                }
+                }
+
+                cpu->decode.issue_cycle = cpu->clock;
+                if (cpu->energy)
+                {
+                    APEX_energy_operands(cpu->energy, cpu->decode.opcode);
                 }
 
                 /* Copy data from decode latch to execute latch*/
                 /* Incase FU unit is busy stall the instructions else push instruction into queue*/
-                if ((cpu->decode.opcode == OPCODE_STR) || (cpu->decode.opcode == OPCODE_LDR) || (cpu->decode.opcode == OPCODE_LOAD) || (cpu->decode.opcode == OPCODE_STORE))
+                if (APEX_fu_of(cpu->decode.opcode) == STAGE_LOAD_STORE)
                 {
                     if (cpu->load_store.stall == 0)
                     {
@@ -495,7 +867,7 @@ APEX_decode(APEX_CPU *cpu)
                     }
                     else
                     {
-                        if (((cpu->decode.opcode == OPCODE_LOAD) || (cpu->decode.opcode == OPCODE_LDR)) && (cpu->state_regs[cpu->decode.rd] == 1))
+                        if (APEX_writes_register(cpu->decode.opcode) && (cpu->state_regs[cpu->decode.rd] == 1))
                         {
                             cpu->state_regs[cpu->decode.rd] = 0;
                         }
@@ -504,7 +876,7 @@ APEX_decode(APEX_CPU *cpu)
                         goto STALL;
                     }
                 }
-                else if (cpu->decode.opcode == OPCODE_MUL)
+                else if (APEX_fu_of(cpu->decode.opcode) == STAGE_MULTIPLIER)
                 {
                     if (cpu->multiplier.stall == 0)
                     {
@@ -513,7 +885,7 @@ APEX_decode(APEX_CPU *cpu)
                     }
                     else
                     {
-                        if (cpu->state_regs[cpu->decode.rd] == 1)
+                        if (APEX_writes_register(cpu->decode.opcode) && (cpu->state_regs[cpu->decode.rd] == 1))
                         {
                             cpu->state_regs[cpu->decode.rd] = 0;
                         }
@@ -530,11 +902,19 @@ APEX_decode(APEX_CPU *cpu)
                     }
                     else
                     {
+                        if (APEX_writes_register(cpu->decode.opcode) && (cpu->state_regs[cpu->decode.rd] == 1))
+                        {
+                            cpu->state_regs[cpu->decode.rd] = 0;
+                        }
                         cpu->decode.stall = 1;
                         goto STALL;
                     }
                 }
                 enqueue(cpu, cpu->decode.number);
+                if (cpu->energy)
+                {
+                    APEX_energy_issue(cpu->energy, cpu->decode.opcode);
+                }
                 if (ENABLE_DEBUG_MESSAGES)
                 {
                     printf("MJXX: value to be added:%d\n", cpu->decode.number);
@@ -542,13 +922,27 @@ APEX_decode(APEX_CPU *cpu)
                 }
                 cpu->decode.has_insn = FALSE;
             STALL:;
-                if ((ENABLE_DEBUG_MESSAGES) || (cpu->command == DISPLAY) || (cpu->command == SINGLE_STEP))
-                {
-                    print_stage_content("Decode/RF", &cpu->decode);
-                }
+                stage_activity(cpu, STAGE_DECODE, &cpu->decode);
             }
         }
     }
+    if (cpu->interval || cpu->live)
+    {
+        int outcome = decode_outcome(cpu, had_insn);
+
+        if (cpu->interval)
+        {
+            APEX_interval_cycle(cpu->interval, cpu, outcome);
+        }
+        if (cpu->live)
+        {
+            APEX_live_cycle(cpu->live, cpu, outcome);
+        }
+    }
+    if (cpu->energy)
+    {
+        APEX_energy_cycle(cpu->energy, cpu);
+    }
 }
 
 /*
@@ -556,11 +950,12 @@ APEX_decode(APEX_CPU *cpu)
  *
  * Note: You are free to edit this function according to your implementation
  */
-static void
+void
 APEX_multiplier_FU(APEX_CPU *cpu)
 {
     if (cpu->multiplier.has_insn)
     {
+        switch_thread(cpu, cpu->multiplier.thread);
         if ((cpu->multiplier.stall == 1) || (cpu->multiplier.stall == 2))
         { /* Incase three cycles are completed process the instruction*/
             if (cpu->multiplier.cycle == 2)
@@ -576,8 +971,9 @@ APEX_multiplier_FU(APEX_CPU *cpu)
                     cpu->zero_flag = FALSE;
                 }
                 cpu->multiplier.stall = 2;
-                /* Copy data from execute latch to memory latch*/
-                if (cpu->instruction_queue[cpu->Front] == cpu->multiplier.number)
+                /* Copy data from execute latch to memory latch, another
+                 * thread may have taken writeback this cycle */
+                if (cpu->instruction_queue[cpu->Front] == cpu->multiplier.number && !cpu->writeback.has_insn)
                 {
                     cpu->multiplier.stall = 0;
                     if (ENABLE_DEBUG_MESSAGES)
@@ -587,18 +983,12 @@ APEX_multiplier_FU(APEX_CPU *cpu)
                     cpu->writeback = cpu->multiplier;
                     cpu->multiplier.has_insn = FALSE;
                 }
-                if ((ENABLE_DEBUG_MESSAGES) || (cpu->command == DISPLAY) || (cpu->command == SINGLE_STEP))
-                {
-                    print_stage_content("Multiplier FU", &cpu->multiplier);
-                }
+                stage_activity(cpu, STAGE_MULTIPLIER, &cpu->multiplier);
             }
             else
             {
                 cpu->multiplier.cycle++;
-                if ((ENABLE_DEBUG_MESSAGES) || (cpu->command == DISPLAY) || (cpu->command == SINGLE_STEP))
-                {
-                    print_stage_content("Multiplier FU", &cpu->multiplier);
-                }
+                stage_activity(cpu, STAGE_MULTIPLIER, &cpu->multiplier);
             }
         }
         else
@@ -608,10 +998,7 @@ APEX_multiplier_FU(APEX_CPU *cpu)
 
             /* Execute logic based on instruction type **/
 
-            if ((ENABLE_DEBUG_MESSAGES) || (cpu->command == DISPLAY) || (cpu->command == SINGLE_STEP))
-            {
-                print_stage_content("Multiplier FU", &cpu->multiplier);
-            }
+            stage_activity(cpu, STAGE_MULTIPLIER, &cpu->multiplier);
         }
     }
 }
@@ -621,48 +1008,108 @@ APEX_multiplier_FU(APEX_CPU *cpu)
  *
  * Note: You are free to edit this function according to your implementation
  */
-static void
+void
 APEX_load_store_FU(APEX_CPU *cpu)
 {
     if (cpu->load_store.has_insn)
     {
+        switch_thread(cpu, cpu->load_store.thread);
         if ((cpu->load_store.stall == 1) || (cpu->load_store.stall == 2))
         { /* Incase four cycles are completed process the instruction*/
-            if (cpu->load_store.cycle == 3)
+            /* Memory is accessed once, the result is kept while the
+             * instruction waits for the head of the queue. Other cores may
+             * write the same words, so the accesses are atomic. */
+            if (cpu->load_store.cycle == 3 && cpu->load_store.stall == 1)
             {
                 switch (cpu->load_store.opcode)
                 {
                 case OPCODE_LOAD:
                 {
                     /* Read from data memory */
-                    cpu->load_store.memory_address = cpu->load_store.rs2_value + cpu->load_store.imm;
-                    cpu->load_store.result_buffer = cpu->data_memory[cpu->load_store.memory_address];
+                    cpu->load_store.memory_address = cpu->load_store.rs1_value + cpu->load_store.imm;
+                    cpu->load_store.result_buffer =
+                        __atomic_load_n(&cpu->data_memory[cpu->load_store.memory_address], __ATOMIC_RELAXED);
                     break;
                 }
                 case OPCODE_STORE:
                 {
                     /* Read from data memory */
                     cpu->load_store.memory_address = cpu->load_store.rs2_value + cpu->load_store.imm;
-                    cpu->data_memory[cpu->load_store.memory_address] = cpu->load_store.rs1_value;
+                    __atomic_store_n(&cpu->data_memory[cpu->load_store.memory_address], cpu->load_store.rs1_value,
+                                     __ATOMIC_RELAXED);
+                    if (cpu->trace)
+                    {
+                        APEX_trace_record(cpu->trace, cpu->clock, TRACE_MEM_WRITE, 0,
+                                          cpu->load_store.memory_address, cpu->load_store.rs1_value);
+                    }
                     break;
                 }
                 case OPCODE_LDR:
                 {
                     /* Read from data memory */
                     cpu->load_store.memory_address = cpu->load_store.rs2_value + cpu->load_store.rs1_value;
-                    cpu->load_store.result_buffer = cpu->data_memory[cpu->load_store.memory_address];
+                    cpu->load_store.result_buffer =
+                        __atomic_load_n(&cpu->data_memory[cpu->load_store.memory_address], __ATOMIC_RELAXED);
                     break;
                 }
                 case OPCODE_STR:
                 {
                     /* Read from data memory */
                     cpu->load_store.memory_address = cpu->load_store.rs1_value + cpu->load_store.rs2_value;
-                    cpu->data_memory[cpu->load_store.memory_address] = cpu->load_store.rs3_value;
+                    __atomic_store_n(&cpu->data_memory[cpu->load_store.memory_address], cpu->load_store.rs3_value,
+                                     __ATOMIC_RELAXED);
+                    if (cpu->trace)
+                    {
+                        APEX_trace_record(cpu->trace, cpu->clock, TRACE_MEM_WRITE, 0,
+                                          cpu->load_store.memory_address, cpu->load_store.rs3_value);
+                    }
+                    break;
+                }
+                case OPCODE_AADD:
+                {
+                    /* Fetch and add, rd gets the old value */
+                    cpu->load_store.memory_address = cpu->load_store.rs1_value;
+                    cpu->load_store.result_buffer =
+                        __atomic_fetch_add(&cpu->data_memory[cpu->load_store.memory_address],
+                                           cpu->load_store.rs2_value, __ATOMIC_SEQ_CST);
+                    if (cpu->trace)
+                    {
+                        APEX_trace_record(cpu->trace, cpu->clock, TRACE_MEM_WRITE, 0,
+                                          cpu->load_store.memory_address,
+                                          cpu->load_store.result_buffer + cpu->load_store.rs2_value);
+                    }
+                    break;
+                }
+                case OPCODE_FENCE:
+                {
+                    /* Older accesses of this core are already done, order
+                     * them before the younger ones on the host too */
+                    __atomic_thread_fence(__ATOMIC_SEQ_CST);
                     break;
                 }
                 }
+
+                if (cpu->prefetch)
+                {
+                    APEX_prefetch_train(cpu->prefetch, &cpu->load_store, cpu->clock);
+                }
+                if (cpu->memprof && cpu->load_store.opcode != OPCODE_FENCE)
+                {
+                    APEX_memprof_access(cpu->memprof, &cpu->load_store, cpu->clock);
+                }
+                if (cpu->interval)
+                {
+                    APEX_interval_memory(cpu->interval, cpu->load_store.opcode);
+                }
+                if (cpu->energy)
+                {
+                    APEX_energy_memory(cpu->energy, cpu->load_store.opcode);
+                }
                 cpu->load_store.stall = 2;
-                if (cpu->instruction_queue[cpu->Front] == cpu->load_store.number)
+            }
+            if (cpu->load_store.cycle == 3)
+            {
+                if (cpu->instruction_queue[cpu->Front] == cpu->load_store.number && !cpu->writeback.has_insn)
                 {
                     /* Copy data from execute latch to memory latch*/
                     cpu->load_store.stall = 0;
@@ -672,19 +1119,13 @@ APEX_load_store_FU(APEX_CPU *cpu)
                     }
                     cpu->writeback = cpu->load_store;
                     cpu->load_store.has_insn = FALSE;
-                    if ((ENABLE_DEBUG_MESSAGES) || (cpu->command == DISPLAY) || (cpu->command == SINGLE_STEP))
-                    {
-                        print_stage_content("Load/Store FU", &cpu->load_store);
-                    }
+                    stage_activity(cpu, STAGE_LOAD_STORE, &cpu->load_store);
                 }
             }
             else
             {
                 cpu->load_store.cycle++;
-                if ((ENABLE_DEBUG_MESSAGES) || (cpu->command == DISPLAY) || (cpu->command == SINGLE_STEP))
-                {
-                    print_stage_content("Load/Store FU", &cpu->load_store);
-                }
+                stage_activity(cpu, STAGE_LOAD_STORE, &cpu->load_store);
             }
         }
         else
@@ -692,10 +1133,13 @@ APEX_load_store_FU(APEX_CPU *cpu)
             cpu->load_store.stall = 1;
             cpu->load_store.cycle = 1;
 
-            if ((ENABLE_DEBUG_MESSAGES) || (cpu->command == DISPLAY) || (cpu->command == SINGLE_STEP))
+            /* A prefetched word needs no address and tag cycles */
+            if (cpu->prefetch && APEX_prefetch_lookup(cpu->prefetch, &cpu->load_store, cpu->clock))
             {
-                print_stage_content("Load/Store FU", &cpu->load_store);
+                cpu->load_store.cycle = 3;
             }
+
+            stage_activity(cpu, STAGE_LOAD_STORE, &cpu->load_store);
         }
     }
 }
@@ -705,14 +1149,15 @@ APEX_load_store_FU(APEX_CPU *cpu)
  *
  * Note: You are free to edit this function according to your implementation
  */
-static void
+void
 APEX_integer_FU(APEX_CPU *cpu)
 {
     if (cpu->integer.has_insn)
     {
+        switch_thread(cpu, cpu->integer.thread);
         if ((cpu->integer.stall == 1) || (cpu->integer.stall == 2))
         { /* Proceed if instruction is at start of queue*/
-            if (cpu->instruction_queue[cpu->Front] == cpu->integer.number)
+            if (cpu->instruction_queue[cpu->Front] == cpu->integer.number && !cpu->writeback.has_insn)
             {
                 goto ALLOW_INTEGER;
             }
@@ -722,7 +1167,7 @@ APEX_integer_FU(APEX_CPU *cpu)
             cpu->integer.stall = 2;
             /* Copy data from execute latch to memory latch*/
             /* Proceed if instruction is at start of queue*/
-            if (cpu->instruction_queue[cpu->Front] == cpu->integer.number)
+            if (cpu->instruction_queue[cpu->Front] == cpu->integer.number && !cpu->writeback.has_insn)
             {
             ALLOW_INTEGER:;
                 cpu->integer.stall = 0;
@@ -864,16 +1309,39 @@ APEX_integer_FU(APEX_CPU *cpu)
                         cpu->pc = cpu->integer.pc + cpu->integer.imm;
 
                         /* Since we are using reverse callbacks for pipeline stages,
-                         * this will prevent the new instruction from being fetched in the current cycle*/
-                        cpu->fetch_from_next_cycle = TRUE;
+                         * this will prevent the new instruction from being fetched in the current cycle,
+                         * unless the loop buffer holds it*/
+                        cpu->fetch_from_next_cycle =
+                            !(cpu->loopbuf && APEX_loopbuf_taken(cpu->loopbuf, cpu->integer.pc, cpu->pc));
 
-                        /* Flush previous stages */
-                        cpu->decode.stall = 0;
-                        cpu->decode.has_insn = FALSE;
+                        /* Flush previous stages of this thread */
+                        if (cpu->decode.thread == cpu->integer.thread)
+                        {
+                            if (cpu->pipeview && cpu->decode.has_insn)
+                            {
+                                APEX_pipeview_flush(cpu->pipeview, &cpu->decode, cpu->clock);
+                            }
+                            if (cpu->energy && cpu->decode.has_insn)
+                            {
+                                APEX_energy_flush(cpu->energy);
+                            }
+                            cpu->decode.stall = 0;
+                            cpu->decode.has_insn = FALSE;
+                        }
 
                         /* Make sure fetch stage is enabled to start fetching from new PC */
+                        cpu->threads[cpu->integer.thread].fetch_done = FALSE;
                         cpu->fetch.has_insn = TRUE;
                     }
+                    if (cpu->trace)
+                    {
+                        APEX_trace_record(cpu->trace, cpu->clock, TRACE_BRANCH, (cpu->zero_flag == TRUE),
+                                          cpu->integer.pc, cpu->integer.pc + cpu->integer.imm);
+                    }
+                    if (cpu->interval)
+                    {
+                        APEX_interval_branch(cpu->interval, (cpu->zero_flag == TRUE));
+                    }
                     break;
                 }
 
@@ -885,16 +1353,62 @@ APEX_integer_FU(APEX_CPU *cpu)
                         cpu->pc = cpu->integer.pc + cpu->integer.imm;
 
                         /* Since we are using reverse callbacks for pipeline stages,
-                         * this will prevent the new instruction from being fetched in the current cycle*/
-                        cpu->fetch_from_next_cycle = TRUE;
+                         * this will prevent the new instruction from being fetched in the current cycle,
+                         * unless the loop buffer holds it*/
+                        cpu->fetch_from_next_cycle =
+                            !(cpu->loopbuf && APEX_loopbuf_taken(cpu->loopbuf, cpu->integer.pc, cpu->pc));
 
-                        /* Flush previous stages */
-                        cpu->decode.stall = 0;
-                        cpu->decode.has_insn = FALSE;
+                        /* Flush previous stages of this thread */
+                        if (cpu->decode.thread == cpu->integer.thread)
+                        {
+                            if (cpu->pipeview && cpu->decode.has_insn)
+                            {
+                                APEX_pipeview_flush(cpu->pipeview, &cpu->decode, cpu->clock);
+                            }
+                            if (cpu->energy && cpu->decode.has_insn)
+                            {
+                                APEX_energy_flush(cpu->energy);
+                            }
+                            cpu->decode.stall = 0;
+                            cpu->decode.has_insn = FALSE;
+                        }
 
                         /* Make sure fetch stage is enabled to start fetching from new PC */
+                        cpu->threads[cpu->integer.thread].fetch_done = FALSE;
                         cpu->fetch.has_insn = TRUE;
                     }
+                    if (cpu->trace)
+                    {
+                        APEX_trace_record(cpu->trace, cpu->clock, TRACE_BRANCH, (cpu->zero_flag == FALSE),
+                                          cpu->integer.pc, cpu->integer.pc + cpu->integer.imm);
+                    }
+                    if (cpu->interval)
+                    {
+                        APEX_interval_branch(cpu->interval, (cpu->zero_flag == FALSE));
+                    }
+                    break;
+                }
+
+                case OPCODE_RDCYCLE:
+                {
+                    /* The instruction is at the head of the queue, so this is
+                     * the cycle every older instruction has completed by */
+                    cpu->integer.result_buffer = cpu->clock;
+                    break;
+                }
+
+                case OPCODE_RDINSTRET:
+                {
+                    /* Older instructions retired in writeback earlier this
+                     * cycle at the latest, so the count covers all of them */
+                    cpu->integer.result_buffer = cpu->insn_completed;
+                    break;
+                }
+
+                case OPCODE_COREID:
+                {
+                    /* Hardware threads are numbered after the cores */
+                    cpu->integer.result_buffer = cpu->core_id * cpu->num_threads + cpu->integer.thread;
                     break;
                 }
 
@@ -927,10 +1441,7 @@ APEX_integer_FU(APEX_CPU *cpu)
             }
         }
 
-        if ((ENABLE_DEBUG_MESSAGES) || (cpu->command == DISPLAY) || (cpu->command == SINGLE_STEP))
-        {
-            print_stage_content("Integer FU", &cpu->integer);
-        }
+        stage_activity(cpu, STAGE_INTEGER, &cpu->integer);
     }
 }
 /*
@@ -938,11 +1449,12 @@ APEX_integer_FU(APEX_CPU *cpu)
  *
  * Note: You are free to edit this function according to your implementation
  */
-static int
+int
 APEX_writeback(APEX_CPU *cpu)
 {
     if (cpu->writeback.has_insn)
     {
+        switch_thread(cpu, cpu->writeback.thread);
         /* Write result to register file based on instruction type */
         switch (cpu->writeback.opcode)
         {
@@ -1028,6 +1540,31 @@ APEX_writeback(APEX_CPU *cpu)
         {
             break;
         }
+        case OPCODE_RDCYCLE:
+        case OPCODE_RDINSTRET:
+        case OPCODE_COREID:
+        {
+            cpu->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
+            break;
+        }
+        case OPCODE_AADD:
+        {
+            cpu->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
+            break;
+        }
+        }
+        if (cpu->trace && APEX_writes_register(cpu->writeback.opcode))
+        {
+            APEX_trace_record(cpu->trace, cpu->clock, TRACE_REG_WRITE, cpu->writeback.rd,
+                              cpu->writeback.pc, cpu->regs[cpu->writeback.rd]);
+        }
+        if (cpu->depgraph)
+        {
+            APEX_depgraph_retire(cpu->depgraph, &cpu->writeback, cpu->clock);
+        }
+        if (cpu->checker)
+        {
+            APEX_checker_retire(cpu->checker, &cpu->writeback, cpu->clock, cpu->regs[cpu->writeback.rd]);
         }
         dequeue(cpu);
         if (ENABLE_DEBUG_MESSAGES)
@@ -1036,20 +1573,29 @@ APEX_writeback(APEX_CPU *cpu)
         }
 
         cpu->insn_completed++;
+        cpu->retired_pc = cpu->writeback.pc;
+        cpu->threads[cpu->writeback.thread].retired++;
         /* MJXX simple scoreboarding logic */
         /* Reset the destination state indicator once execution of instruction is completed */
-        cpu->state_regs[cpu->writeback.rd] = 0;
-        cpu->writeback.has_insn = FALSE;
-
-        if ((ENABLE_DEBUG_MESSAGES) || (cpu->command == DISPLAY) || (cpu->command == SINGLE_STEP))
+        if (APEX_writes_register(cpu->writeback.opcode))
         {
-            print_stage_content("Writeback", &cpu->writeback);
+            cpu->state_regs[cpu->writeback.rd] = 0;
         }
+        if (cpu->energy)
+        {
+            APEX_energy_retire(cpu->energy, APEX_writes_register(cpu->writeback.opcode));
+        }
+        cpu->writeback.has_insn = FALSE;
+
+        stage_activity(cpu, STAGE_WRITEBACK, &cpu->writeback);
 
         if (cpu->writeback.opcode == OPCODE_HALT)
         {
-            /* Stop the APEX simulator */
-            return TRUE;
+            cpu->threads[cpu->writeback.thread].halted = TRUE;
+            cpu->threads[cpu->writeback.thread].halt_cycle = cpu->clock;
+
+            /* Stop the APEX simulator once every thread halted */
+            return all_halted(cpu);
         }
     }
     /* Default */
@@ -1079,13 +1625,19 @@ APEX_cpu_init(const char *filename)
     }
 
     /* Initialize PC, Registers and all pipeline stages */
+    cpu->num_threads = 1;
+    cpu->regs = cpu->threads[0].regs;
+    cpu->state_regs = cpu->threads[0].state_regs;
+    cpu->instruction_queue = cpu->threads[0].instruction_queue;
     cpu->pc = 4000;
     memset(cpu->regs, 0, sizeof(int) * REG_FILE_SIZE);
     memset(cpu->state_regs, 0, sizeof(int) * REG_FILE_SIZE);
+    cpu->data_memory = cpu->memory_store;
     memset(cpu->data_memory, 0, sizeof(int) * DATA_MEMORY_SIZE);
     memset(cpu->instruction_queue, 0, sizeof(int) * QUEUE_SIZE);
-    cpu->Front = -1;
+    cpu->Front = 0;
     cpu->Rear = -1;
+    cpu->queue_count = 0;
     cpu->single_step = ENABLE_MULTIPLE_STEP;
 
     /* Parse input file and create code memory */
@@ -1145,12 +1697,233 @@ int APEX_cpu_simulator(const char *command)
 
         return SHOWMEM;
     }
+    else if (strcmp(command, "debug") == 0)
+    {
+
+        return DEBUGGER;
+    }
+    else if (strcmp(command, "estimate") == 0)
+    {
+
+        return ESTIMATE;
+    }
     else
     {
         return 0;
     }
 }
 
+#if ENABLE_HOST_PROFILE
+/* Same as APEX_cpu_cycle(), timing each stage on the host */
+static int
+APEX_cpu_cycle_profiled(APEX_CPU *cpu)
+{
+    uint64_t *stage_ns = cpu->profile->stage_ns;
+    uint64_t t0, t1;
+
+    cpu->profile->sampled_cycles++;
+    t0 = APEX_profile_now();
+    if (APEX_writeback(cpu))
+    {
+        stage_ns[STAGE_WRITEBACK] += APEX_profile_now() - t0;
+        return TRUE;
+    }
+    t1 = APEX_profile_now();
+    stage_ns[STAGE_WRITEBACK] += t1 - t0;
+    APEX_load_store_FU(cpu);
+    t0 = APEX_profile_now();
+    stage_ns[STAGE_LOAD_STORE] += t0 - t1;
+    APEX_multiplier_FU(cpu);
+    t1 = APEX_profile_now();
+    stage_ns[STAGE_MULTIPLIER] += t1 - t0;
+    APEX_integer_FU(cpu);
+    t0 = APEX_profile_now();
+    stage_ns[STAGE_INTEGER] += t0 - t1;
+    APEX_decode(cpu);
+    t1 = APEX_profile_now();
+    stage_ns[STAGE_DECODE] += t1 - t0;
+    APEX_fetch(cpu);
+    stage_ns[STAGE_FETCH] += APEX_profile_now() - t1;
+    return FALSE;
+}
+#endif
+
+/* Prints the register file and data memory */
+void APEX_cpu_print_state(const APEX_CPU *cpu)
+{
+    print_reg_file(cpu);
+    print_memory_file(cpu);
+}
+
+void APEX_cpu_print_registers(const APEX_CPU *cpu)
+{
+    print_reg_file(cpu);
+}
+
+void APEX_cpu_print_memory(const APEX_CPU *cpu)
+{
+    print_memory_file(cpu);
+}
+
+/* Every thread runs the program from the start on its own registers */
+void APEX_cpu_set_threads(APEX_CPU *cpu, int num_threads, int policy)
+{
+    int t;
+
+    for (t = 1; t < num_threads; ++t)
+    {
+        memset(&cpu->threads[t], 0, sizeof(APEX_Thread));
+        cpu->threads[t].pc = 4000;
+        cpu->threads[t].Rear = -1;
+    }
+    cpu->num_threads = num_threads;
+    cpu->smt_policy = policy;
+    cpu->last_thread = num_threads - 1;
+}
+
+static void
+smt_report(const APEX_CPU *cpu)
+{
+    const APEX_Thread *thread;
+    int cycles = cpu->clock > 0 ? cpu->clock : 1;
+    int t;
+
+    fprintf(stderr, "APEX_SMT: %d threads, %s fetch, IPC %.3f over %d cycles\n", cpu->num_threads,
+            cpu->smt_policy == SMT_POLICY_READY ? "ready" : "round-robin",
+            (double)cpu->insn_completed / cycles, cycles);
+    for (t = 0; t < cpu->num_threads; ++t)
+    {
+        thread = &cpu->threads[t];
+        fprintf(stderr, "APEX_SMT: thread %d: retired %lld, IPC %.3f, fetched %lld, skipped %lld, "
+                        "decode hazard cycles %lld, %s %d\n",
+                t, thread->retired, (double)thread->retired / cycles, thread->fetched, thread->skipped,
+                thread->hazard_stalls, thread->halted ? "halted at cycle" : "running at cycle",
+                thread->halted ? thread->halt_cycle : cpu->clock);
+    }
+}
+
+static int
+pipeline_empty(const APEX_CPU *cpu)
+{
+    return !cpu->decode.has_insn && !cpu->integer.has_insn && !cpu->multiplier.has_insn &&
+           !cpu->load_store.has_insn && !cpu->writeback.has_insn;
+}
+
+/*
+ * Simulates one clock cycle of a run with the per-cycle hooks every run
+ * loop needs: the checkpoint due at this cycle is saved before it, and the
+ * pipeline view is told the cycle starts. The caller advances the clock.
+ * Returns TRUE when HALT retires in writeback.
+ */
+int APEX_cpu_step(APEX_CPU *cpu)
+{
+    /* Saved before the cycle runs, restoring resumes with this cycle */
+    if (cpu->checkpoint_file && cpu->clock == cpu->checkpoint_at)
+    {
+        if (APEX_checkpoint_save(cpu, cpu->checkpoint_file))
+        {
+            fprintf(stderr, "APEX_Error: Unable to write checkpoint %s\n", cpu->checkpoint_file);
+        }
+        else
+        {
+            fprintf(stderr, "APEX_CPU: Checkpoint written to %s at cycle %d\n", cpu->checkpoint_file, cpu->clock);
+        }
+    }
+
+    if (cpu->pipeview)
+    {
+        APEX_pipeview_cycle(cpu->pipeview, cpu->clock);
+    }
+
+    return APEX_cpu_cycle(cpu);
+}
+
+/*
+ * Stops fetch and runs until every fetched instruction has retired, leaving
+ * an empty pipeline with cpu->pc at the next instruction.
+ * Returns TRUE when HALT retires.
+ */
+int APEX_cpu_drain(APEX_CPU *cpu)
+{
+    cpu->fetch.has_insn = FALSE;
+    while (!pipeline_empty(cpu))
+    {
+        if (APEX_cpu_step(cpu))
+        {
+            return TRUE;
+        }
+        cpu->clock++;
+
+        /* A taken branch restarts fetch at its target, which is kept in pc */
+        cpu->fetch.has_insn = FALSE;
+        cpu->fetch_from_next_cycle = FALSE;
+    }
+    return FALSE;
+}
+
+/* Same as APEX_cpu_drain(), squashing the instruction in decode first since
+ * it has not been issued yet */
+int APEX_cpu_flush(APEX_CPU *cpu)
+{
+    if (cpu->decode.has_insn)
+    {
+        cpu->pc = cpu->decode.pc;
+        memset(&cpu->decode, 0, sizeof(CPU_Stage));
+    }
+    return APEX_cpu_drain(cpu);
+}
+
+/*
+ * Simulates one clock cycle, stages are called in reverse order.
+ * Returns TRUE when HALT retires in writeback.
+ */
+int APEX_cpu_cycle(APEX_CPU *cpu)
+{
+#if ENABLE_HOST_PROFILE
+    if (cpu->profile && !(cpu->clock & cpu->profile->period_mask))
+    {
+        return APEX_cpu_cycle_profiled(cpu);
+    }
+#endif
+
+    if (APEX_writeback(cpu))
+    {
+        return TRUE;
+    }
+    if (cpu->multicore)
+    {
+        /* The only stage touching shared memory, ordered between cores when deterministic */
+        APEX_multicore_memory_enter(cpu);
+        APEX_load_store_FU(cpu);
+        APEX_multicore_memory_leave(cpu);
+    }
+    else
+    {
+        APEX_load_store_FU(cpu);
+    }
+    APEX_multiplier_FU(cpu);
+    APEX_integer_FU(cpu);
+    APEX_decode(cpu);
+    APEX_fetch(cpu);
+    return FALSE;
+}
+
+/* Prints what a run that halted ends with */
+void APEX_cpu_print_result(APEX_CPU *cpu)
+{
+    if (cpu->command == SHOWMEM)
+    {
+        printf("MEM[%-2d]=%-2d ", cpu->command_2, cpu->data_memory[cpu->command_2]);
+        printf("APEX_CPU: Simulation Complete, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
+    }
+    else
+    {
+        print_thread_reg_files(cpu);
+        print_memory_file(cpu);
+        printf("APEX_CPU: Simulation Complete, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
+    }
+}
+
 /*
  * APEX CPU simulation loop
  *
@@ -1171,45 +1944,42 @@ void APEX_cpu_run(APEX_CPU *cpu)
             printf("--------------------------------------------\n");
         }
 
-        if (APEX_writeback(cpu))
+        if (APEX_cpu_step(cpu))
         {
             /* Halt in writeback stage */
-            if (cpu->command == SHOWMEM)
-            {
-                printf("MEM[%-2d]=%-2d ", cpu->command_2, cpu->data_memory[cpu->command_2]);
-                printf("APEX_CPU: Simulation Complete, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
-            }
-            else
-            {
-                print_reg_file(cpu);
-                print_memory_file(cpu);
-                printf("APEX_CPU: Simulation Complete, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
-            }
+            APEX_cpu_print_result(cpu);
             break;
         }
-        APEX_load_store_FU(cpu);
-        APEX_multiplier_FU(cpu);
-        APEX_integer_FU(cpu);
-        APEX_decode(cpu);
-        APEX_fetch(cpu);
-        print_reg_file(cpu);
-        print_memory_file(cpu);
+        /* A threaded checker may notice a few cycles after the retirement it reports */
+        if (cpu->checker && APEX_checker_diverged(cpu->checker))
+        {
+            print_thread_reg_files(cpu);
+            print_memory_file(cpu);
+            printf("APEX_CPU: Simulation Stopped, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
+            break;
+        }
+        /* Per cycle state is only shown when the pipeline is being displayed */
+        if ((cpu->command == DISPLAY) || (cpu->command == SINGLE_STEP))
+        {
+            print_thread_reg_files(cpu);
+            print_memory_file(cpu);
+        }
         if (ENABLE_DEBUG_MESSAGES)
         {
-            print_reg_file(cpu);
+            print_thread_reg_files(cpu);
         }
         if ((cpu->command_2 != 0) && (cpu->command != SHOWMEM))
         {
             if (cpu->clock == cpu->command_2)
             {
-                print_reg_file(cpu);
+                print_thread_reg_files(cpu);
                 print_memory_file(cpu);
                 printf("Enter additional cycle number to run or 0 to quit:\n");
                 scanf("%d", &user_prompt_cycle);
 
                 if (user_prompt_cycle == 0)
                 {
-                    print_reg_file(cpu);
+                    print_thread_reg_files(cpu);
                     print_memory_file(cpu);
                     printf("APEX_CPU: Simulation Stopped, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
                     break;
@@ -1226,7 +1996,7 @@ void APEX_cpu_run(APEX_CPU *cpu)
 
             if ((user_prompt_val == 'Q') || (user_prompt_val == 'q'))
             {
-                print_reg_file(cpu);
+                print_thread_reg_files(cpu);
                 print_memory_file(cpu);
                 printf("APEX_CPU: Simulation Stopped, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
                 break;
@@ -1244,6 +2014,60 @@ void APEX_cpu_run(APEX_CPU *cpu)
  */
 void APEX_cpu_stop(APEX_CPU *cpu)
 {
+    if (cpu->num_threads > 1)
+    {
+        smt_report(cpu);
+    }
+    if (cpu->checker)
+    {
+        APEX_checker_close(cpu->checker);
+    }
+    if (cpu->pipeview)
+    {
+        APEX_pipeview_close(cpu->pipeview, cpu->clock);
+    }
+    if (cpu->trace)
+    {
+        APEX_trace_close(cpu->trace);
+    }
+    if (cpu->profile)
+    {
+        APEX_profile_report(cpu->profile, cpu);
+        APEX_profile_destroy(cpu->profile);
+    }
+    if (cpu->depgraph)
+    {
+        APEX_depgraph_report(cpu->depgraph, cpu);
+        APEX_depgraph_destroy(cpu->depgraph);
+    }
+    if (cpu->memprof)
+    {
+        APEX_memprof_report(cpu->memprof, cpu->clock);
+        APEX_memprof_destroy(cpu->memprof);
+    }
+    if (cpu->interval)
+    {
+        APEX_interval_close(cpu->interval, cpu);
+    }
+    if (cpu->live)
+    {
+        APEX_live_close(cpu->live, cpu);
+    }
+    if (cpu->energy)
+    {
+        APEX_energy_report(cpu->energy, cpu);
+        APEX_energy_destroy(cpu->energy);
+    }
+    if (cpu->prefetch)
+    {
+        APEX_prefetch_report(cpu->prefetch);
+        APEX_prefetch_destroy(cpu->prefetch);
+    }
+    if (cpu->loopbuf)
+    {
+        APEX_loopbuf_report(cpu->loopbuf);
+        APEX_loopbuf_destroy(cpu->loopbuf);
+    }
     free(cpu->code_memory);
     free(cpu);
 }
@@ -36,6 +36,7 @@ typedef struct CPU_Stage
     int rd;
     int imm;
     int number; /*Instruction number to track in queue*/
+    int seq;    /* Dynamic instruction id given at fetch */
     int rs1_value;
     int rs2_value;
     int rs3_value;
@@ -45,28 +46,76 @@ typedef struct CPU_Stage
                /* 1 : STAGE IS BUSY */
                /* 2 : OUTPUT IS READY */
     int cycle; /* To track number of cycles in multiplier and load/store FU*/
+    int issue_cycle; /* Cycle the instruction left decode for its FU */
     int has_insn;
+    int thread; /* Hardware thread the instruction belongs to */
 } CPU_Stage;
 
+/* Context of a hardware thread. The pc, zero flag and queue indices of the
+ * active thread are kept in APEX_CPU and saved here when another thread
+ * becomes active; the arrays are always used in place. */
+typedef struct APEX_Thread
+{
+    int pc;
+    int zero_flag;
+    int Front;
+    int Rear;
+    int queue_count;
+    int regs[REG_FILE_SIZE];
+    int state_regs[REG_FILE_SIZE];
+    int instruction_queue[QUEUE_SIZE];
+    int fetch_done; /* HALT fetched and no taken branch since */
+    int halted;     /* HALT retired */
+    int halt_cycle;
+    long long fetched;
+    long long retired;
+    long long hazard_stalls; /* Cycles decode held an instruction of the thread waiting on a register or branch */
+    long long skipped;       /* Fetch slots passed to another thread because this one was not ready */
+} APEX_Thread;
+
 /* Model of APEX CPU */
 typedef struct APEX_CPU
 {
     int pc;                            /* Current program counter */
     int clock;                         /* Clock cycles elapsed */
     int insn_completed;                /* Instructions retired */
-    int regs[REG_FILE_SIZE];           /* Integer register file */
-    int state_regs[REG_FILE_SIZE];     /* State of the registers*/
+    int retired_pc;                    /* pc of the instruction retired last */
+    int *regs;                         /* Integer register file of the active thread */
+    int *state_regs;                   /* State of the registers*/
     int code_memory_size;              /* Number of instruction in the input file */
     APEX_Instruction *code_memory;     /* Code Memory */
-    int data_memory[DATA_MEMORY_SIZE]; /* Data Memory */
+    int *data_memory;                  /* Data Memory, memory_store unless shared between cores */
+    int memory_store[DATA_MEMORY_SIZE];
     int single_step;                   /* Wait for user input after every cycle */
     int zero_flag;                     /* {TRUE, FALSE} Used by BZ and BNZ to branch */
     int fetch_from_next_cycle;
+    int next_seq;                      /* Dynamic id of the last fetched instruction */
     int command;
     int command_2;
-    int instruction_queue[QUEUE_SIZE]; /* Queue to hold instruction*/
+    int *instruction_queue;            /* Queue to hold instruction*/
     int Rear;
     int Front;
+    int queue_count;                   /* Number of entries in the queue */
+    struct APEX_Pipeview *pipeview;    /* Pipeline timeline export, NULL if disabled */
+    struct APEX_Trace *trace;          /* Binary per-cycle trace, NULL if disabled */
+    struct APEX_Profile *profile;      /* Host-side self-profiling, NULL if disabled */
+    struct APEX_Depgraph *depgraph;    /* Dependency graph / critical path, NULL if disabled */
+    struct APEX_Memprof *memprof;      /* Data memory access profiler, NULL if disabled */
+    struct APEX_Checker *checker;      /* Lockstep check against the ISA model, NULL if disabled */
+    struct APEX_Interval *interval;    /* Interval statistics stream, NULL if disabled */
+    struct APEX_Live *live;            /* Live statistics in shared memory, NULL if disabled */
+    struct APEX_Energy *energy;        /* Activity-based energy model, NULL if disabled */
+    struct APEX_Prefetch *prefetch;    /* Stride prefetcher of the load/store FU, NULL if disabled */
+    struct APEX_Loopbuf *loopbuf;      /* Loop buffer of the front end, NULL if disabled */
+    const char *checkpoint_file;       /* Checkpoint written at checkpoint_at, NULL if disabled */
+    int checkpoint_at;
+    int core_id;                       /* Read by COREID, 0 unless running with --cores */
+    struct APEX_Multicore *multicore;  /* Cores sharing data_memory, NULL for a single core */
+    int num_threads;                   /* Hardware threads, 1 unless running with --smt */
+    int active_thread;                 /* Thread whose context the fields above hold */
+    int last_thread;                   /* Thread fetched from last */
+    int smt_policy;                    /* SMT_POLICY_* */
+    APEX_Thread threads[MAX_THREADS];
 
     /* Pipeline stages */
     CPU_Stage fetch;
@@ -80,6 +129,26 @@ typedef struct APEX_CPU
 APEX_Instruction *create_code_memory(const char *filename, int *size);
 APEX_CPU *APEX_cpu_init(const char *filename);
 int APEX_cpu_simulator(const char *command);
+int APEX_cpu_cycle(APEX_CPU *cpu);
+int APEX_cpu_step(APEX_CPU *cpu);
+int APEX_cpu_drain(APEX_CPU *cpu);
+int APEX_cpu_flush(APEX_CPU *cpu);
+void APEX_cpu_print_state(const APEX_CPU *cpu);
+void APEX_cpu_print_registers(const APEX_CPU *cpu);
+void APEX_cpu_print_memory(const APEX_CPU *cpu);
+void APEX_cpu_set_threads(APEX_CPU *cpu, int num_threads, int policy);
+void APEX_cpu_print_result(APEX_CPU *cpu);
 void APEX_cpu_run(APEX_CPU *cpu);
 void APEX_cpu_stop(APEX_CPU *cpu);
+void APEX_stage_from_instruction(CPU_Stage *stage, const APEX_Instruction *ins, int pc);
+int APEX_format_instruction(const CPU_Stage *stage, char *buf, int size);
+const char *APEX_stage_name(int stage_id);
+int APEX_writes_register(int opcode);
+int APEX_fu_of(int opcode);
+int APEX_is_branch(int opcode);
+int APEX_is_load(int opcode);
+int APEX_is_store(int opcode);
+int APEX_reads_memory(int opcode);
+int APEX_writes_memory(int opcode);
+int APEX_reads_registers(int opcode);
 #endif
@@ -0,0 +1,17 @@
+/*
+ * apex_cpu_internal.h
+ * Contains the stage functions of apex_cpu.c, for tools that run the
+ * pipeline one stage at a time instead of through APEX_cpu_cycle
+ */
+#ifndef _APEX_CPU_INTERNAL_H_
+#define _APEX_CPU_INTERNAL_H_
+
+#include "apex_cpu.h"
+
+void APEX_fetch(APEX_CPU *cpu);
+void APEX_decode(APEX_CPU *cpu);
+void APEX_integer_FU(APEX_CPU *cpu);
+void APEX_multiplier_FU(APEX_CPU *cpu);
+void APEX_load_store_FU(APEX_CPU *cpu);
+int APEX_writeback(APEX_CPU *cpu);
+#endif
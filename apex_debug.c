@@ -0,0 +1,889 @@
+/*
+ * apex_debug.c
+ * Contains the interactive debugger
+ *
+ * Stops are taken between cycles. A pc or instruction breakpoint stops in
+ * the cycle the instruction retires, so its result is already in the
+ * register file. A watchpoint compares its location with the value it had
+ * after the previous cycle and stops when it changed and the condition, if
+ * any, holds for the new value.
+ *
+ * Reverse execution restores a snapshot from the history and replays up to
+ * the cycle wanted without looking at the points. reverse-continue replays
+ * the intervals between snapshots from the latest back, checking the
+ * points quietly, until one has a hit before the current cycle, then goes
+ * to the last such hit and reports it by running its cycle again.
+ */
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+#include "apex_checker.h"
+#include "apex_debug.h"
+#include "apex_history.h"
+
+/* Kinds of stop points */
+#define DBG_BREAK_PC 0
+#define DBG_BREAK_CYCLE 1
+#define DBG_BREAK_INSN 2
+#define DBG_WATCH_REG 3
+#define DBG_WATCH_MEM 4
+
+/* Conditions of a watchpoint */
+#define DBG_OP_CHANGE 0
+#define DBG_OP_EQ 1
+#define DBG_OP_NE 2
+#define DBG_OP_LT 3
+#define DBG_OP_LE 4
+#define DBG_OP_GT 5
+#define DBG_OP_GE 6
+
+/* Why a run returned */
+#define DBG_LIMIT 0    /* Reached the cycle it was bounded by */
+#define DBG_STOPPED 1  /* A pc, instruction or watch point hit */
+#define DBG_HALTED 2
+#define DBG_DIVERGED 3 /* The lockstep checker found a divergence */
+
+static const char *op_names[] = {"changes", "==", "!=", "<", "<=", ">", ">="};
+
+typedef struct DBG_Point
+{
+    int id;
+    int kind;   /* DBG_BREAK_* or DBG_WATCH_* */
+    int target; /* pc, cycle, instruction count, register or address */
+    int op;     /* DBG_OP_*, watchpoints only */
+    int value;
+    int old;    /* Watched value after the last cycle */
+    int hits;
+} DBG_Point;
+
+typedef struct APEX_Debugger
+{
+    APEX_CPU *cpu;
+    DBG_Point points[DEBUG_MAX_POINTS];
+    int num_points;
+    int next_id;
+    int checked; /* pc, instruction or watch points set, the run needs per-cycle checks */
+    int halted;
+    int quiet;   /* Points hit without being reported or counted, while looking for the last hit */
+    APEX_History *history; /* NULL if reverse execution is not available */
+    int next_snapshot;     /* Clock the history takes its next snapshot at */
+} APEX_Debugger;
+
+static int
+watched_value(const APEX_Debugger *dbg, const DBG_Point *point)
+{
+    if (point->kind == DBG_WATCH_REG)
+    {
+        return dbg->cpu->regs[point->target];
+    }
+    return dbg->cpu->data_memory[point->target];
+}
+
+static int
+condition_holds(int op, int v, int value)
+{
+    switch (op)
+    {
+    case DBG_OP_EQ:
+        return v == value;
+    case DBG_OP_NE:
+        return v != value;
+    case DBG_OP_LT:
+        return v < value;
+    case DBG_OP_LE:
+        return v <= value;
+    case DBG_OP_GT:
+        return v > value;
+    case DBG_OP_GE:
+        return v >= value;
+    }
+    return TRUE;
+}
+
+static void
+print_point(const DBG_Point *point)
+{
+    switch (point->kind)
+    {
+    case DBG_BREAK_PC:
+        printf("%d: break at pc(%d)", point->id, point->target);
+        break;
+    case DBG_BREAK_CYCLE:
+        printf("%d: break after cycle %d", point->id, point->target);
+        break;
+    case DBG_BREAK_INSN:
+        printf("%d: break at instruction %d", point->id, point->target);
+        break;
+    case DBG_WATCH_REG:
+        printf("%d: watch R%d", point->id, point->target);
+        break;
+    case DBG_WATCH_MEM:
+        printf("%d: watch MEM[%d]", point->id, point->target);
+        break;
+    }
+    if (point->kind >= DBG_WATCH_REG && point->op != DBG_OP_CHANGE)
+    {
+        printf(" %s %d", op_names[point->op], point->value);
+    }
+    printf(", hit %d times\n", point->hits);
+}
+
+static void
+update_checked(APEX_Debugger *dbg)
+{
+    int i;
+
+    dbg->checked = FALSE;
+    for (i = 0; i < dbg->num_points; ++i)
+    {
+        if (dbg->points[i].kind != DBG_BREAK_CYCLE)
+        {
+            dbg->checked = TRUE;
+        }
+    }
+}
+
+/* Clock value the run has to stop at for the next cycle breakpoint */
+static int
+next_cycle_stop(const APEX_Debugger *dbg, int limit)
+{
+    const DBG_Point *point;
+    int i;
+
+    for (i = 0; i < dbg->num_points; ++i)
+    {
+        point = &dbg->points[i];
+        if (point->kind == DBG_BREAK_CYCLE && point->target >= dbg->cpu->clock && point->target < limit - 1)
+        {
+            limit = point->target + 1;
+        }
+    }
+    return limit;
+}
+
+/* Formats the instruction writeback retired last. The writeback latch
+ * already holds the next one once the FUs ran. */
+static void
+format_retired(const APEX_CPU *cpu, char *text, int size)
+{
+    CPU_Stage stage;
+
+    APEX_stage_from_instruction(&stage, &cpu->code_memory[(cpu->retired_pc - 4000) / 4], cpu->retired_pc);
+    APEX_format_instruction(&stage, text, size);
+}
+
+/* Evaluates the points after the given cycle ran, reports those that hit */
+static int
+check_points(APEX_Debugger *dbg, int retired, int cycle)
+{
+    APEX_CPU *cpu = dbg->cpu;
+    DBG_Point *point;
+    char text[256];
+    int i, v, hit = FALSE;
+
+    for (i = 0; i < dbg->num_points; ++i)
+    {
+        point = &dbg->points[i];
+        switch (point->kind)
+        {
+        case DBG_BREAK_PC:
+            if (retired && cpu->retired_pc == point->target && dbg->quiet)
+            {
+                hit = TRUE;
+            }
+            else if (retired && cpu->retired_pc == point->target)
+            {
+                format_retired(cpu, text, sizeof(text));
+                printf("APEX_Debug: Breakpoint %d, pc(%d) %s retired in cycle %d\n", point->id, point->target,
+                       text, cycle);
+                point->hits++;
+                hit = TRUE;
+            }
+            break;
+        case DBG_BREAK_INSN:
+            if (retired && cpu->insn_completed == point->target && dbg->quiet)
+            {
+                hit = TRUE;
+            }
+            else if (retired && cpu->insn_completed == point->target)
+            {
+                format_retired(cpu, text, sizeof(text));
+                printf("APEX_Debug: Breakpoint %d, instruction %d pc(%d) %s retired in cycle %d\n", point->id,
+                       point->target, cpu->retired_pc, text, cycle);
+                point->hits++;
+                hit = TRUE;
+            }
+            break;
+        case DBG_WATCH_REG:
+        case DBG_WATCH_MEM:
+            v = watched_value(dbg, point);
+            if (v != point->old && condition_holds(point->op, v, point->value) && dbg->quiet)
+            {
+                hit = TRUE;
+            }
+            else if (v != point->old && condition_holds(point->op, v, point->value))
+            {
+                if (point->kind == DBG_WATCH_REG)
+                {
+                    printf("APEX_Debug: Watchpoint %d, R%d %d -> %d in cycle %d\n", point->id, point->target,
+                           point->old, v, cycle);
+                }
+                else
+                {
+                    printf("APEX_Debug: Watchpoint %d, MEM[%d] %d -> %d in cycle %d\n", point->id,
+                           point->target, point->old, v, cycle);
+                }
+                point->hits++;
+                hit = TRUE;
+            }
+            point->old = v;
+            break;
+        }
+    }
+    return hit;
+}
+
+/* Runs until cpu->clock reaches limit, without looking at any point */
+static int
+run_fast(APEX_Debugger *dbg, int limit)
+{
+    APEX_CPU *cpu = dbg->cpu;
+
+    while (cpu->clock < limit)
+    {
+        if (cpu->clock >= dbg->next_snapshot)
+        {
+            dbg->next_snapshot = APEX_history_record(dbg->history);
+        }
+        if (APEX_cpu_step(cpu))
+        {
+            return DBG_HALTED;
+        }
+        cpu->clock++;
+        if (cpu->checker && APEX_checker_diverged(cpu->checker))
+        {
+            return DBG_DIVERGED;
+        }
+    }
+    return DBG_LIMIT;
+}
+
+/* Same as run_fast(), checking the points after every cycle */
+static int
+run_checked(APEX_Debugger *dbg, int limit)
+{
+    APEX_CPU *cpu = dbg->cpu;
+    int retired;
+
+    while (cpu->clock < limit)
+    {
+        if (cpu->clock >= dbg->next_snapshot)
+        {
+            dbg->next_snapshot = APEX_history_record(dbg->history);
+        }
+        retired = cpu->insn_completed;
+        if (APEX_cpu_step(cpu))
+        {
+            /* A point on the HALT itself is still reported */
+            check_points(dbg, TRUE, cpu->clock);
+            return DBG_HALTED;
+        }
+        cpu->clock++;
+        if (cpu->checker && APEX_checker_diverged(cpu->checker))
+        {
+            return DBG_DIVERGED;
+        }
+        if (check_points(dbg, cpu->insn_completed != retired, cpu->clock - 1))
+        {
+            return DBG_STOPPED;
+        }
+    }
+    return DBG_LIMIT;
+}
+
+/* Runs at most until cpu->clock reaches limit, stopping at the points */
+static int
+run(APEX_Debugger *dbg, int limit)
+{
+    APEX_CPU *cpu = dbg->cpu;
+    DBG_Point *point;
+    int stop = next_cycle_stop(dbg, limit);
+    int status, i;
+
+    status = dbg->checked ? run_checked(dbg, stop) : run_fast(dbg, stop);
+    if (status == DBG_LIMIT)
+    {
+        for (i = 0; i < dbg->num_points; ++i)
+        {
+            point = &dbg->points[i];
+            if (point->kind == DBG_BREAK_CYCLE && point->target == cpu->clock - 1)
+            {
+                printf("APEX_Debug: Breakpoint %d, after cycle %d\n", point->id, point->target);
+                point->hits++;
+                status = DBG_STOPPED;
+            }
+        }
+    }
+    if (status == DBG_HALTED)
+    {
+        dbg->halted = TRUE;
+        APEX_cpu_print_state(cpu);
+        printf("APEX_CPU: Simulation Complete, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
+    }
+    else if (status == DBG_DIVERGED)
+    {
+        printf("APEX_Debug: The lockstep checker found a divergence, see stderr when quitting\n");
+    }
+    return status;
+}
+
+/* Watchpoints compare with the values at the cycle the CPU is now at */
+static void
+reset_watches(APEX_Debugger *dbg)
+{
+    DBG_Point *point;
+    int i;
+
+    for (i = 0; i < dbg->num_points; ++i)
+    {
+        point = &dbg->points[i];
+        if (point->kind >= DBG_WATCH_REG)
+        {
+            point->old = watched_value(dbg, point);
+        }
+    }
+}
+
+/* Puts the CPU in its state when the clock read clock, which the history
+ * has to reach and the run has to have got to */
+static void
+travel(APEX_Debugger *dbg, int clock)
+{
+    APEX_history_restore(dbg->history, clock);
+    run_fast(dbg, clock);
+    dbg->halted = FALSE;
+    reset_watches(dbg);
+}
+
+/* Returns the first option that rules out the history, NULL if none does.
+ * What the recorders already wrote cannot be taken back, and the snapshots
+ * leave out the prefetcher and loop buffer, which change the timing */
+static const char *
+history_blocker(const APEX_CPU *cpu)
+{
+    if (cpu->pipeview)
+    {
+        return "--pipeview";
+    }
+    if (cpu->trace)
+    {
+        return "--trace";
+    }
+    if (cpu->depgraph)
+    {
+        return "--critpath";
+    }
+    if (cpu->memprof)
+    {
+        return "--memprof";
+    }
+    if (cpu->interval)
+    {
+        return "--stats";
+    }
+    if (cpu->live)
+    {
+        return "--live";
+    }
+    if (cpu->energy)
+    {
+        return "--energy";
+    }
+    if (cpu->checker)
+    {
+        return "--check";
+    }
+    if (cpu->prefetch)
+    {
+        return "--prefetch";
+    }
+    if (cpu->loopbuf)
+    {
+        return "--loop-buffer";
+    }
+    return NULL;
+}
+
+static int
+reverse_available(const APEX_Debugger *dbg)
+{
+    const char *blocker;
+
+    if (!dbg->history)
+    {
+        blocker = history_blocker(dbg->cpu);
+        if (blocker)
+        {
+            printf("APEX_Debug: Reverse execution is not available with %s\n", blocker);
+        }
+        else
+        {
+            printf("APEX_Debug: Reverse execution is not available, out of memory for the snapshots\n");
+        }
+    }
+    return dbg->history != NULL;
+}
+
+static void
+cmd_reverse_step(APEX_Debugger *dbg, const char *line)
+{
+    APEX_CPU *cpu = dbg->cpu;
+    int n = 1, target;
+
+    if (sscanf(line, "%*s %d", &n) == 1 && n < 1)
+    {
+        printf("APEX_Debug: reverse-step [<n>]\n");
+        return;
+    }
+
+    /* A halted CPU has run the cycle of the HALT without counting it */
+    target = cpu->clock - n + (dbg->halted ? 1 : 0);
+    if (target < APEX_history_start(dbg->history))
+    {
+        target = APEX_history_start(dbg->history);
+        printf("APEX_Debug: The history starts at cycle %d\n", target);
+    }
+    travel(dbg, target);
+    printf("APEX_Debug: Back to cycle %d, pc(%d), %d instructions retired\n", cpu->clock, cpu->pc,
+           cpu->insn_completed);
+}
+
+static void
+cmd_reverse_continue(APEX_Debugger *dbg)
+{
+    APEX_CPU *cpu = dbg->cpu;
+    DBG_Point *point, *cycle_point = NULL;
+    int end = cpu->clock;
+    int latest = dbg->halted ? cpu->clock : cpu->clock - 1; /* Clock of the last state before this one */
+    int found = -1, start, hit, i;
+
+    for (i = 0; i < dbg->num_points; ++i)
+    {
+        point = &dbg->points[i];
+        if (point->kind == DBG_BREAK_CYCLE && point->target + 1 <= latest && point->target + 1 > found &&
+            point->target >= APEX_history_start(dbg->history))
+        {
+            found = point->target + 1;
+            cycle_point = point;
+        }
+    }
+
+    /* The other points need the cycles replayed, the latest interval first */
+    dbg->quiet = TRUE;
+    while (dbg->checked)
+    {
+        start = APEX_history_restore(dbg->history, end - 1);
+        if (start < 0)
+        {
+            break;
+        }
+        reset_watches(dbg);
+        hit = -1;
+        while (run_checked(dbg, end) == DBG_STOPPED)
+        {
+            if (cpu->clock <= latest)
+            {
+                hit = cpu->clock;
+            }
+        }
+        if (hit > found)
+        {
+            found = hit;
+            cycle_point = NULL;
+        }
+        if (found >= start)
+        {
+            break;
+        }
+        end = start;
+    }
+    dbg->quiet = FALSE;
+
+    if (found < 0)
+    {
+        travel(dbg, APEX_history_start(dbg->history));
+        printf("APEX_Debug: No earlier stop, back to the start of the history at cycle %d\n", cpu->clock);
+    }
+    else if (cycle_point)
+    {
+        travel(dbg, found);
+        printf("APEX_Debug: Breakpoint %d, after cycle %d\n", cycle_point->id, cycle_point->target);
+        cycle_point->hits++;
+    }
+    else
+    {
+        /* Running the cycle of the hit again reports it */
+        travel(dbg, found - 1);
+        run_checked(dbg, found);
+    }
+}
+
+static void
+cmd_history(APEX_Debugger *dbg, const char *line)
+{
+    int interval, budget_kb = HISTORY_DEFAULT_BUDGET_KB;
+    int fields = sscanf(line, "%*s %d %d", &interval, &budget_kb);
+
+    if (fields >= 1)
+    {
+        if (interval < 1 || budget_kb < 1)
+        {
+            printf("APEX_Debug: history [<interval> [<budget KB>]]\n");
+            return;
+        }
+        APEX_history_set_limits(dbg->history, interval, budget_kb);
+    }
+    printf("APEX_Debug: ");
+    APEX_history_print(dbg->history);
+}
+
+static int
+parse_op(const char *s)
+{
+    int op;
+
+    for (op = DBG_OP_EQ; op <= DBG_OP_GE; ++op)
+    {
+        if (strcmp(s, op_names[op]) == 0)
+        {
+            return op;
+        }
+    }
+    return -1;
+}
+
+static DBG_Point *
+add_point(APEX_Debugger *dbg, int kind, int target)
+{
+    DBG_Point *point;
+
+    if (dbg->num_points == DEBUG_MAX_POINTS)
+    {
+        printf("APEX_Debug: No more than %d breakpoints and watchpoints\n", DEBUG_MAX_POINTS);
+        return NULL;
+    }
+    point = &dbg->points[dbg->num_points++];
+    memset(point, 0, sizeof(DBG_Point));
+    point->id = dbg->next_id++;
+    point->kind = kind;
+    point->target = target;
+    update_checked(dbg);
+    return point;
+}
+
+static void
+cmd_break(APEX_Debugger *dbg, const char *line)
+{
+    char what[16];
+    int n;
+
+    if (sscanf(line, "%*s %15s %d", what, &n) != 2)
+    {
+        printf("APEX_Debug: break pc|cycle|insn <n>\n");
+        return;
+    }
+    if (strcmp(what, "pc") == 0)
+    {
+        if (n < 4000 || n >= 4000 + 4 * dbg->cpu->code_memory_size || n % 4)
+        {
+            printf("APEX_Debug: pc(%d) is not an instruction of the program\n", n);
+            return;
+        }
+        add_point(dbg, DBG_BREAK_PC, n);
+    }
+    else if (strcmp(what, "cycle") == 0)
+    {
+        add_point(dbg, DBG_BREAK_CYCLE, n);
+    }
+    else if (strcmp(what, "insn") == 0)
+    {
+        add_point(dbg, DBG_BREAK_INSN, n);
+    }
+    else
+    {
+        printf("APEX_Debug: break pc|cycle|insn <n>\n");
+        return;
+    }
+    print_point(&dbg->points[dbg->num_points - 1]);
+}
+
+static void
+cmd_watch(APEX_Debugger *dbg, const char *line)
+{
+    char what[16], op_str[8];
+    int n = 0, value = 0, kind, op = DBG_OP_CHANGE;
+    int fields;
+    DBG_Point *point;
+
+    if (sscanf(line, "%*s %15s", what) != 1)
+    {
+        printf("APEX_Debug: watch R<n>|mem <address> [<op> <value>]\n");
+        return;
+    }
+    if (strcmp(what, "mem") == 0)
+    {
+        kind = DBG_WATCH_MEM;
+        fields = sscanf(line, "%*s %*s %d %7s %d", &n, op_str, &value) - 1;
+        if (fields < 0 || n < 0 || n >= DATA_MEMORY_SIZE)
+        {
+            printf("APEX_Debug: watch mem takes an address below %d\n", DATA_MEMORY_SIZE);
+            return;
+        }
+    }
+    else if (what[0] == 'R' || what[0] == 'r')
+    {
+        kind = DBG_WATCH_REG;
+        n = atoi(what + 1);
+        fields = sscanf(line, "%*s %*s %7s %d", op_str, &value);
+        if (n < 0 || n >= REG_FILE_SIZE)
+        {
+            printf("APEX_Debug: There are registers R0 to R%d\n", REG_FILE_SIZE - 1);
+            return;
+        }
+    }
+    else
+    {
+        printf("APEX_Debug: watch R<n>|mem <address> [<op> <value>]\n");
+        return;
+    }
+    if (fields > 0)
+    {
+        op = parse_op(op_str);
+        if (op < 0 || fields != 2)
+        {
+            printf("APEX_Debug: A condition is one of == != < <= > >= and a value\n");
+            return;
+        }
+    }
+
+    point = add_point(dbg, kind, n);
+    if (point)
+    {
+        point->op = op;
+        point->value = value;
+        point->old = watched_value(dbg, point);
+        print_point(point);
+    }
+}
+
+static void
+cmd_delete(APEX_Debugger *dbg, const char *line)
+{
+    int id, i;
+
+    if (sscanf(line, "%*s %d", &id) != 1)
+    {
+        printf("APEX_Debug: delete <id>\n");
+        return;
+    }
+    for (i = 0; i < dbg->num_points; ++i)
+    {
+        if (dbg->points[i].id == id)
+        {
+            dbg->points[i] = dbg->points[--dbg->num_points];
+            update_checked(dbg);
+            return;
+        }
+    }
+    printf("APEX_Debug: No breakpoint or watchpoint %d\n", id);
+}
+
+static void
+cmd_step(APEX_Debugger *dbg, const char *line)
+{
+    APEX_CPU *cpu = dbg->cpu;
+    int command = cpu->command;
+    int n = 1, i, status = DBG_LIMIT;
+
+    sscanf(line, "%*s %d", &n);
+
+    /* The stages print what they do, as with the display command */
+    for (i = 0; i < n && status == DBG_LIMIT; ++i)
+    {
+        printf("--------------------------------------------\n");
+        printf("Clock Cycle #: %d\n", cpu->clock);
+        printf("--------------------------------------------\n");
+        cpu->command = DISPLAY;
+        status = run(dbg, cpu->clock + 1);
+        cpu->command = command;
+    }
+}
+
+static void
+cmd_mem(APEX_Debugger *dbg, const char *line)
+{
+    int address, count = 1, i;
+
+    if (sscanf(line, "%*s %d %d", &address, &count) < 1 || address < 0 || count < 1)
+    {
+        printf("APEX_Debug: mem <address> [<count>]\n");
+        return;
+    }
+    for (i = address; i < address + count && i < DATA_MEMORY_SIZE; ++i)
+    {
+        printf("MEM[%-2d]=%-2d ", i, dbg->cpu->data_memory[i]);
+        if ((i - address) % 8 == 7)
+        {
+            printf("\n");
+        }
+    }
+    printf("\n");
+}
+
+static void
+print_help(void)
+{
+    printf("break pc|cycle|insn <n>              Stop when pc(<n>) or the <n>th instruction retires, or after cycle <n>\n");
+    printf("watch R<n>|mem <address> [<op> <v>]  Stop when the value changes, op is one of == != < <= > >=\n");
+    printf("delete <id>                          Remove a breakpoint or watchpoint\n");
+    printf("info                                 List breakpoints and watchpoints\n");
+    printf("continue                             Run at full speed to the next stop or HALT\n");
+    printf("step [<n>]                           Run <n> cycles showing the stages (default 1)\n");
+    printf("regs                                 Show the registers, pc and zero flag\n");
+    printf("mem <address> [<count>]              Show data memory\n");
+    printf("reverse-step [<n>]                   Go back <n> cycles (default 1)\n");
+    printf("reverse-continue                     Go back to the last stop before the current cycle\n");
+    printf("history [<interval> [<budget KB>]]   Show or set how often snapshots are taken and the memory they use\n");
+    printf("quit                                 Stop the simulation\n");
+}
+
+void APEX_debug_run(APEX_CPU *cpu)
+{
+    APEX_Debugger *dbg;
+    char line[256], cmd[32];
+    int i;
+
+    dbg = calloc(1, sizeof(APEX_Debugger));
+    if (!dbg)
+    {
+        fprintf(stderr, "APEX_Error: Unable to start the debugger\n");
+        return;
+    }
+    dbg->cpu = cpu;
+    dbg->next_id = 1;
+    dbg->next_snapshot = INT_MAX;
+
+    if (!history_blocker(cpu))
+    {
+        dbg->history = APEX_history_create(cpu, HISTORY_DEFAULT_INTERVAL, HISTORY_DEFAULT_BUDGET_KB);
+        if (dbg->history)
+        {
+            dbg->next_snapshot = cpu->clock + HISTORY_DEFAULT_INTERVAL;
+        }
+    }
+    printf("APEX_Debug: %d instructions loaded, type help for the commands\n", cpu->code_memory_size);
+
+    while (TRUE)
+    {
+        printf("(apex) ");
+        fflush(stdout);
+        if (!fgets(line, sizeof(line), stdin))
+        {
+            break;
+        }
+        if (sscanf(line, "%31s", cmd) != 1)
+        {
+            continue;
+        }
+
+        if (strcmp(cmd, "quit") == 0 || strcmp(cmd, "q") == 0)
+        {
+            break;
+        }
+        else if (strcmp(cmd, "help") == 0 || strcmp(cmd, "h") == 0)
+        {
+            print_help();
+        }
+        else if (strcmp(cmd, "break") == 0 || strcmp(cmd, "b") == 0)
+        {
+            cmd_break(dbg, line);
+        }
+        else if (strcmp(cmd, "watch") == 0 || strcmp(cmd, "w") == 0)
+        {
+            cmd_watch(dbg, line);
+        }
+        else if (strcmp(cmd, "delete") == 0 || strcmp(cmd, "d") == 0)
+        {
+            cmd_delete(dbg, line);
+        }
+        else if (strcmp(cmd, "info") == 0 || strcmp(cmd, "i") == 0)
+        {
+            for (i = 0; i < dbg->num_points; ++i)
+            {
+                print_point(&dbg->points[i]);
+            }
+        }
+        else if (strcmp(cmd, "regs") == 0 || strcmp(cmd, "r") == 0)
+        {
+            APEX_cpu_print_registers(cpu);
+            printf("pc(%d) Z[%d] cycle %d, %d instructions retired\n", cpu->pc, cpu->zero_flag, cpu->clock,
+                   cpu->insn_completed);
+        }
+        else if (strcmp(cmd, "mem") == 0 || strcmp(cmd, "m") == 0)
+        {
+            cmd_mem(dbg, line);
+        }
+        else if (strcmp(cmd, "reverse-step") == 0 || strcmp(cmd, "rs") == 0)
+        {
+            if (reverse_available(dbg))
+            {
+                cmd_reverse_step(dbg, line);
+            }
+        }
+        else if (strcmp(cmd, "reverse-continue") == 0 || strcmp(cmd, "rc") == 0)
+        {
+            if (reverse_available(dbg))
+            {
+                cmd_reverse_continue(dbg);
+            }
+        }
+        else if (strcmp(cmd, "history") == 0)
+        {
+            if (reverse_available(dbg))
+            {
+                cmd_history(dbg, line);
+            }
+        }
+        else if (dbg->halted && (strcmp(cmd, "continue") == 0 || strcmp(cmd, "c") == 0 ||
+                                 strcmp(cmd, "step") == 0 || strcmp(cmd, "s") == 0))
+        {
+            printf("APEX_Debug: The program has halted\n");
+        }
+        else if (strcmp(cmd, "continue") == 0 || strcmp(cmd, "c") == 0)
+        {
+            run(dbg, INT_MAX);
+        }
+        else if (strcmp(cmd, "step") == 0 || strcmp(cmd, "s") == 0)
+        {
+            cmd_step(dbg, line);
+        }
+        else
+        {
+            printf("APEX_Debug: Unknown command %s, type help for the commands\n", cmd);
+        }
+    }
+
+    if (!dbg->halted)
+    {
+        printf("APEX_CPU: Simulation Stopped, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
+    }
+    if (dbg->history)
+    {
+        APEX_history_destroy(dbg->history);
+    }
+    free(dbg);
+}
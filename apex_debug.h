@@ -0,0 +1,20 @@
+/*
+ * apex_debug.h
+ * Contains declarations for the interactive debugger
+ *
+ * The debug command reads commands from stdin instead of prompting every
+ * cycle. Between stops the pipeline runs at full speed: cycle breakpoints
+ * only bound the loop, and the per-cycle checks of pc and instruction
+ * breakpoints and of watchpoints are in a separate loop that is used only
+ * while one of them is set.
+ */
+#ifndef _APEX_DEBUG_H_
+#define _APEX_DEBUG_H_
+
+#include "apex_cpu.h"
+
+/* Breakpoints and watchpoints that can be set at the same time */
+#define DEBUG_MAX_POINTS 64
+
+void APEX_debug_run(APEX_CPU *cpu);
+#endif
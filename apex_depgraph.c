@@ -0,0 +1,341 @@
+/*
+ * apex_depgraph.c
+ * Contains the dynamic dependency graph and critical path analysis
+ *
+ * The longest path ending at each node is computed as instructions retire.
+ * The report walks the graph backwards once to get the longest path
+ * starting at each node, which gives the slack of every instruction.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+#include "apex_depgraph.h"
+
+/* Pseudo register used for the zero flag dependencies of BZ/BNZ */
+#define DEP_ZERO_FLAG REG_FILE_SIZE
+#define DEP_MAX_PREDS 4
+
+typedef struct DEP_Node
+{
+    int number;                 /* Instruction number */
+    int latency;                /* Cycles from issue to writeback */
+    int preds[DEP_MAX_PREDS];   /* Producer nodes, -1 when unused */
+    int crit_pred;              /* Producer on the longest path to this node */
+    long long head;             /* Longest path ending here, including latency */
+} DEP_Node;
+
+struct APEX_Depgraph
+{
+    DEP_Node *nodes;
+    int count;
+    int capacity;
+    int last_writer[REG_FILE_SIZE + 1];   /* Node that last wrote each register / the flag */
+    int mem_writer[DATA_MEMORY_SIZE];     /* Node that last wrote each memory word */
+    int num_insns;
+    const APEX_Instruction *code_memory;
+    const char *report_file;
+    int failed; /* Out of memory, nodes freed and later instructions dropped */
+};
+
+/* Instructions that set the zero flag when they execute */
+static int
+dep_sets_flag(int opcode)
+{
+    switch (opcode)
+    {
+    case OPCODE_ADD:
+    case OPCODE_ADDL:
+    case OPCODE_SUB:
+    case OPCODE_SUBL:
+    case OPCODE_MUL:
+    case OPCODE_DIV:
+    case OPCODE_AND:
+    case OPCODE_OR:
+    case OPCODE_XOR:
+    case OPCODE_CMP:
+    case OPCODE_MOVC:
+        return TRUE;
+    }
+    return FALSE;
+}
+
+/* Fills srcs with the registers an instruction reads, returns how many */
+static int
+dep_sources(const CPU_Stage *stage, int *srcs)
+{
+    if (APEX_is_branch(stage->opcode))
+    {
+        srcs[0] = DEP_ZERO_FLAG;
+        return 1;
+    }
+    srcs[0] = stage->rs1;
+    srcs[1] = stage->rs2;
+    srcs[2] = stage->rs3;
+    return APEX_reads_registers(stage->opcode);
+}
+
+APEX_Depgraph *
+APEX_depgraph_create(const APEX_CPU *cpu, const char *report_file)
+{
+    APEX_Depgraph *graph;
+    int i;
+
+    graph = calloc(1, sizeof(APEX_Depgraph));
+    if (!graph)
+    {
+        return NULL;
+    }
+
+    for (i = 0; i <= REG_FILE_SIZE; ++i)
+    {
+        graph->last_writer[i] = -1;
+    }
+    for (i = 0; i < DATA_MEMORY_SIZE; ++i)
+    {
+        graph->mem_writer[i] = -1;
+    }
+    graph->num_insns = cpu->code_memory_size;
+    graph->code_memory = cpu->code_memory;
+    graph->report_file = report_file;
+    return graph;
+}
+
+static void
+dep_add_pred(APEX_Depgraph *graph, DEP_Node *node, int *npreds, int pred)
+{
+    int i;
+
+    if (pred < 0)
+    {
+        return;
+    }
+    for (i = 0; i < *npreds; ++i)
+    {
+        if (node->preds[i] == pred)
+        {
+            return;
+        }
+    }
+    node->preds[(*npreds)++] = pred;
+
+    if (node->crit_pred < 0 || graph->nodes[pred].head > graph->nodes[node->crit_pred].head)
+    {
+        node->crit_pred = pred;
+    }
+}
+
+/* Called from writeback for every retiring instruction */
+void APEX_depgraph_retire(APEX_Depgraph *graph, const CPU_Stage *stage, int clock)
+{
+    DEP_Node *node, *nodes;
+    int srcs[3];
+    int nsrcs, npreds = 0;
+    int id, i;
+
+    if (graph->failed)
+    {
+        return;
+    }
+
+    if (graph->count == graph->capacity)
+    {
+        int capacity = graph->capacity ? graph->capacity * 2 : 4096;
+
+        nodes = realloc(graph->nodes, sizeof(DEP_Node) * capacity);
+        if (!nodes)
+        {
+            /* A graph with a gap would report a wrong path, stop the analysis */
+            fprintf(stderr, "APEX_Error: Out of memory for the dependency graph at instruction %d\n",
+                    graph->count + 1);
+            free(graph->nodes);
+            graph->nodes = NULL;
+            graph->failed = TRUE;
+            return;
+        }
+        graph->nodes = nodes;
+        graph->capacity = capacity;
+    }
+
+    id = graph->count++;
+    node = &graph->nodes[id];
+    node->number = stage->number;
+    node->latency = clock - stage->issue_cycle;
+    node->crit_pred = -1;
+    for (i = 0; i < DEP_MAX_PREDS; ++i)
+    {
+        node->preds[i] = -1;
+    }
+
+    nsrcs = dep_sources(stage, srcs);
+    for (i = 0; i < nsrcs; ++i)
+    {
+        dep_add_pred(graph, node, &npreds, graph->last_writer[srcs[i]]);
+    }
+
+    if (APEX_reads_memory(stage->opcode) && stage->memory_address >= 0 && stage->memory_address < DATA_MEMORY_SIZE)
+    {
+        dep_add_pred(graph, node, &npreds, graph->mem_writer[stage->memory_address]);
+    }
+
+    node->head = node->latency + (node->crit_pred >= 0 ? graph->nodes[node->crit_pred].head : 0);
+
+    /* Record what this instruction produces */
+    if (APEX_writes_memory(stage->opcode) && stage->memory_address >= 0 && stage->memory_address < DATA_MEMORY_SIZE)
+    {
+        graph->mem_writer[stage->memory_address] = id;
+    }
+    if (APEX_writes_register(stage->opcode))
+    {
+        graph->last_writer[stage->rd] = id;
+    }
+    if (dep_sets_flag(stage->opcode))
+    {
+        graph->last_writer[DEP_ZERO_FLAG] = id;
+    }
+}
+
+void APEX_depgraph_report(APEX_Depgraph *graph, const APEX_CPU *cpu)
+{
+    FILE *fp = stderr;
+    long long *tail;
+    long long critical = 0, slack;
+    long long fu_latency[NUM_STAGES] = {0};
+    long long fu_crit_latency[NUM_STAGES] = {0};
+    long long *slack_sum;
+    int *on_path, *executed;
+    int last = -1;
+    int i, j, n, fu;
+    char text[256];
+    CPU_Stage stage;
+
+    if (graph->failed)
+    {
+        if (graph->report_file)
+        {
+            fp = fopen(graph->report_file, "w");
+        }
+        if (!fp)
+        {
+            fprintf(stderr, "APEX_Error: Unable to write critical path report\n");
+            return;
+        }
+        fprintf(fp, "----------\n%s\n----------\n", "Critical Path:");
+        fprintf(fp, "analysis stopped at instruction %d, out of memory for the dependency graph\n",
+                graph->count + 1);
+        if (fp != stderr)
+        {
+            fclose(fp);
+        }
+        return;
+    }
+
+    if (!graph->count)
+    {
+        return;
+    }
+
+    tail = malloc(sizeof(long long) * graph->count);
+    slack_sum = calloc(graph->num_insns + 1, sizeof(long long));
+    on_path = calloc(graph->num_insns + 1, sizeof(int));
+    executed = calloc(graph->num_insns + 1, sizeof(int));
+    if (graph->report_file)
+    {
+        fp = fopen(graph->report_file, "w");
+    }
+    if (!fp || !tail || !slack_sum || !on_path || !executed)
+    {
+        fprintf(stderr, "APEX_Error: Unable to write critical path report\n");
+        if (fp && fp != stderr)
+        {
+            fclose(fp);
+        }
+        free(tail);
+        free(slack_sum);
+        free(on_path);
+        free(executed);
+        return;
+    }
+
+    /* Longest path starting at each node, consumers come after producers */
+    for (i = 0; i < graph->count; ++i)
+    {
+        tail[i] = graph->nodes[i].latency;
+        if (graph->nodes[i].head > critical)
+        {
+            critical = graph->nodes[i].head;
+            last = i;
+        }
+    }
+    for (i = graph->count - 1; i >= 0; --i)
+    {
+        for (j = 0; j < DEP_MAX_PREDS && graph->nodes[i].preds[j] >= 0; ++j)
+        {
+            int p = graph->nodes[i].preds[j];
+
+            if (graph->nodes[p].latency + tail[i] > tail[p])
+            {
+                tail[p] = graph->nodes[p].latency + tail[i];
+            }
+        }
+    }
+
+    for (i = 0; i < graph->count; ++i)
+    {
+        n = graph->nodes[i].number;
+        fu = APEX_fu_of(graph->code_memory[n - 1].opcode);
+        slack = critical - (graph->nodes[i].head + tail[i] - graph->nodes[i].latency);
+        fu_latency[fu] += graph->nodes[i].latency;
+        slack_sum[n] += slack;
+        executed[n]++;
+    }
+
+    /* Walk the critical path back from its last instruction */
+    for (i = last; i >= 0; i = graph->nodes[i].crit_pred)
+    {
+        n = graph->nodes[i].number;
+        on_path[n]++;
+        fu_crit_latency[APEX_fu_of(graph->code_memory[n - 1].opcode)] += graph->nodes[i].latency;
+    }
+
+    fprintf(fp, "----------\n%s\n----------\n", "Critical Path:");
+    fprintf(fp, "cycles = %d, instructions = %d, critical path = %lld cycles (%.1f%% of run)\n",
+            cpu->clock, graph->count, critical, 100.0 * critical / (cpu->clock ? cpu->clock : 1));
+    fprintf(fp, "%-15s %14s %14s %14s\n", "FU", "path cycles", "path share", "busy share");
+    for (fu = STAGE_INTEGER; fu <= STAGE_LOAD_STORE; ++fu)
+    {
+        fprintf(fp, "%-15s %14lld %13.1f%% %13.1f%%\n", APEX_stage_name(fu), fu_crit_latency[fu],
+                100.0 * fu_crit_latency[fu] / (critical ? critical : 1),
+                100.0 * fu_latency[fu] / (cpu->clock ? cpu->clock : 1));
+    }
+
+    fprintf(fp, "%-6s %-8s %-28s %10s %10s %12s\n", "insn", "pc", "instruction", "executed",
+            "on path", "avg slack");
+    for (n = 1; n <= graph->num_insns; ++n)
+    {
+        if (!executed[n])
+        {
+            continue;
+        }
+        APEX_stage_from_instruction(&stage, &graph->code_memory[n - 1], 4000 + (n - 1) * 4);
+        APEX_format_instruction(&stage, text, sizeof(text));
+        fprintf(fp, "I%-5d %-8d %-28s %10d %10d %12.1f\n", n, 4000 + (n - 1) * 4, text,
+                executed[n], on_path[n], (double)slack_sum[n] / executed[n]);
+    }
+
+    if (fp != stderr)
+    {
+        fclose(fp);
+    }
+    free(tail);
+    free(slack_sum);
+    free(on_path);
+    free(executed);
+}
+
+void APEX_depgraph_destroy(APEX_Depgraph *graph)
+{
+    free(graph->nodes);
+    free(graph);
+}
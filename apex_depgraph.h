@@ -0,0 +1,23 @@
+/*
+ * apex_depgraph.h
+ * Contains declarations for the dynamic dependency graph and critical path
+ * analysis
+ *
+ * Every retired instruction becomes a node weighted with the number of
+ * cycles from its issue into an FU to its writeback. Edges go from the last
+ * producer of each register it reads, of the zero flag for BZ/BNZ, and of
+ * the memory word for LOAD/LDR. The report goes to the given file, or to
+ * stderr when no file is given.
+ */
+#ifndef _APEX_DEPGRAPH_H_
+#define _APEX_DEPGRAPH_H_
+
+#include "apex_cpu.h"
+
+typedef struct APEX_Depgraph APEX_Depgraph;
+
+APEX_Depgraph *APEX_depgraph_create(const APEX_CPU *cpu, const char *report_file);
+void APEX_depgraph_retire(APEX_Depgraph *graph, const CPU_Stage *stage, int clock);
+void APEX_depgraph_report(APEX_Depgraph *graph, const APEX_CPU *cpu);
+void APEX_depgraph_destroy(APEX_Depgraph *graph);
+#endif
@@ -0,0 +1,334 @@
+/*
+ * apex_energy.c
+ * Contains the activity-based energy model
+ *
+ * The stages only count events. Energy is the dot product of the counts
+ * with the table, taken at the end of every interval and of the run, so
+ * changing the table never changes the cost of a cycle.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+#include "apex_energy.h"
+
+typedef struct EN_Interval
+{
+    int start;
+    int cycles;
+    int retired;
+    double pj;
+} EN_Interval;
+
+struct APEX_Energy
+{
+    long long counts[ENERGY_EVENTS];
+    long long latches[NUM_STAGES]; /* Instructions moved into the latch of each stage */
+    double pj[ENERGY_EVENTS];
+    double frequency_mhz;
+
+    /* Power per interval */
+    int interval;
+    int interval_start;
+    int interval_retired;
+    double interval_pj; /* Energy up to interval_start */
+    EN_Interval *intervals;
+    int num_intervals;
+    int capacity;
+};
+
+static const char *event_names[ENERGY_EVENTS] = {
+    "fetch", "loop_buffer", "rf_read", "rf_write", "alu", "div", "branch", "mul",
+    "agu", "mem_read", "mem_write", "latch", "flush", "cycle"};
+
+/* Energy of every event in pJ, a small in-order core in a recent process */
+static const double default_pj[ENERGY_EVENTS] = {
+    8.0, 1.0, 1.5, 2.0, 1.0, 12.0, 1.0, 4.0, 1.0, 15.0, 17.0, 0.5, 1.0, 3.0};
+
+/* Stage whose energy the event counts toward, the latches excepted */
+static const int event_stages[ENERGY_EVENTS] = {
+    STAGE_FETCH, STAGE_FETCH, STAGE_DECODE, STAGE_WRITEBACK, STAGE_INTEGER, STAGE_INTEGER, STAGE_INTEGER,
+    STAGE_MULTIPLIER, STAGE_LOAD_STORE, STAGE_LOAD_STORE, STAGE_LOAD_STORE, -1, STAGE_DECODE, -1};
+
+static int
+read_table(APEX_Energy *energy, const char *table_file)
+{
+    char line[256], name[64];
+    double value;
+    int line_number = 0;
+    int i, fields;
+    FILE *fp;
+
+    fp = fopen(table_file, "r");
+    if (!fp)
+    {
+        fprintf(stderr, "APEX_Error: Unable to open energy table %s\n", table_file);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), fp))
+    {
+        line_number++;
+        line[strcspn(line, "#\r\n")] = '\0';
+        fields = sscanf(line, "%63s %lf", name, &value);
+        if (fields <= 0)
+        {
+            continue;
+        }
+        if (fields != 2 || value < 0)
+        {
+            fprintf(stderr, "APEX_Error: %s:%d: Expected <name> <value>\n", table_file, line_number);
+            fclose(fp);
+            return -1;
+        }
+        if (strcmp(name, "frequency_mhz") == 0)
+        {
+            energy->frequency_mhz = value;
+            continue;
+        }
+        for (i = 0; i < ENERGY_EVENTS; ++i)
+        {
+            if (strcmp(name, event_names[i]) == 0)
+            {
+                energy->pj[i] = value;
+                break;
+            }
+        }
+        if (i == ENERGY_EVENTS)
+        {
+            fprintf(stderr, "APEX_Error: %s:%d: Unknown event %s\n", table_file, line_number, name);
+            fclose(fp);
+            return -1;
+        }
+    }
+    fclose(fp);
+    return 0;
+}
+
+static double
+total_pj(const APEX_Energy *energy)
+{
+    double pj = 0;
+    int i;
+
+    for (i = 0; i < ENERGY_EVENTS; ++i)
+    {
+        if (i != ENERGY_LATCH)
+        {
+            pj += energy->counts[i] * energy->pj[i];
+        }
+    }
+    for (i = 0; i < NUM_STAGES; ++i)
+    {
+        pj += energy->latches[i] * energy->pj[ENERGY_LATCH];
+    }
+    return pj;
+}
+
+/* Ends the current interval at clock */
+static void
+close_interval(APEX_Energy *energy, int clock, int retired)
+{
+    EN_Interval *entry;
+    double pj;
+
+    if (clock <= energy->interval_start)
+    {
+        return;
+    }
+    if (energy->num_intervals == energy->capacity)
+    {
+        int capacity = energy->capacity ? energy->capacity * 2 : 256;
+        EN_Interval *intervals = realloc(energy->intervals, sizeof(EN_Interval) * capacity);
+
+        if (!intervals)
+        {
+            return;
+        }
+        energy->intervals = intervals;
+        energy->capacity = capacity;
+    }
+    pj = total_pj(energy);
+    entry = &energy->intervals[energy->num_intervals++];
+    entry->start = energy->interval_start;
+    entry->cycles = clock - energy->interval_start;
+    entry->retired = retired - energy->interval_retired;
+    entry->pj = pj - energy->interval_pj;
+
+    energy->interval_start = clock;
+    energy->interval_retired = retired;
+    energy->interval_pj = pj;
+}
+
+APEX_Energy *
+APEX_energy_create(const APEX_CPU *cpu, int interval, const char *table_file)
+{
+    APEX_Energy *energy;
+
+    energy = calloc(1, sizeof(APEX_Energy));
+    if (!energy)
+    {
+        return NULL;
+    }
+    memcpy(energy->pj, default_pj, sizeof(energy->pj));
+    energy->frequency_mhz = ENERGY_DEFAULT_FREQUENCY;
+    if (table_file && read_table(energy, table_file))
+    {
+        free(energy);
+        return NULL;
+    }
+    energy->interval = interval > 0 ? interval : ENERGY_DEFAULT_INTERVAL;
+    energy->interval_start = cpu->clock;
+    energy->interval_retired = cpu->insn_completed;
+    return energy;
+}
+
+/* Called by fetch for every instruction it copies into decode */
+void APEX_energy_fetch(APEX_Energy *energy, int from_loop_buffer)
+{
+    energy->counts[from_loop_buffer ? ENERGY_LOOP_BUFFER : ENERGY_FETCH]++;
+    energy->latches[STAGE_DECODE]++;
+}
+
+/* Called by decode every time it reads the sources of an instruction,
+ * including the reads repeated after its FU turned out busy */
+void APEX_energy_operands(APEX_Energy *energy, int opcode)
+{
+    energy->counts[ENERGY_RF_READ] += APEX_reads_registers(opcode);
+}
+
+/* Called by decode for every instruction it issues to an FU */
+void APEX_energy_issue(APEX_Energy *energy, int opcode)
+{
+    int fu = APEX_fu_of(opcode);
+
+    energy->latches[fu]++;
+    if (fu == STAGE_MULTIPLIER)
+    {
+        energy->counts[ENERGY_MUL]++;
+    }
+    else if (fu == STAGE_LOAD_STORE)
+    {
+        /* FENCE only waits for the FU to drain, it computes no address */
+        if (APEX_reads_memory(opcode) || APEX_writes_memory(opcode))
+        {
+            energy->counts[ENERGY_AGU]++;
+        }
+    }
+    else if (opcode == OPCODE_DIV)
+    {
+        energy->counts[ENERGY_DIV]++;
+    }
+    else if (APEX_is_branch(opcode))
+    {
+        energy->counts[ENERGY_BRANCH]++;
+    }
+    else if (opcode != OPCODE_NOP && opcode != OPCODE_HALT)
+    {
+        energy->counts[ENERGY_ALU]++;
+    }
+}
+
+/* Called by the load/store FU once per instruction that reached memory */
+void APEX_energy_memory(APEX_Energy *energy, int opcode)
+{
+    energy->counts[ENERGY_MEM_READ] += APEX_reads_memory(opcode);
+    energy->counts[ENERGY_MEM_WRITE] += APEX_writes_memory(opcode);
+}
+
+/* Called for every instruction a taken branch squashes */
+void APEX_energy_flush(APEX_Energy *energy)
+{
+    energy->counts[ENERGY_FLUSH]++;
+}
+
+/* Called by writeback for every instruction it retires */
+void APEX_energy_retire(APEX_Energy *energy, int writes_register)
+{
+    energy->counts[ENERGY_RF_WRITE] += writes_register;
+    energy->latches[STAGE_WRITEBACK]++;
+}
+
+/* Counts the cycle in the static energy. Decode calls this last, once the
+ * cycle's events are in, so the interval is closed at cpu->clock + 1, the
+ * first cycle of the next one. */
+void APEX_energy_cycle(APEX_Energy *energy, const APEX_CPU *cpu)
+{
+    energy->counts[ENERGY_CYCLE]++;
+    if (cpu->clock + 1 - energy->interval_start >= energy->interval)
+    {
+        close_interval(energy, cpu->clock + 1, cpu->insn_completed);
+    }
+}
+
+void APEX_energy_report(APEX_Energy *energy, const APEX_CPU *cpu)
+{
+    FILE *fp = stderr;
+    double stage_pj[NUM_STAGES];
+    double pj, event_pj, cycles, mw;
+    long long count;
+    int i;
+
+    close_interval(energy, cpu->clock, cpu->insn_completed);
+    pj = total_pj(energy);
+    cycles = energy->counts[ENERGY_CYCLE];
+
+    fprintf(fp, "----------\n%s\n----------\n", "Energy Report:");
+    fprintf(fp, "%-12s %14s %10s %14s %7s\n", "event", "count", "pJ each", "nJ", "share");
+    for (i = 0; i < NUM_STAGES; ++i)
+    {
+        stage_pj[i] = energy->latches[i] * energy->pj[ENERGY_LATCH];
+    }
+    for (i = 0; i < ENERGY_EVENTS; ++i)
+    {
+        if (i == ENERGY_LATCH)
+        {
+            count = energy->latches[STAGE_DECODE] + energy->latches[STAGE_INTEGER] +
+                    energy->latches[STAGE_MULTIPLIER] + energy->latches[STAGE_LOAD_STORE] +
+                    energy->latches[STAGE_WRITEBACK];
+        }
+        else
+        {
+            count = energy->counts[i];
+        }
+        event_pj = count * energy->pj[i];
+        if (event_stages[i] >= 0)
+        {
+            stage_pj[event_stages[i]] += event_pj;
+        }
+        fprintf(fp, "%-12s %14lld %10.2f %14.1f %6.1f%%\n", event_names[i], count, energy->pj[i], event_pj / 1000,
+                pj ? 100 * event_pj / pj : 0.0);
+    }
+
+    fprintf(fp, "\n%-14s %14s %7s\n", "stage", "nJ", "share");
+    for (i = 0; i < NUM_STAGES; ++i)
+    {
+        fprintf(fp, "%-14s %14.1f %6.1f%%\n", APEX_stage_name(i), stage_pj[i] / 1000,
+                pj ? 100 * stage_pj[i] / pj : 0.0);
+    }
+    event_pj = energy->counts[ENERGY_CYCLE] * energy->pj[ENERGY_CYCLE];
+    fprintf(fp, "%-14s %14.1f %6.1f%%\n", "Clock/leakage", event_pj / 1000, pj ? 100 * event_pj / pj : 0.0);
+
+    fprintf(fp, "\ntotal = %.1f nJ, energy per instruction = %.2f pJ, average power = %.2f mW at %.0f MHz\n",
+            pj / 1000, cpu->insn_completed ? pj / cpu->insn_completed : 0.0,
+            cycles ? pj / cycles * energy->frequency_mhz / 1000 : 0.0, energy->frequency_mhz);
+
+    /* Power over time */
+    fprintf(fp, "power per %d cycles:\n", energy->interval);
+    fprintf(fp, "%-12s %12s %12s %12s\n", "cycle", "nJ", "mW", "pJ/insn");
+    for (i = 0; i < energy->num_intervals; ++i)
+    {
+        const EN_Interval *entry = &energy->intervals[i];
+
+        mw = entry->pj / entry->cycles * energy->frequency_mhz / 1000;
+        fprintf(fp, "%-12d %12.1f %12.2f %12.2f\n", entry->start, entry->pj / 1000, mw,
+                entry->retired ? entry->pj / entry->retired : 0.0);
+    }
+}
+
+void APEX_energy_destroy(APEX_Energy *energy)
+{
+    free(energy->intervals);
+    free(energy);
+}
@@ -0,0 +1,56 @@
+/*
+ * apex_energy.h
+ * Contains declarations for the activity-based energy model
+ *
+ * The stages report what they did: instructions fetched from code memory
+ * or the loop buffer, register file reads and writes, FU operations by
+ * type, data memory reads and writes, instructions moved from one latch to
+ * the next and instructions squashed by a taken branch. Every event costs
+ * the energy given for it in the table, and every cycle costs the clock
+ * tree and leakage energy. The report gives the count and energy of every
+ * event, the energy of every stage, the energy per instruction and the
+ * power of every interval of a given number of cycles.
+ *
+ * A table file overrides the defaults, one "<name> <value>" per line with
+ * energies in pJ, frequency_mhz setting the clock the power is computed at
+ * and # starting a comment.
+ */
+#ifndef _APEX_ENERGY_H_
+#define _APEX_ENERGY_H_
+
+#include "apex_cpu.h"
+
+/* Defaults */
+#define ENERGY_DEFAULT_INTERVAL 10000 /* cycles */
+#define ENERGY_DEFAULT_FREQUENCY 1000 /* MHz */
+
+/* Events, in the order of the table */
+#define ENERGY_FETCH 0       /* Instruction read from code memory */
+#define ENERGY_LOOP_BUFFER 1 /* Instruction read from the loop buffer */
+#define ENERGY_RF_READ 2     /* Source register read by decode */
+#define ENERGY_RF_WRITE 3    /* Destination register written by writeback */
+#define ENERGY_ALU 4         /* Integer FU operation other than DIV and branches */
+#define ENERGY_DIV 5
+#define ENERGY_BRANCH 6      /* BZ/BNZ resolved */
+#define ENERGY_MUL 7
+#define ENERGY_AGU 8         /* Address computed by the load/store FU */
+#define ENERGY_MEM_READ 9
+#define ENERGY_MEM_WRITE 10
+#define ENERGY_LATCH 11      /* Instruction moved into the next latch */
+#define ENERGY_FLUSH 12      /* Instruction squashed by a taken branch */
+#define ENERGY_CYCLE 13      /* Clock tree and leakage */
+#define ENERGY_EVENTS 14
+
+typedef struct APEX_Energy APEX_Energy;
+
+APEX_Energy *APEX_energy_create(const APEX_CPU *cpu, int interval, const char *table_file);
+void APEX_energy_fetch(APEX_Energy *energy, int from_loop_buffer);
+void APEX_energy_operands(APEX_Energy *energy, int opcode);
+void APEX_energy_issue(APEX_Energy *energy, int opcode);
+void APEX_energy_memory(APEX_Energy *energy, int opcode);
+void APEX_energy_flush(APEX_Energy *energy);
+void APEX_energy_retire(APEX_Energy *energy, int writes_register);
+void APEX_energy_cycle(APEX_Energy *energy, const APEX_CPU *cpu);
+void APEX_energy_report(APEX_Energy *energy, const APEX_CPU *cpu);
+void APEX_energy_destroy(APEX_Energy *energy);
+#endif
@@ -0,0 +1,451 @@
+/*
+ * apex_estimate.c
+ * Contains the analytical cycle estimator
+ *
+ * A block has at most two successors, the instruction after it and the
+ * target of the BZ/BNZ ending it, so there are at most two edge costs per
+ * block and the analysis is linear in the size of the program.
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+#include "apex_isa.h"
+#include "apex_estimate.h"
+
+/* Cycles from the issue of an instruction to it leaving each FU */
+static const int fu_latency[NUM_STAGES] = {[STAGE_INTEGER] = 1, [STAGE_MULTIPLIER] = 3, [STAGE_LOAD_STORE] = 4};
+
+/* Cycles the first instruction reaches decode at, and the cycles HALT
+ * takes from leaving its FU to the end of the run */
+#define ESTIMATE_FIRST_DECODE 1
+#define ESTIMATE_HALT_CYCLES 1
+
+typedef struct ES_Block
+{
+    int first; /* Code memory indices of the first and last instruction */
+    int last;
+    int fall_block;  /* Block after this one, -1 after HALT or at the end */
+    int taken_block; /* Block of the branch target, -1 without a branch */
+    double visits;
+    double fall; /* Times the block was left for each successor */
+    double taken;
+    int fall_cost;
+    int taken_cost;
+} ES_Block;
+
+/* Timing of the instructions run so far, in cycles from the start */
+typedef struct ES_State
+{
+    int next_decode;   /* Cycle the next instruction reaches decode */
+    int retire;        /* Cycle the last instruction left its FU */
+    int branch_retire; /* Same for the last BZ/BNZ */
+    int reg_ready[REG_FILE_SIZE];
+    int fu_free[NUM_STAGES]; /* Indexed by the STAGE_* identifier of the FU */
+} ES_State;
+
+static int
+max2(int a, int b)
+{
+    return a > b ? a : b;
+}
+
+static double
+elapsed_us(const struct timespec *start, const struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) * 1e6 + (end->tv_nsec - start->tv_nsec) / 1e3;
+}
+
+static void
+state_init(ES_State *s)
+{
+    memset(s, 0, sizeof(ES_State));
+    s->next_decode = ESTIMATE_FIRST_DECODE;
+}
+
+/* Same checks as decode: every register field is looked at, used or not */
+static void
+step(ES_State *s, const APEX_Instruction *ins)
+{
+    int fu = APEX_fu_of(ins->opcode);
+    int issue, leave;
+
+    issue = max2(s->next_decode, s->branch_retire);
+    issue = max2(issue, s->reg_ready[ins->rd]);
+    issue = max2(issue, s->reg_ready[ins->rs1]);
+    issue = max2(issue, s->reg_ready[ins->rs2]);
+    issue = max2(issue, s->reg_ready[ins->rs3]);
+    issue = max2(issue, s->fu_free[fu]);
+
+    /* Instructions leave their FU in order, one per cycle */
+    leave = max2(issue + fu_latency[fu], s->retire + 1);
+    if (APEX_writes_register(ins->opcode))
+    {
+        /* Written back the next cycle, before decode looks at it */
+        s->reg_ready[ins->rd] = leave + 1;
+    }
+    s->fu_free[fu] = leave;
+    s->retire = leave;
+    s->next_decode = issue + 1;
+    if (APEX_is_branch(ins->opcode))
+    {
+        s->branch_retire = leave;
+    }
+}
+
+static void
+run_block(ES_State *s, const APEX_CPU *cpu, const ES_Block *block)
+{
+    int i;
+
+    for (i = block->first; i <= block->last; ++i)
+    {
+        step(s, &cpu->code_memory[i]);
+    }
+}
+
+/* Cycles block b adds when run after block a */
+static int
+edge_cost(const APEX_CPU *cpu, const ES_Block *a, const ES_Block *b, int taken)
+{
+    ES_State s;
+    int base;
+
+    state_init(&s);
+    run_block(&s, cpu, a);
+    base = s.retire;
+    if (taken)
+    {
+        /* Fetch skips the cycle the branch resolves in */
+        s.next_decode = s.branch_retire + 2;
+    }
+    run_block(&s, cpu, b);
+    return s.retire - base;
+}
+
+/* Splits code memory into blocks, returns their number or -1 */
+static int
+find_blocks(const APEX_CPU *cpu, ES_Block *blocks, int *block_of)
+{
+    const APEX_Instruction *ins;
+    int *leader = calloc(cpu->code_memory_size + 1, sizeof(int));
+    int num_blocks = 0;
+    int i, target;
+
+    if (!leader)
+    {
+        return -1;
+    }
+    leader[0] = TRUE;
+    for (i = 0; i < cpu->code_memory_size; ++i)
+    {
+        ins = &cpu->code_memory[i];
+        if (APEX_is_branch(ins->opcode) || ins->opcode == OPCODE_HALT)
+        {
+            leader[i + 1] = TRUE;
+        }
+        if (APEX_is_branch(ins->opcode))
+        {
+            target = i + ins->imm / 4;
+            if (target >= 0 && target < cpu->code_memory_size)
+            {
+                leader[target] = TRUE;
+            }
+        }
+    }
+
+    for (i = 0; i < cpu->code_memory_size; ++i)
+    {
+        if (leader[i])
+        {
+            blocks[num_blocks].first = i;
+            num_blocks++;
+        }
+        blocks[num_blocks - 1].last = i;
+        block_of[i] = num_blocks - 1;
+    }
+    free(leader);
+
+    for (i = 0; i < num_blocks; ++i)
+    {
+        ins = &cpu->code_memory[blocks[i].last];
+        blocks[i].fall_block = (ins->opcode == OPCODE_HALT || i + 1 == num_blocks) ? -1 : i + 1;
+        blocks[i].taken_block = -1;
+        if (APEX_is_branch(ins->opcode))
+        {
+            target = blocks[i].last + ins->imm / 4;
+            if (target >= 0 && target < cpu->code_memory_size)
+            {
+                blocks[i].taken_block = block_of[target];
+            }
+        }
+    }
+    return num_blocks;
+}
+
+/* Counts visits and edges with the functional model, 0 once HALT ran */
+static int
+profile_blocks(APEX_CPU *cpu, ES_Block *blocks, const int *block_of)
+{
+    long long steps = 0;
+    int cur, index, pc;
+
+    index = (cpu->pc - 4000) / 4;
+    if (index < 0 || index >= cpu->code_memory_size)
+    {
+        fprintf(stderr, "APEX_Error: pc %d is outside code memory\n", cpu->pc);
+        return -1;
+    }
+    cur = block_of[index];
+    blocks[cur].visits++;
+    while (steps++ < ESTIMATE_MAX_STEPS)
+    {
+        pc = cpu->pc;
+        index = (pc - 4000) / 4;
+        if (APEX_isa_step(cpu))
+        {
+            return (index >= 0 && index < cpu->code_memory_size &&
+                    cpu->code_memory[index].opcode == OPCODE_HALT) ? 0 : -1;
+        }
+        if (index != blocks[cur].last)
+        {
+            continue;
+        }
+        /* A pc outside code memory stops the next step */
+        index = (cpu->pc - 4000) / 4;
+        if (index < 0 || index >= cpu->code_memory_size)
+        {
+            continue;
+        }
+        if (cpu->pc == pc + 4)
+        {
+            blocks[cur].fall++;
+        }
+        else
+        {
+            blocks[cur].taken++;
+        }
+        cur = block_of[index];
+        blocks[cur].visits++;
+    }
+    fprintf(stderr, "APEX_Error: The functional run did not halt within %lld instructions\n", ESTIMATE_MAX_STEPS);
+    return -1;
+}
+
+/* Probability of leaving the block through its branch, without a profile */
+static double
+static_taken(const APEX_CPU *cpu, const ES_Block *block)
+{
+    const APEX_Instruction *ins = &cpu->code_memory[block->last];
+
+    if (block->taken_block < 0)
+    {
+        return 0.0;
+    }
+    if (block->fall_block < 0)
+    {
+        return 1.0;
+    }
+    return ins->imm <= 0 ? 1.0 - 1.0 / ESTIMATE_STATIC_TRIPS : 0.5;
+}
+
+/* A block runs ESTIMATE_STATIC_TRIPS times for every loop around it and half
+ * as often for every forward branch that can skip it, counted over code
+ * memory with difference arrays */
+static int
+static_blocks(const APEX_CPU *cpu, ES_Block *blocks, int num_blocks)
+{
+    const APEX_Instruction *ins;
+    int *depth = calloc(cpu->code_memory_size + 1, sizeof(int));
+    int *skips = calloc(cpu->code_memory_size + 1, sizeof(int));
+    int loops = 0, skipped = 0;
+    int i, target;
+    double p;
+
+    if (!depth || !skips)
+    {
+        free(depth);
+        free(skips);
+        return -1;
+    }
+    for (i = 0; i < cpu->code_memory_size; ++i)
+    {
+        ins = &cpu->code_memory[i];
+        if (!APEX_is_branch(ins->opcode))
+        {
+            continue;
+        }
+        target = i + ins->imm / 4;
+        if (target < 0 || target >= cpu->code_memory_size)
+        {
+            continue;
+        }
+        if (target <= i)
+        {
+            depth[target]++;
+            depth[i + 1]--;
+        }
+        else
+        {
+            skips[i + 1]++;
+            skips[target]--;
+        }
+    }
+
+    i = 0;
+    for (target = 0; target < num_blocks; ++target)
+    {
+        for (; i <= blocks[target].first; ++i)
+        {
+            loops += depth[i];
+            skipped += skips[i];
+        }
+        blocks[target].visits = pow(ESTIMATE_STATIC_TRIPS, loops) * pow(0.5, skipped);
+    }
+    for (i = 0; i < num_blocks; ++i)
+    {
+        p = static_taken(cpu, &blocks[i]);
+        blocks[i].taken = blocks[i].visits * p;
+        blocks[i].fall = blocks[i].fall_block >= 0 ? blocks[i].visits * (1.0 - p) : 0;
+    }
+    free(depth);
+    free(skips);
+    return 0;
+}
+
+static void
+print_blocks(const ES_Block *blocks, int num_blocks, double cycles)
+{
+    int *order = malloc(sizeof(int) * num_blocks);
+    double *block_cycles = malloc(sizeof(double) * num_blocks);
+    int i, j, t;
+
+    if (!order || !block_cycles)
+    {
+        free(order);
+        free(block_cycles);
+        return;
+    }
+    /* Cycles a block adds, the edges it is entered by are charged to it */
+    for (i = 0; i < num_blocks; ++i)
+    {
+        block_cycles[i] = 0;
+        order[i] = i;
+    }
+    for (i = 0; i < num_blocks; ++i)
+    {
+        if (blocks[i].fall_block >= 0)
+        {
+            block_cycles[blocks[i].fall_block] += blocks[i].fall * blocks[i].fall_cost;
+        }
+        if (blocks[i].taken_block >= 0)
+        {
+            block_cycles[blocks[i].taken_block] += blocks[i].taken * blocks[i].taken_cost;
+        }
+    }
+    for (i = 1; i < num_blocks; ++i)
+    {
+        for (j = i; j > 0 && block_cycles[order[j]] > block_cycles[order[j - 1]]; --j)
+        {
+            t = order[j];
+            order[j] = order[j - 1];
+            order[j - 1] = t;
+        }
+    }
+
+    printf("%-12s %14s %12s %14s %7s\n", "pc", "executions", "cycles/exec", "cycles", "share");
+    for (i = 0; i < num_blocks && i < ESTIMATE_TOP_BLOCKS; ++i)
+    {
+        const ES_Block *block = &blocks[order[i]];
+
+        if (block->visits <= 0)
+        {
+            break;
+        }
+        printf("%4d-%-7d %14.0f %12.2f %14.0f %6.1f%%\n", 4000 + 4 * block->first, 4000 + 4 * block->last,
+               block->visits, block_cycles[order[i]] / block->visits, block_cycles[order[i]],
+               cycles ? 100.0 * block_cycles[order[i]] / cycles : 0.0);
+    }
+    free(order);
+    free(block_cycles);
+}
+
+/* Prints the estimated cycles of the program loaded in cpu, 0 on success */
+int APEX_estimate_run(APEX_CPU *cpu, int use_static)
+{
+    ES_Block *blocks;
+    int *block_of;
+    struct timespec t0, t1, t2;
+    double cycles, insns = 0;
+    int num_blocks, i;
+    ES_State s;
+
+    if (cpu->code_memory_size == 0)
+    {
+        fprintf(stderr, "APEX_Error: Nothing to estimate, the program is empty\n");
+        return -1;
+    }
+    blocks = calloc(cpu->code_memory_size, sizeof(ES_Block));
+    block_of = calloc(cpu->code_memory_size, sizeof(int));
+    if (!blocks || !block_of)
+    {
+        free(blocks);
+        free(block_of);
+        return -1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    num_blocks = find_blocks(cpu, blocks, block_of);
+    if (num_blocks < 0)
+    {
+        free(blocks);
+        free(block_of);
+        return -1;
+    }
+    if (use_static ? static_blocks(cpu, blocks, num_blocks) : profile_blocks(cpu, blocks, block_of))
+    {
+        free(blocks);
+        free(block_of);
+        return -1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    state_init(&s);
+    run_block(&s, cpu, &blocks[0]);
+    cycles = s.retire + ESTIMATE_HALT_CYCLES;
+    for (i = 0; i < num_blocks; ++i)
+    {
+        insns += blocks[i].visits * (blocks[i].last - blocks[i].first + 1);
+        if (blocks[i].fall > 0)
+        {
+            blocks[i].fall_cost = edge_cost(cpu, &blocks[i], &blocks[blocks[i].fall_block], FALSE);
+            cycles += blocks[i].fall * blocks[i].fall_cost;
+        }
+        if (blocks[i].taken > 0)
+        {
+            blocks[i].taken_cost = edge_cost(cpu, &blocks[i], &blocks[blocks[i].taken_block], TRUE);
+            cycles += blocks[i].taken * blocks[i].taken_cost;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t2);
+
+    printf("APEX_Estimate: %.0f cycles, %.0f instructions, CPI %.3f (%s counts)\n", cycles, insns,
+           insns ? cycles / insns : 0.0, use_static ? "static" : "functional");
+    if (use_static)
+    {
+        printf("APEX_Estimate: %d blocks analysed in %.0f us\n", num_blocks, elapsed_us(&t0, &t2));
+    }
+    else
+    {
+        printf("APEX_Estimate: %d blocks analysed in %.0f us after a functional run of %.0f us\n", num_blocks,
+               elapsed_us(&t1, &t2), elapsed_us(&t0, &t1));
+    }
+    print_blocks(blocks, num_blocks, cycles);
+    free(blocks);
+    free(block_of);
+    return 0;
+}
@@ -0,0 +1,34 @@
+/*
+ * apex_estimate.h
+ * Contains declarations for the analytical cycle estimator
+ *
+ * The program is split into basic blocks. The cost of going from a block
+ * to one of its successors is found by running a timing recurrence over
+ * the instructions of both blocks, starting from an empty pipeline: an
+ * instruction issues once it reached decode, its source and destination
+ * registers were written back, its FU is free and no branch waits in the
+ * integer FU; it leaves its FU after the FU latency (1, 3 or 4 cycles),
+ * but never before the instruction ahead of it; a taken branch sends the
+ * next instruction to decode two cycles after it resolves. The cost of the
+ * edge is the number of cycles the second block adds to the first.
+ *
+ * The estimate is the sum of the edge costs weighted by how often each
+ * edge is taken. By default the counts come from a run of the functional
+ * model, which executes the program without the pipeline. With the static
+ * option they come from the control flow alone: a block runs
+ * ESTIMATE_STATIC_TRIPS times for each loop it sits in and half as often
+ * for each forward branch that can skip it; a backward branch is taken
+ * ESTIMATE_STATIC_TRIPS - 1 times out of ESTIMATE_STATIC_TRIPS and a
+ * forward branch half of the time.
+ */
+#ifndef _APEX_ESTIMATE_H_
+#define _APEX_ESTIMATE_H_
+
+#include "apex_cpu.h"
+
+#define ESTIMATE_STATIC_TRIPS 10
+#define ESTIMATE_MAX_STEPS 1000000000LL /* Instructions the functional run may execute */
+#define ESTIMATE_TOP_BLOCKS 10          /* Blocks listed in the report */
+
+int APEX_estimate_run(APEX_CPU *cpu, int use_static);
+#endif
@@ -0,0 +1,862 @@
+/*
+ * apex_gdbstub.c
+ * Contains the GDB remote serial protocol server
+ *
+ * Breakpoints are taken when the instruction at their pc is fetched: it is
+ * squashed in decode and the older instructions drain, so the core stops
+ * before it executes. A breakpoint fetched on the wrong path behind a
+ * branch drains to a different pc and the run simply goes on. Watchpoints
+ * compare the watched word after every cycle and stop, after the drain,
+ * once it changed. Without breakpoints or watchpoints the run loop only
+ * looks at the socket every GDB_POLL_CYCLES cycles.
+ */
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+#include "apex_gdbstub.h"
+
+/* Outcome of resuming the core */
+#define GDB_STOP_TRAP 0      /* Breakpoint or single step */
+#define GDB_STOP_WATCH 1
+#define GDB_STOP_INTERRUPT 2
+#define GDB_STOP_HALT 3
+#define GDB_STOP_DETACH 4    /* The connection was closed while running */
+
+typedef struct GDB_Stub
+{
+    APEX_CPU *cpu;
+    int fd;
+    int no_ack;
+    int halted;
+
+    unsigned char in[GDB_PACKET_SIZE];
+    int in_len;
+    int in_pos;
+    char packet[GDB_PACKET_SIZE];
+    char reply[GDB_PACKET_SIZE];
+
+    int breakpoints[GDB_MAX_BREAKPOINTS];
+    int num_breakpoints;
+    int watch[GDB_MAX_BREAKPOINTS]; /* Word addresses */
+    int watch_old[GDB_MAX_BREAKPOINTS];
+    int num_watch;
+    int watch_hit;
+} GDB_Stub;
+
+static const char hex_digits[] = "0123456789abcdef";
+
+static int
+hex_value(int c)
+{
+    if (c >= '0' && c <= '9')
+    {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f')
+    {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F')
+    {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+/* Appends a 32-bit value as 8 hex digits in little-endian byte order */
+static char *
+put_word(char *out, int value)
+{
+    unsigned int v = (unsigned int)value;
+    int i;
+
+    for (i = 0; i < 4; ++i, v >>= 8)
+    {
+        *out++ = hex_digits[(v >> 4) & 0xf];
+        *out++ = hex_digits[v & 0xf];
+    }
+    *out = '\0';
+    return out;
+}
+
+/* Reads 8 hex digits in little-endian byte order, returns FALSE if malformed */
+static int
+get_word(const char *in, int *value)
+{
+    unsigned int v = 0;
+    int i, hi, lo;
+
+    for (i = 0; i < 4; ++i)
+    {
+        hi = hex_value(in[2 * i]);
+        lo = hex_value(in[2 * i + 1]);
+        if (hi < 0 || lo < 0)
+        {
+            return FALSE;
+        }
+        v |= (unsigned int)(hi << 4 | lo) << (8 * i);
+    }
+    *value = (int)v;
+    return TRUE;
+}
+
+/* Next byte from the connection, -1 once it is closed */
+static int
+read_byte(GDB_Stub *stub)
+{
+    ssize_t n;
+
+    if (stub->in_pos == stub->in_len)
+    {
+        n = recv(stub->fd, stub->in, sizeof(stub->in), 0);
+        if (n <= 0)
+        {
+            return -1;
+        }
+        stub->in_len = n;
+        stub->in_pos = 0;
+    }
+    return stub->in[stub->in_pos++];
+}
+
+static int
+send_all(GDB_Stub *stub, const char *buf, size_t len)
+{
+    ssize_t n;
+
+    while (len > 0)
+    {
+        n = send(stub->fd, buf, len, 0);
+        if (n <= 0)
+        {
+            return FALSE;
+        }
+        buf += n;
+        len -= n;
+    }
+    return TRUE;
+}
+
+/* Sends $data#checksum, resending until acknowledged */
+static int
+put_packet(GDB_Stub *stub, const char *data)
+{
+    static char frame[GDB_PACKET_SIZE + 4];
+    unsigned char sum = 0;
+    int len = strlen(data);
+    int i, c;
+
+    frame[0] = '$';
+    for (i = 0; i < len; ++i)
+    {
+        frame[i + 1] = data[i];
+        sum += (unsigned char)data[i];
+    }
+    frame[len + 1] = '#';
+    frame[len + 2] = hex_digits[sum >> 4];
+    frame[len + 3] = hex_digits[sum & 0xf];
+
+    while (TRUE)
+    {
+        if (!send_all(stub, frame, len + 4))
+        {
+            return FALSE;
+        }
+        if (stub->no_ack)
+        {
+            return TRUE;
+        }
+        c = read_byte(stub);
+        if (c == '+')
+        {
+            return TRUE;
+        }
+        if (c != '-')
+        {
+            return FALSE;
+        }
+    }
+}
+
+/* Receives the next packet into stub->packet, returns its length or -1 */
+static int
+get_packet(GDB_Stub *stub)
+{
+    unsigned char sum;
+    int c, len, hi, lo;
+
+    while (TRUE)
+    {
+        /* Anything before '$', acknowledgements and ^C included, is skipped */
+        do
+        {
+            c = read_byte(stub);
+            if (c < 0)
+            {
+                return -1;
+            }
+        } while (c != '$');
+
+        sum = 0;
+        len = 0;
+        while ((c = read_byte(stub)) != '#')
+        {
+            if (c < 0)
+            {
+                return -1;
+            }
+            if (c == '$')
+            {
+                /* A new packet started, drop the partial one */
+                sum = 0;
+                len = 0;
+                continue;
+            }
+            sum += c;
+            if (len < GDB_PACKET_SIZE - 1)
+            {
+                stub->packet[len++] = c;
+            }
+        }
+        stub->packet[len] = '\0';
+        hi = hex_value(read_byte(stub));
+        lo = hex_value(read_byte(stub));
+
+        if (stub->no_ack)
+        {
+            return len;
+        }
+        if (hi >= 0 && lo >= 0 && (hi << 4 | lo) == sum)
+        {
+            send_all(stub, "+", 1);
+            return len;
+        }
+        send_all(stub, "-", 1);
+    }
+}
+
+/* TRUE if ^C arrived or the connection closed, the byte is consumed */
+static int
+interrupted(GDB_Stub *stub, int *closed)
+{
+    struct pollfd pfd;
+    unsigned char c;
+    ssize_t n;
+
+    if (stub->in_pos < stub->in_len)
+    {
+        if (stub->in[stub->in_pos] == 0x03)
+        {
+            stub->in_pos++;
+            return TRUE;
+        }
+        return FALSE;
+    }
+    pfd.fd = stub->fd;
+    pfd.events = POLLIN;
+    if (poll(&pfd, 1, 0) <= 0)
+    {
+        return FALSE;
+    }
+    n = recv(stub->fd, &c, 1, MSG_PEEK);
+    if (n <= 0)
+    {
+        *closed = TRUE;
+        return TRUE;
+    }
+    if (c == 0x03)
+    {
+        recv(stub->fd, &c, 1, 0);
+        return TRUE;
+    }
+    return FALSE;
+}
+
+static int
+is_breakpoint(const GDB_Stub *stub, int pc)
+{
+    int i;
+
+    for (i = 0; i < stub->num_breakpoints; ++i)
+    {
+        if (stub->breakpoints[i] == pc)
+        {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/* Word address of the first watchpoint whose word changed, -1 if none */
+static int
+watch_changed(GDB_Stub *stub)
+{
+    int i, v, hit = -1;
+
+    for (i = 0; i < stub->num_watch; ++i)
+    {
+        v = stub->cpu->data_memory[stub->watch[i]];
+        if (v != stub->watch_old[i])
+        {
+            stub->watch_old[i] = v;
+            if (hit < 0)
+            {
+                hit = stub->watch[i];
+            }
+        }
+    }
+    return hit;
+}
+
+/* Runs from the empty pipeline until a stop, leaving the pipeline empty */
+static int
+resume(GDB_Stub *stub, int step)
+{
+    APEX_CPU *cpu = stub->cpu;
+    long long fetched = cpu->threads[0].fetched;
+    int skip_pc = cpu->pc; /* Resuming at a breakpoint does not hit it again */
+    int closed = FALSE;
+    int checked = stub->num_breakpoints || stub->num_watch;
+    int n, pc, hit;
+
+    cpu->fetch.has_insn = TRUE;
+    cpu->fetch_from_next_cycle = FALSE;
+
+    if (step)
+    {
+        /* One fetch, then everything fetched retires */
+        if (APEX_cpu_step(cpu))
+        {
+            return GDB_STOP_HALT;
+        }
+        cpu->clock++;
+        if (APEX_cpu_drain(cpu))
+        {
+            return GDB_STOP_HALT;
+        }
+        watch_changed(stub);
+        return GDB_STOP_TRAP;
+    }
+
+    for (n = 1;; ++n)
+    {
+        if (APEX_cpu_step(cpu))
+        {
+            return GDB_STOP_HALT;
+        }
+        cpu->clock++;
+
+        if (checked)
+        {
+            if (cpu->threads[0].fetched != fetched)
+            {
+                fetched = cpu->threads[0].fetched;
+                pc = cpu->decode.pc;
+                if (pc != skip_pc && is_breakpoint(stub, pc))
+                {
+                    if (APEX_cpu_flush(cpu))
+                    {
+                        return GDB_STOP_HALT;
+                    }
+                    if (cpu->pc == pc)
+                    {
+                        return GDB_STOP_TRAP;
+                    }
+                    /* Fetched on the wrong path */
+                    cpu->fetch.has_insn = TRUE;
+                    fetched = cpu->threads[0].fetched;
+                }
+                skip_pc = -1;
+            }
+            if (stub->num_watch && (hit = watch_changed(stub)) >= 0)
+            {
+                stub->watch_hit = hit;
+                if (APEX_cpu_flush(cpu))
+                {
+                    return GDB_STOP_HALT;
+                }
+                watch_changed(stub);
+                return GDB_STOP_WATCH;
+            }
+        }
+
+        if (!(n & (GDB_POLL_CYCLES - 1)) && interrupted(stub, &closed))
+        {
+            if (APEX_cpu_flush(cpu))
+            {
+                return GDB_STOP_HALT;
+            }
+            return closed ? GDB_STOP_DETACH : GDB_STOP_INTERRUPT;
+        }
+    }
+}
+
+static void
+stop_reply(GDB_Stub *stub, int stop)
+{
+    switch (stop)
+    {
+    case GDB_STOP_HALT:
+        stub->halted = TRUE;
+        strcpy(stub->reply, "W00");
+        break;
+    case GDB_STOP_INTERRUPT:
+        strcpy(stub->reply, "S02");
+        break;
+    case GDB_STOP_WATCH:
+        sprintf(stub->reply, "T05watch:%x;", stub->watch_hit * 4);
+        break;
+    default:
+        strcpy(stub->reply, "S05");
+        break;
+    }
+}
+
+static int
+read_register(const APEX_CPU *cpu, int n)
+{
+    if (n < REG_FILE_SIZE)
+    {
+        return cpu->regs[n];
+    }
+    switch (n)
+    {
+    case 16:
+        return cpu->pc;
+    case 17:
+        return cpu->zero_flag;
+    case 18:
+        return cpu->clock;
+    }
+    return cpu->insn_completed;
+}
+
+/* TRUE for a pc fetch can read, or the current one left unchanged */
+static int
+valid_pc(const APEX_CPU *cpu, int pc)
+{
+    return pc == cpu->pc || (pc >= 4000 && pc < 4000 + 4 * cpu->code_memory_size && pc % 4 == 0);
+}
+
+/* Returns FALSE, writing nothing, for a pc outside code memory */
+static int
+write_register(APEX_CPU *cpu, int n, int value)
+{
+    if (n < REG_FILE_SIZE)
+    {
+        cpu->regs[n] = value;
+    }
+    else if (n == 16)
+    {
+        if (!valid_pc(cpu, value))
+        {
+            return FALSE;
+        }
+        cpu->pc = value;
+    }
+    else if (n == 17)
+    {
+        cpu->zero_flag = value ? TRUE : FALSE;
+    }
+    return TRUE;
+}
+
+/* Byte of data memory, MEM[i] being little-endian at 4 * i */
+static unsigned int
+read_memory_byte(const APEX_CPU *cpu, unsigned int address)
+{
+    return ((unsigned int)cpu->data_memory[address / 4] >> (8 * (address % 4))) & 0xff;
+}
+
+static void
+write_memory_byte(APEX_CPU *cpu, unsigned int address, unsigned int byte)
+{
+    unsigned int word = (unsigned int)cpu->data_memory[address / 4];
+    int shift = 8 * (address % 4);
+
+    word = (word & ~(0xffu << shift)) | (byte << shift);
+    cpu->data_memory[address / 4] = (int)word;
+}
+
+static void
+cmd_read_memory(GDB_Stub *stub)
+{
+    unsigned int address, len, i;
+    char *out = stub->reply;
+
+    if (sscanf(stub->packet + 1, "%x,%x", &address, &len) != 2 || len > (GDB_PACKET_SIZE - 1) / 2 ||
+        address + len > 4 * DATA_MEMORY_SIZE || address + len < address)
+    {
+        strcpy(stub->reply, "E01");
+        return;
+    }
+    for (i = 0; i < len; ++i)
+    {
+        *out++ = hex_digits[read_memory_byte(stub->cpu, address + i) >> 4];
+        *out++ = hex_digits[read_memory_byte(stub->cpu, address + i) & 0xf];
+    }
+    *out = '\0';
+}
+
+static void
+cmd_write_memory(GDB_Stub *stub)
+{
+    unsigned int address, len, i;
+    const char *data = strchr(stub->packet, ':');
+    int hi, lo;
+
+    if (!data || sscanf(stub->packet + 1, "%x,%x", &address, &len) != 2 ||
+        address + len > 4 * DATA_MEMORY_SIZE || address + len < address || strlen(data + 1) < 2 * len)
+    {
+        strcpy(stub->reply, "E01");
+        return;
+    }
+    data++;
+    for (i = 0; i < len; ++i)
+    {
+        hi = hex_value(data[2 * i]);
+        lo = hex_value(data[2 * i + 1]);
+        if (hi < 0 || lo < 0)
+        {
+            strcpy(stub->reply, "E01");
+            return;
+        }
+        write_memory_byte(stub->cpu, address + i, hi << 4 | lo);
+    }
+    watch_changed(stub);
+    strcpy(stub->reply, "OK");
+}
+
+/* Z/z packets: 0 and 1 are breakpoints, 2 a write watchpoint */
+static void
+cmd_point(GDB_Stub *stub, int insert)
+{
+    int type, i;
+    unsigned int address;
+    int *list, *count;
+
+    if (sscanf(stub->packet + 1, "%d,%x", &type, &address) != 2)
+    {
+        strcpy(stub->reply, "E01");
+        return;
+    }
+    if (type == 0 || type == 1)
+    {
+        list = stub->breakpoints;
+        count = &stub->num_breakpoints;
+    }
+    else if (type == 2)
+    {
+        if (address >= 4 * DATA_MEMORY_SIZE)
+        {
+            strcpy(stub->reply, "E01");
+            return;
+        }
+        address /= 4;
+        list = stub->watch;
+        count = &stub->num_watch;
+    }
+    else
+    {
+        /* Read and access watchpoints are not supported */
+        stub->reply[0] = '\0';
+        return;
+    }
+
+    for (i = 0; i < *count && list[i] != (int)address; ++i)
+    {
+    }
+    if (insert && i == *count)
+    {
+        if (*count == GDB_MAX_BREAKPOINTS)
+        {
+            strcpy(stub->reply, "E02");
+            return;
+        }
+        list[(*count)++] = address;
+        if (type == 2)
+        {
+            stub->watch_old[i] = stub->cpu->data_memory[address];
+        }
+    }
+    else if (!insert && i < *count)
+    {
+        (*count)--;
+        list[i] = list[*count];
+        if (type == 2)
+        {
+            stub->watch_old[i] = stub->watch_old[*count];
+        }
+    }
+    strcpy(stub->reply, "OK");
+}
+
+/* Handles one packet, returns FALSE when the session is over */
+static int
+handle_packet(GDB_Stub *stub)
+{
+    APEX_CPU *cpu = stub->cpu;
+    char *p = stub->packet;
+    char *out;
+    int n, value, stop;
+
+    stub->reply[0] = '\0';
+    switch (p[0])
+    {
+    case '?':
+        strcpy(stub->reply, stub->halted ? "W00" : "S05");
+        break;
+    case 'g':
+        out = stub->reply;
+        for (n = 0; n < GDB_NUM_REGS; ++n)
+        {
+            out = put_word(out, read_register(cpu, n));
+        }
+        break;
+    case 'G':
+        if (strlen(p + 1) < 8 * GDB_NUM_REGS)
+        {
+            strcpy(stub->reply, "E01");
+            break;
+        }
+        /* The pc is checked first, so a rejected packet changes nothing */
+        if (get_word(p + 1 + 8 * 16, &value) && !valid_pc(cpu, value))
+        {
+            strcpy(stub->reply, "E01");
+            break;
+        }
+        for (n = 0; n < GDB_NUM_REGS; ++n)
+        {
+            if (get_word(p + 1 + 8 * n, &value))
+            {
+                write_register(cpu, n, value);
+            }
+        }
+        strcpy(stub->reply, "OK");
+        break;
+    case 'p':
+        n = strtol(p + 1, NULL, 16);
+        if (n < 0 || n >= GDB_NUM_REGS)
+        {
+            strcpy(stub->reply, "E01");
+            break;
+        }
+        put_word(stub->reply, read_register(cpu, n));
+        break;
+    case 'P':
+        n = strtol(p + 1, &out, 16);
+        if (n < 0 || n >= GDB_NUM_REGS || *out != '=' || !get_word(out + 1, &value))
+        {
+            strcpy(stub->reply, "E01");
+            break;
+        }
+        strcpy(stub->reply, write_register(cpu, n, value) ? "OK" : "E01");
+        break;
+    case 'm':
+        cmd_read_memory(stub);
+        break;
+    case 'M':
+        cmd_write_memory(stub);
+        break;
+    case 'c':
+    case 's':
+        if (stub->halted)
+        {
+            strcpy(stub->reply, "W00");
+            break;
+        }
+        /* An address to resume at may follow */
+        if (p[1])
+        {
+            value = strtol(p + 1, NULL, 16);
+            if (!valid_pc(cpu, value))
+            {
+                strcpy(stub->reply, "E01");
+                break;
+            }
+            cpu->pc = value;
+        }
+        stop = resume(stub, p[0] == 's');
+        if (stop == GDB_STOP_DETACH)
+        {
+            return FALSE;
+        }
+        stop_reply(stub, stop);
+        break;
+    case 'Z':
+    case 'z':
+        cmd_point(stub, p[0] == 'Z');
+        break;
+    case 'H':
+        strcpy(stub->reply, "OK");
+        break;
+    case 'k':
+        return FALSE;
+    case 'D':
+        put_packet(stub, "OK");
+        return FALSE;
+    case 'q':
+        if (strncmp(p, "qSupported", 10) == 0)
+        {
+            sprintf(stub->reply, "PacketSize=%x;QStartNoAckMode+", GDB_PACKET_SIZE);
+        }
+        else if (strcmp(p, "qAttached") == 0)
+        {
+            strcpy(stub->reply, "1");
+        }
+        else if (strcmp(p, "qC") == 0)
+        {
+            strcpy(stub->reply, "QC1");
+        }
+        break;
+    case 'Q':
+        if (strcmp(p, "QStartNoAckMode") == 0)
+        {
+            put_packet(stub, "OK");
+            stub->no_ack = TRUE;
+            return TRUE;
+        }
+        break;
+    }
+    return put_packet(stub, stub->reply);
+}
+
+/* A TCP port number, anything else is the path of a Unix socket */
+static int
+is_port(const char *address)
+{
+    char *end;
+
+    strtol(address, &end, 10);
+    return *address && !*end;
+}
+
+/* Listens on a TCP port of the loopback interface or on a Unix socket */
+static int
+open_listener(const char *address)
+{
+    struct sockaddr_in in;
+    struct sockaddr_un un;
+    struct stat st;
+    long port = strtol(address, NULL, 10);
+    int fd, one = 1;
+
+    if (is_port(address))
+    {
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0)
+        {
+            return -1;
+        }
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        memset(&in, 0, sizeof(in));
+        in.sin_family = AF_INET;
+        in.sin_port = htons(port);
+        in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (port < 1 || port > 65535 || bind(fd, (struct sockaddr *)&in, sizeof(in)) < 0)
+        {
+            close(fd);
+            return -1;
+        }
+    }
+    else
+    {
+        if (strlen(address) >= sizeof(un.sun_path))
+        {
+            return -1;
+        }
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0)
+        {
+            return -1;
+        }
+        memset(&un, 0, sizeof(un));
+        un.sun_family = AF_UNIX;
+        strcpy(un.sun_path, address);
+        /* Only a stale socket is replaced, never some other file */
+        if (lstat(address, &st) == 0)
+        {
+            if (!S_ISSOCK(st.st_mode))
+            {
+                fprintf(stderr, "APEX_Error: %s exists and is not a socket\n", address);
+                close(fd);
+                return -1;
+            }
+            unlink(address);
+        }
+        if (bind(fd, (struct sockaddr *)&un, sizeof(un)) < 0)
+        {
+            close(fd);
+            return -1;
+        }
+    }
+    if (listen(fd, 1) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/*
+ * Serves one debugger connection, then prints the final state the way
+ * APEX_cpu_run() does. Returns 1 if the socket could not be opened.
+ */
+int APEX_gdbstub_run(APEX_CPU *cpu, const char *address)
+{
+    GDB_Stub *stub;
+    int listen_fd;
+
+    listen_fd = open_listener(address);
+    if (listen_fd < 0)
+    {
+        fprintf(stderr, "APEX_Error: Unable to listen on %s\n", address);
+        return 1;
+    }
+    stub = calloc(1, sizeof(GDB_Stub));
+    if (!stub)
+    {
+        close(listen_fd);
+        return 1;
+    }
+    stub->cpu = cpu;
+
+    /* A restored checkpoint may have instructions in flight */
+    stub->halted = APEX_cpu_flush(cpu);
+
+    fprintf(stderr, "APEX_GDB: Waiting for a debugger on %s\n", address);
+    stub->fd = accept(listen_fd, NULL, NULL);
+    close(listen_fd);
+    if (stub->fd < 0)
+    {
+        fprintf(stderr, "APEX_Error: Unable to accept a debugger on %s\n", address);
+        free(stub);
+        return 1;
+    }
+    fprintf(stderr, "APEX_GDB: Debugger connected\n");
+
+    while (get_packet(stub) >= 0 && handle_packet(stub))
+    {
+    }
+    close(stub->fd);
+    if (!is_port(address))
+    {
+        unlink(address);
+    }
+
+    APEX_cpu_print_state(cpu);
+    printf("APEX_CPU: Simulation %s, cycles = %d instructions = %d\n", stub->halted ? "Complete" : "Stopped",
+           cpu->clock, cpu->insn_completed);
+    free(stub);
+    return 0;
+}
@@ -0,0 +1,33 @@
+/*
+ * apex_gdbstub.h
+ * Contains declarations for the GDB remote serial protocol server
+ *
+ * A debugger or a script connects over a local TCP port or Unix socket
+ * and drives the core with RSP packets. The core is only ever stopped with
+ * an empty pipeline, so the registers, pc and memory it reports are
+ * architectural and can be written safely.
+ *
+ * Registers, 32 bits each in target (little-endian) byte order:
+ *   0-15  R0-R15
+ *   16    pc, the next instruction to execute
+ *   17    zero flag
+ *   18    clock cycles elapsed, read only
+ *   19    instructions retired, read only
+ *
+ * Memory addresses are byte addresses into data memory, MEM[i] being the
+ * little-endian word at address 4 * i. Code memory cannot be accessed.
+ */
+#ifndef _APEX_GDBSTUB_H_
+#define _APEX_GDBSTUB_H_
+
+#include "apex_cpu.h"
+
+#define GDB_NUM_REGS 20
+#define GDB_PACKET_SIZE 4096
+#define GDB_MAX_BREAKPOINTS 64
+
+/* Cycles between checks for an interrupt (^C) while running, a power of two */
+#define GDB_POLL_CYCLES 4096
+
+int APEX_gdbstub_run(APEX_CPU *cpu, const char *address);
+#endif
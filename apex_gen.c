@@ -0,0 +1,352 @@
+/*
+ * apex_gen.c
+ * Generator of synthetic APEX programs for simulator scaling tests
+ *
+ * Emits a loop body of a given number of instructions, drawn from an
+ * instruction mix, repeated a given number of times by an outer BNZ loop.
+ * Sources are taken from the destination of an instruction a chosen
+ * distance back, memory instructions address R0 plus an immediate inside
+ * the footprint, and every branch is preceded by CMP R0,R0 so whether it
+ * is taken is fixed when the program is generated. The same options and
+ * seed always give the same program.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_macros.h"
+
+/* Instruction classes of the mix */
+#define GEN_ALU 0
+#define GEN_MUL 1
+#define GEN_MEM 2
+#define GEN_BRANCH 3
+#define GEN_NUM_CLASSES 4
+
+/* R0 stays zero for addressing and CMP, R15 counts the outer loop */
+#define GEN_FIRST_REG 1
+#define GEN_LAST_REG 14
+#define GEN_LOOP_REG 15
+
+/* Longest forward branch, in instructions skipped */
+#define GEN_MAX_SKIP 4
+
+typedef struct Gen_Options
+{
+    unsigned long long seed;
+    int insns;      /* Static instructions in the loop body */
+    int iterations; /* Times the body is executed */
+    int mix[GEN_NUM_CLASSES];
+    int dep;       /* Mean dependency distance, 0 for independent sources */
+    int taken;     /* Percentage of branches taken */
+    int footprint; /* Data memory words addressed */
+    int stores;    /* Percentage of memory instructions that are stores */
+    const char *output;
+} Gen_Options;
+
+typedef struct Gen_Stats
+{
+    long long count[GEN_NUM_CLASSES];
+    long long stores;
+    long long taken;
+} Gen_Stats;
+
+static unsigned long long rng_state;
+
+/* xorshift64*, seeded through splitmix64 so that small seeds differ well */
+static void
+gen_seed(unsigned long long seed)
+{
+    unsigned long long z = seed + 0x9E3779B97F4A7C15ULL;
+
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    rng_state = (z ^ (z >> 31)) | 1;
+}
+
+static unsigned int
+gen_rand(unsigned int n)
+{
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return (unsigned int)((rng_state * 0x2545F4914F6CDD1DULL) >> 32) % n;
+}
+
+static int
+gen_dest(void)
+{
+    return GEN_FIRST_REG + gen_rand(GEN_LAST_REG - GEN_FIRST_REG + 1);
+}
+
+/* Register written by the instruction about dep positions back */
+static int
+gen_source(const Gen_Options *opt, const signed char *dest, int i)
+{
+    int distance;
+
+    if (opt->dep > 0)
+    {
+        distance = 1 + gen_rand(2 * opt->dep - 1);
+        if (distance <= i && dest[i - distance] > 0)
+        {
+            return dest[i - distance];
+        }
+    }
+    return gen_dest();
+}
+
+static int
+gen_class(const Gen_Options *opt, int total)
+{
+    int r = gen_rand(total);
+    int c;
+
+    for (c = 0; c < GEN_NUM_CLASSES - 1; ++c)
+    {
+        if (r < opt->mix[c])
+        {
+            return c;
+        }
+        r -= opt->mix[c];
+    }
+    return GEN_BRANCH;
+}
+
+/* Writes the loop body, branches take two of its instructions */
+static void
+gen_body(FILE *fp, const Gen_Options *opt, signed char *dest, Gen_Stats *stats)
+{
+    static const char *alu_rr[] = {"ADD", "SUB", "AND", "OR", "EXOR"};
+    int total = 0;
+    int c, i, rd, skip;
+
+    for (c = 0; c < GEN_NUM_CLASSES; ++c)
+    {
+        total += opt->mix[c];
+    }
+
+    for (i = 0; i < opt->insns; ++i)
+    {
+        dest[i] = -1;
+        c = gen_class(opt, total);
+
+        /* A branch needs its CMP and at least one instruction to skip */
+        if (c == GEN_BRANCH && opt->insns - i < 3)
+        {
+            c = GEN_ALU;
+        }
+        stats->count[c]++;
+
+        switch (c)
+        {
+        case GEN_ALU:
+        {
+            rd = gen_dest();
+            switch (gen_rand(8))
+            {
+            case 5:
+                fprintf(fp, "ADDL R%d,R%d,#%d\n", rd, gen_source(opt, dest, i), gen_rand(16));
+                break;
+            case 6:
+                fprintf(fp, "SUBL R%d,R%d,#%d\n", rd, gen_source(opt, dest, i), gen_rand(16));
+                break;
+            case 7:
+                fprintf(fp, "MOVC R%d,#%d\n", rd, gen_rand(256));
+                break;
+            default:
+                fprintf(fp, "%s R%d,R%d,R%d\n", alu_rr[gen_rand(5)], rd, gen_source(opt, dest, i),
+                        gen_source(opt, dest, i));
+                break;
+            }
+            dest[i] = rd;
+            break;
+        }
+        case GEN_MUL:
+        {
+            rd = gen_dest();
+            fprintf(fp, "MUL R%d,R%d,R%d\n", rd, gen_source(opt, dest, i), gen_source(opt, dest, i));
+            dest[i] = rd;
+            break;
+        }
+        case GEN_MEM:
+        {
+            if ((int)gen_rand(100) < opt->stores)
+            {
+                fprintf(fp, "STORE R%d,R0,#%d\n", gen_source(opt, dest, i), gen_rand(opt->footprint));
+                stats->stores++;
+            }
+            else
+            {
+                rd = gen_dest();
+                fprintf(fp, "LOAD R%d,R0,#%d\n", rd, gen_rand(opt->footprint));
+                dest[i] = rd;
+            }
+            break;
+        }
+        case GEN_BRANCH:
+        {
+            /* CMP R0,R0 sets the zero flag, so BZ is taken and BNZ is not */
+            fprintf(fp, "CMP R0,R0\n");
+            i++;
+            dest[i] = -1;
+            skip = 1 + gen_rand(GEN_MAX_SKIP < opt->insns - i - 1 ? GEN_MAX_SKIP : opt->insns - i - 1);
+            if ((int)gen_rand(100) < opt->taken)
+            {
+                fprintf(fp, "BZ #%d\n", (skip + 1) * 4);
+                stats->taken++;
+            }
+            else
+            {
+                fprintf(fp, "BNZ #%d\n", (skip + 1) * 4);
+            }
+            break;
+        }
+        }
+    }
+}
+
+static void
+usage(const char *prog)
+{
+    fprintf(stderr,
+            "APEX_Help: Usage %s [--seed=<n>] [--insns=<n>] [--iterations=<n>]\n"
+            "                 [--mix=<alu>,<mul>,<mem>,<branch>] [--dep=<n>] [--taken=<percent>]\n"
+            "                 [--footprint=<words>] [--stores=<percent>] [--output=<file>]\n",
+            prog);
+    exit(1);
+}
+
+int main(int argc, char const *argv[])
+{
+    Gen_Options opt;
+    Gen_Stats stats;
+    signed char *dest;
+    FILE *fp = stdout;
+    int i;
+
+    opt.seed = 1;
+    opt.insns = 1000;
+    opt.iterations = 1;
+    opt.mix[GEN_ALU] = 60;
+    opt.mix[GEN_MUL] = 10;
+    opt.mix[GEN_MEM] = 20;
+    opt.mix[GEN_BRANCH] = 10;
+    opt.dep = 4;
+    opt.taken = 50;
+    opt.footprint = 1024;
+    opt.stores = 30;
+    opt.output = NULL;
+
+    for (i = 1; i < argc; ++i)
+    {
+        if (strncmp(argv[i], "--seed=", 7) == 0)
+        {
+            opt.seed = strtoull(argv[i] + 7, NULL, 0);
+        }
+        else if (strncmp(argv[i], "--insns=", 8) == 0)
+        {
+            opt.insns = atoi(argv[i] + 8);
+        }
+        else if (strncmp(argv[i], "--iterations=", 13) == 0)
+        {
+            opt.iterations = atoi(argv[i] + 13);
+        }
+        else if (strncmp(argv[i], "--mix=", 6) == 0)
+        {
+            if (sscanf(argv[i] + 6, "%d,%d,%d,%d", &opt.mix[GEN_ALU], &opt.mix[GEN_MUL],
+                       &opt.mix[GEN_MEM], &opt.mix[GEN_BRANCH]) != GEN_NUM_CLASSES)
+            {
+                usage(argv[0]);
+            }
+        }
+        else if (strncmp(argv[i], "--dep=", 6) == 0)
+        {
+            opt.dep = atoi(argv[i] + 6);
+        }
+        else if (strncmp(argv[i], "--taken=", 8) == 0)
+        {
+            opt.taken = atoi(argv[i] + 8);
+        }
+        else if (strncmp(argv[i], "--footprint=", 12) == 0)
+        {
+            opt.footprint = atoi(argv[i] + 12);
+        }
+        else if (strncmp(argv[i], "--stores=", 9) == 0)
+        {
+            opt.stores = atoi(argv[i] + 9);
+        }
+        else if (strncmp(argv[i], "--output=", 9) == 0)
+        {
+            opt.output = argv[i] + 9;
+        }
+        else
+        {
+            usage(argv[0]);
+        }
+    }
+
+    if (opt.insns < 1 || opt.iterations < 1 || opt.dep < 0 ||
+        opt.mix[GEN_ALU] < 0 || opt.mix[GEN_MUL] < 0 || opt.mix[GEN_MEM] < 0 || opt.mix[GEN_BRANCH] < 0 ||
+        opt.mix[GEN_ALU] + opt.mix[GEN_MUL] + opt.mix[GEN_MEM] + opt.mix[GEN_BRANCH] <= 0)
+    {
+        usage(argv[0]);
+    }
+    if (opt.footprint < 1 || opt.footprint > DATA_MEMORY_SIZE)
+    {
+        fprintf(stderr, "APEX_Error: footprint must be between 1 and %d words\n", DATA_MEMORY_SIZE);
+        exit(1);
+    }
+
+    dest = malloc(opt.insns);
+    if (!dest)
+    {
+        fprintf(stderr, "APEX_Error: Unable to allocate memory\n");
+        exit(1);
+    }
+    if (opt.output)
+    {
+        fp = fopen(opt.output, "w");
+        if (!fp)
+        {
+            fprintf(stderr, "APEX_Error: Unable to open %s\n", opt.output);
+            exit(1);
+        }
+    }
+
+    gen_seed(opt.seed);
+    memset(&stats, 0, sizeof(stats));
+
+    /* Give every register a distinct non-zero value */
+    for (i = GEN_FIRST_REG; i <= GEN_LAST_REG; ++i)
+    {
+        fprintf(fp, "MOVC R%d,#%d\n", i, i);
+    }
+    if (opt.iterations > 1)
+    {
+        fprintf(fp, "MOVC R%d,#%d\n", GEN_LOOP_REG, opt.iterations);
+    }
+
+    gen_body(fp, &opt, dest, &stats);
+
+    if (opt.iterations > 1)
+    {
+        /* Back to the first body instruction, just after the MOVC of R15 */
+        fprintf(fp, "SUBL R%d,R%d,#1\n", GEN_LOOP_REG, GEN_LOOP_REG);
+        fprintf(fp, "BNZ #%d\n", -(opt.insns + 1) * 4);
+    }
+    fprintf(fp, "HALT\n");
+
+    if (fp != stdout)
+    {
+        fclose(fp);
+    }
+    free(dest);
+
+    fprintf(stderr, "APEX_Gen: %d body instructions x %d iterations, seed %llu\n", opt.insns,
+            opt.iterations, opt.seed);
+    fprintf(stderr, "APEX_Gen: alu %lld, mul %lld, load %lld, store %lld, branch %lld (%lld taken)\n",
+            stats.count[GEN_ALU], stats.count[GEN_MUL], stats.count[GEN_MEM] - stats.stores,
+            stats.stores, stats.count[GEN_BRANCH], stats.taken);
+    return 0;
+}
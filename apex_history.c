@@ -0,0 +1,313 @@
+/*
+ * apex_history.c
+ * Contains the snapshot history used by reverse execution
+ *
+ * Pages are found by comparing data memory with a copy of it as of the
+ * last snapshot rather than by tracking stores, so the pipeline runs
+ * untouched between snapshots. Only the last snapshot is ever compared
+ * against, which is why thinning never drops it.
+ */
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+#include "apex_history.h"
+
+#define HIST_NUM_PAGES (DATA_MEMORY_SIZE / HISTORY_PAGE_WORDS)
+
+/* The CPU state is saved without its memory_store, which goes into pages */
+#define HIST_MEMORY_START offsetof(APEX_CPU, memory_store)
+#define HIST_MEMORY_END (HIST_MEMORY_START + sizeof(int) * DATA_MEMORY_SIZE)
+#define HIST_STATE_SIZE (sizeof(APEX_CPU) - sizeof(int) * DATA_MEMORY_SIZE)
+
+typedef struct HIST_Snapshot
+{
+    int clock;
+    int num_pages;
+    int *page_index;
+    int *pages;                 /* num_pages pages of HISTORY_PAGE_WORDS words */
+    unsigned char *cpu_state;   /* HIST_STATE_SIZE bytes */
+} HIST_Snapshot;
+
+struct APEX_History
+{
+    APEX_CPU *cpu;
+    HIST_Snapshot *snapshots;
+    int num_snapshots;
+    int capacity;
+    int interval;
+    long long budget;
+    long long bytes;
+    long long merged;             /* Snapshots merged away to stay within the budget */
+    int shadow[DATA_MEMORY_SIZE]; /* Data memory as of the last snapshot */
+};
+
+static long long
+snapshot_bytes(const HIST_Snapshot *s)
+{
+    return sizeof(HIST_Snapshot) + HIST_STATE_SIZE +
+           (long long)s->num_pages * (1 + HISTORY_PAGE_WORDS) * sizeof(int);
+}
+
+static void
+free_snapshot(HIST_Snapshot *s)
+{
+    free(s->page_index);
+    free(s->pages);
+    free(s->cpu_state);
+}
+
+/* Adds the pages of from that into does not have, into being the later snapshot */
+static int
+merge_pages(HIST_Snapshot *into, const HIST_Snapshot *from)
+{
+    int present[HIST_NUM_PAGES] = {0};
+    int *page_index, *pages;
+    int i, n = into->num_pages;
+
+    for (i = 0; i < into->num_pages; ++i)
+    {
+        present[into->page_index[i]] = TRUE;
+    }
+    for (i = 0; i < from->num_pages; ++i)
+    {
+        n += !present[from->page_index[i]];
+    }
+    if (n == into->num_pages)
+    {
+        return 0;
+    }
+
+    page_index = realloc(into->page_index, sizeof(int) * n);
+    if (!page_index)
+    {
+        return 1;
+    }
+    into->page_index = page_index;
+    pages = realloc(into->pages, sizeof(int) * HISTORY_PAGE_WORDS * n);
+    if (!pages)
+    {
+        return 1;
+    }
+    into->pages = pages;
+
+    for (i = 0; i < from->num_pages; ++i)
+    {
+        if (!present[from->page_index[i]])
+        {
+            into->page_index[into->num_pages] = from->page_index[i];
+            memcpy(&into->pages[into->num_pages * HISTORY_PAGE_WORDS], &from->pages[i * HISTORY_PAGE_WORDS],
+                   sizeof(int) * HISTORY_PAGE_WORDS);
+            into->num_pages++;
+        }
+    }
+    return 0;
+}
+
+/* Merges every other snapshot into the next one until the history fits its
+ * budget. The first snapshot holds all of memory and the last one matches
+ * the shadow, so both stay. */
+static void
+thin(APEX_History *history)
+{
+    HIST_Snapshot *s = history->snapshots;
+    int i, kept;
+
+    while (history->bytes > history->budget && history->num_snapshots > 2)
+    {
+        kept = 1;
+        for (i = 1; i < history->num_snapshots; ++i)
+        {
+            if (i % 2 == 1 && i < history->num_snapshots - 1 && merge_pages(&s[i + 1], &s[i]) == 0)
+            {
+                free_snapshot(&s[i]);
+                history->merged++;
+                continue;
+            }
+            s[kept++] = s[i];
+        }
+        history->num_snapshots = kept;
+        history->interval *= 2;
+
+        history->bytes = 0;
+        for (i = 0; i < history->num_snapshots; ++i)
+        {
+            history->bytes += snapshot_bytes(&s[i]);
+        }
+    }
+}
+
+APEX_History *
+APEX_history_create(APEX_CPU *cpu, int interval, int budget_kb)
+{
+    APEX_History *history;
+
+    history = calloc(1, sizeof(APEX_History));
+    if (!history)
+    {
+        return NULL;
+    }
+    history->cpu = cpu;
+    history->interval = interval;
+    history->budget = (long long)budget_kb * 1024;
+
+    /* The first snapshot is compared against nothing and saves every page */
+    APEX_history_record(history);
+    if (history->num_snapshots == 0)
+    {
+        APEX_history_destroy(history);
+        return NULL;
+    }
+    return history;
+}
+
+/* Takes a snapshot unless the history already reaches this cycle, returns
+ * the clock the next one is due at */
+int
+APEX_history_record(APEX_History *history)
+{
+    APEX_CPU *cpu = history->cpu;
+    HIST_Snapshot *s, *snapshots;
+    int changed[HIST_NUM_PAGES];
+    int first = history->num_snapshots == 0;
+    int i, n = 0;
+
+    if (!first && cpu->clock <= history->snapshots[history->num_snapshots - 1].clock)
+    {
+        return history->snapshots[history->num_snapshots - 1].clock + history->interval;
+    }
+    if (history->num_snapshots == history->capacity)
+    {
+        snapshots = realloc(history->snapshots, sizeof(HIST_Snapshot) * (history->capacity * 2 + 16));
+        if (!snapshots)
+        {
+            return cpu->clock + history->interval;
+        }
+        history->snapshots = snapshots;
+        history->capacity = history->capacity * 2 + 16;
+    }
+
+    for (i = 0; i < HIST_NUM_PAGES; ++i)
+    {
+        if (first || memcmp(&cpu->data_memory[i * HISTORY_PAGE_WORDS], &history->shadow[i * HISTORY_PAGE_WORDS],
+                            sizeof(int) * HISTORY_PAGE_WORDS) != 0)
+        {
+            changed[n++] = i;
+        }
+    }
+
+    s = &history->snapshots[history->num_snapshots];
+    memset(s, 0, sizeof(HIST_Snapshot));
+    s->clock = cpu->clock;
+    s->num_pages = n;
+    s->cpu_state = malloc(HIST_STATE_SIZE);
+    s->page_index = malloc(sizeof(int) * (n ? n : 1));
+    s->pages = malloc(sizeof(int) * HISTORY_PAGE_WORDS * (n ? n : 1));
+    if (!s->cpu_state || !s->page_index || !s->pages)
+    {
+        free_snapshot(s);
+        return cpu->clock + history->interval;
+    }
+
+    memcpy(s->cpu_state, cpu, HIST_MEMORY_START);
+    memcpy(s->cpu_state + HIST_MEMORY_START, (const unsigned char *)cpu + HIST_MEMORY_END,
+           sizeof(APEX_CPU) - HIST_MEMORY_END);
+    memcpy(s->page_index, changed, sizeof(int) * n);
+    for (i = 0; i < n; ++i)
+    {
+        memcpy(&s->pages[i * HISTORY_PAGE_WORDS], &cpu->data_memory[changed[i] * HISTORY_PAGE_WORDS],
+               sizeof(int) * HISTORY_PAGE_WORDS);
+    }
+    memcpy(history->shadow, cpu->data_memory, sizeof(int) * DATA_MEMORY_SIZE);
+    history->num_snapshots++;
+    history->bytes += snapshot_bytes(s);
+
+    thin(history);
+    return history->snapshots[history->num_snapshots - 1].clock + history->interval;
+}
+
+/* Loads the last snapshot at or before clock into the CPU, returns its
+ * clock or -1 if the history starts later */
+int
+APEX_history_restore(APEX_History *history, int clock)
+{
+    APEX_CPU *cpu = history->cpu;
+    const HIST_Snapshot *s;
+    int command = cpu->command, command_2 = cpu->command_2, single_step = cpu->single_step;
+    int i, j, target = -1;
+
+    for (i = history->num_snapshots - 1; i >= 0; --i)
+    {
+        if (history->snapshots[i].clock <= clock)
+        {
+            target = i;
+            break;
+        }
+    }
+    if (target < 0)
+    {
+        return -1;
+    }
+
+    /* Memory is the first snapshot with the pages of the later ones on top */
+    for (i = 0; i <= target; ++i)
+    {
+        s = &history->snapshots[i];
+        for (j = 0; j < s->num_pages; ++j)
+        {
+            memcpy(&cpu->data_memory[s->page_index[j] * HISTORY_PAGE_WORDS], &s->pages[j * HISTORY_PAGE_WORDS],
+                   sizeof(int) * HISTORY_PAGE_WORDS);
+        }
+    }
+
+    /* How the run is displayed is not part of the state */
+    s = &history->snapshots[target];
+    memcpy(cpu, s->cpu_state, HIST_MEMORY_START);
+    memcpy((unsigned char *)cpu + HIST_MEMORY_END, s->cpu_state + HIST_MEMORY_START,
+           sizeof(APEX_CPU) - HIST_MEMORY_END);
+    cpu->command = command;
+    cpu->command_2 = command_2;
+    cpu->single_step = single_step;
+    return s->clock;
+}
+
+/* Clock of the first snapshot, the earliest cycle that can be restored */
+int
+APEX_history_start(const APEX_History *history)
+{
+    return history->snapshots[0].clock;
+}
+
+void
+APEX_history_set_limits(APEX_History *history, int interval, int budget_kb)
+{
+    history->interval = interval;
+    history->budget = (long long)budget_kb * 1024;
+    thin(history);
+}
+
+void
+APEX_history_print(const APEX_History *history)
+{
+    const HIST_Snapshot *last = &history->snapshots[history->num_snapshots - 1];
+
+    printf("%d snapshots from cycle %d to %d, one every %d cycles, %lld KB of %lld KB, %lld merged\n",
+           history->num_snapshots, history->snapshots[0].clock, last->clock, history->interval,
+           (history->bytes + 1023) / 1024, history->budget / 1024, history->merged);
+}
+
+void
+APEX_history_destroy(APEX_History *history)
+{
+    int i;
+
+    for (i = 0; i < history->num_snapshots; ++i)
+    {
+        free_snapshot(&history->snapshots[i]);
+    }
+    free(history->snapshots);
+    free(history);
+}
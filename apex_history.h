@@ -0,0 +1,35 @@
+/*
+ * apex_history.h
+ * Contains declarations for the snapshot history used by reverse execution
+ *
+ * A snapshot is taken every interval cycles while the program runs forward.
+ * Each one holds the CPU state except data memory, plus the pages of data
+ * memory that differ from the previous snapshot; the oldest one holds all
+ * of memory. Going back to a cycle restores the last snapshot at or before
+ * it and replays the cycles in between, which gives the same state since
+ * the pipeline is deterministic. When the snapshots outgrow their budget
+ * every other one is merged into the next and the interval doubles, so the
+ * history always reaches back to its first cycle.
+ */
+#ifndef _APEX_HISTORY_H_
+#define _APEX_HISTORY_H_
+
+#include "apex_cpu.h"
+
+/* Data memory words compared and saved together */
+#define HISTORY_PAGE_WORDS 64
+
+/* Defaults */
+#define HISTORY_DEFAULT_INTERVAL 10000  /* cycles */
+#define HISTORY_DEFAULT_BUDGET_KB 65536
+
+typedef struct APEX_History APEX_History;
+
+APEX_History *APEX_history_create(APEX_CPU *cpu, int interval, int budget_kb);
+int APEX_history_record(APEX_History *history);
+int APEX_history_restore(APEX_History *history, int clock);
+int APEX_history_start(const APEX_History *history);
+void APEX_history_set_limits(APEX_History *history, int interval, int budget_kb);
+void APEX_history_print(const APEX_History *history);
+void APEX_history_destroy(APEX_History *history);
+#endif
@@ -0,0 +1,137 @@
+/*
+ * apex_interval.c
+ * Contains the interval statistics stream
+ *
+ * Counting is a few increments per cycle; the file is only touched once
+ * per interval and through a large stdio buffer, so even short intervals
+ * of a long run cost little more than the run.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+#include "apex_interval.h"
+
+#define INTERVAL_BUFFER_SIZE (1 << 20)
+
+struct APEX_Interval
+{
+    FILE *fp;
+    char *buffer;
+    int period;
+
+    /* Current interval */
+    int start_cycle;
+    int start_retired;
+    int cycles;
+    long long decode[INTERVAL_DECODE_OUTCOMES];
+    long long int_busy;
+    long long mul_busy;
+    long long ls_busy;
+    long long branches;
+    long long taken;
+    long long loads;
+    long long stores;
+};
+
+static void
+reset(APEX_Interval *iv, const APEX_CPU *cpu)
+{
+    iv->start_cycle = cpu->clock + 1;
+    iv->start_retired = cpu->insn_completed;
+    iv->cycles = 0;
+    memset(iv->decode, 0, sizeof(iv->decode));
+    iv->int_busy = iv->mul_busy = iv->ls_busy = 0;
+    iv->branches = iv->taken = 0;
+    iv->loads = iv->stores = 0;
+}
+
+static void
+write_row(APEX_Interval *iv, const APEX_CPU *cpu)
+{
+    int retired = cpu->insn_completed - iv->start_retired;
+
+    fprintf(iv->fp, "%d,%d,%d,%.4f,%lld,%lld,%lld,%lld,%lld,%lld,%lld,%lld,%lld,%lld,%lld,%lld\n", iv->start_cycle,
+            iv->cycles, retired, iv->cycles ? (double)retired / iv->cycles : 0.0, iv->decode[INTERVAL_ISSUED],
+            iv->decode[INTERVAL_STALL_DATA], iv->decode[INTERVAL_STALL_BRANCH], iv->decode[INTERVAL_STALL_FU],
+            iv->decode[INTERVAL_EMPTY], iv->int_busy, iv->mul_busy, iv->ls_busy, iv->branches, iv->taken,
+            iv->loads, iv->stores);
+}
+
+APEX_Interval *
+APEX_interval_open(const char *filename, const APEX_CPU *cpu, int period)
+{
+    APEX_Interval *iv;
+
+    iv = calloc(1, sizeof(APEX_Interval));
+    if (!iv)
+    {
+        return NULL;
+    }
+    iv->period = period;
+    iv->buffer = malloc(INTERVAL_BUFFER_SIZE);
+    iv->fp = fopen(filename, "w");
+    if (!iv->buffer || !iv->fp)
+    {
+        if (iv->fp)
+        {
+            fclose(iv->fp);
+        }
+        free(iv->buffer);
+        free(iv);
+        return NULL;
+    }
+    setvbuf(iv->fp, iv->buffer, _IOFBF, INTERVAL_BUFFER_SIZE);
+    fprintf(iv->fp, "cycle,cycles,retired,ipc,issued,stall_data,stall_branch,stall_fu,empty,"
+                    "int_busy,mul_busy,ls_busy,branches,taken,loads,stores\n");
+    reset(iv, cpu);
+    iv->start_cycle = cpu->clock;
+    return iv;
+}
+
+/* Adds the decode outcome and the busy FUs of a cycle to the current row and
+ * writes the row every period cycles. The FU latches are read after decode
+ * issued, so they hold what the FUs work on in the next cycle, which evens
+ * out over an interval. */
+void APEX_interval_cycle(APEX_Interval *iv, const APEX_CPU *cpu, int decode_outcome)
+{
+    iv->decode[decode_outcome]++;
+    iv->int_busy += cpu->integer.has_insn;
+    iv->mul_busy += cpu->multiplier.has_insn;
+    iv->ls_busy += cpu->load_store.has_insn;
+    if (++iv->cycles == iv->period)
+    {
+        write_row(iv, cpu);
+        reset(iv, cpu);
+    }
+}
+
+void APEX_interval_branch(APEX_Interval *iv, int taken)
+{
+    iv->branches++;
+    iv->taken += taken;
+}
+
+/* Called when the load/store FU accesses data memory */
+void APEX_interval_memory(APEX_Interval *iv, int opcode)
+{
+    iv->loads += APEX_reads_memory(opcode);
+    iv->stores += APEX_writes_memory(opcode);
+}
+
+/* Writes the partial interval the run ended in and closes the file */
+void APEX_interval_close(APEX_Interval *iv, const APEX_CPU *cpu)
+{
+    if (iv->cycles > 0 || cpu->insn_completed != iv->start_retired)
+    {
+        write_row(iv, cpu);
+    }
+    if (fclose(iv->fp))
+    {
+        fprintf(stderr, "APEX_Error: Unable to write the interval statistics\n");
+    }
+    free(iv->buffer);
+    free(iv);
+}
@@ -0,0 +1,44 @@
+/*
+ * apex_interval.h
+ * Contains declarations for the interval statistics stream
+ *
+ * Every period cycles one CSV row is appended to the file, holding what
+ * happened in those cycles:
+ *   cycle, cycles       first cycle of the interval and its length
+ *   retired, ipc
+ *   issued              cycles decode issued an instruction to an FU
+ *   stall_data          cycles decode held an instruction waiting on a register
+ *   stall_branch        cycles decode held an instruction behind an unresolved branch
+ *   stall_fu            cycles decode held an instruction because its FU was busy
+ *   empty               cycles decode had no instruction (branch redirects, HALT fetched)
+ *   int_busy, mul_busy, ls_busy
+ *                       cycles each FU held an instruction
+ *   branches, taken     BZ/BNZ resolved and taken
+ *   loads, stores       data memory reads and writes, an AADD counting as both
+ * issued, the stalls and empty add up to cycles. The last row covers the
+ * cycles from the last full interval to the end of the run.
+ */
+#ifndef _APEX_INTERVAL_H_
+#define _APEX_INTERVAL_H_
+
+#include "apex_cpu.h"
+
+/* Default interval in cycles */
+#define INTERVAL_DEFAULT_PERIOD 10000
+
+/* What decode did in a cycle */
+#define INTERVAL_ISSUED 0
+#define INTERVAL_STALL_DATA 1
+#define INTERVAL_STALL_BRANCH 2
+#define INTERVAL_STALL_FU 3
+#define INTERVAL_EMPTY 4
+#define INTERVAL_DECODE_OUTCOMES 5
+
+typedef struct APEX_Interval APEX_Interval;
+
+APEX_Interval *APEX_interval_open(const char *filename, const APEX_CPU *cpu, int period);
+void APEX_interval_cycle(APEX_Interval *iv, const APEX_CPU *cpu, int decode_outcome);
+void APEX_interval_branch(APEX_Interval *iv, int taken);
+void APEX_interval_memory(APEX_Interval *iv, int opcode);
+void APEX_interval_close(APEX_Interval *iv, const APEX_CPU *cpu);
+#endif
@@ -0,0 +1,128 @@
+/*
+ * apex_isa.c
+ * Contains the functional model of the APEX ISA
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+#include "apex_isa.h"
+
+static void
+set_zero_flag(APEX_CPU *cpu, int result)
+{
+    cpu->zero_flag = (result == 0) ? TRUE : FALSE;
+}
+
+/*
+ * Executes the instruction at cpu->pc and retires it
+ *
+ * Returns TRUE once HALT has been executed, or when the pc leaves code
+ * memory.
+ */
+int APEX_isa_step(APEX_CPU *cpu)
+{
+    const APEX_Instruction *ins;
+    int index = (cpu->pc - 4000) / 4;
+    int *regs = cpu->regs;
+    int next_pc = cpu->pc + 4;
+    int old;
+
+    if (index < 0 || index >= cpu->code_memory_size)
+    {
+        fprintf(stderr, "APEX_Error: pc %d is outside code memory\n", cpu->pc);
+        return TRUE;
+    }
+    ins = &cpu->code_memory[index];
+
+    switch (ins->opcode)
+    {
+    case OPCODE_ADD:
+        regs[ins->rd] = regs[ins->rs1] + regs[ins->rs2];
+        set_zero_flag(cpu, regs[ins->rd]);
+        break;
+    case OPCODE_ADDL:
+        regs[ins->rd] = regs[ins->rs1] + ins->imm;
+        set_zero_flag(cpu, regs[ins->rd]);
+        break;
+    case OPCODE_SUB:
+        regs[ins->rd] = regs[ins->rs1] - regs[ins->rs2];
+        set_zero_flag(cpu, regs[ins->rd]);
+        break;
+    case OPCODE_SUBL:
+        regs[ins->rd] = regs[ins->rs1] - ins->imm;
+        set_zero_flag(cpu, regs[ins->rd]);
+        break;
+    case OPCODE_MUL:
+        regs[ins->rd] = regs[ins->rs1] * regs[ins->rs2];
+        set_zero_flag(cpu, regs[ins->rd]);
+        break;
+    case OPCODE_DIV:
+        regs[ins->rd] = regs[ins->rs1] / regs[ins->rs2];
+        set_zero_flag(cpu, regs[ins->rd]);
+        break;
+    case OPCODE_AND:
+        regs[ins->rd] = regs[ins->rs1] & regs[ins->rs2];
+        set_zero_flag(cpu, regs[ins->rd]);
+        break;
+    case OPCODE_OR:
+        regs[ins->rd] = regs[ins->rs1] | regs[ins->rs2];
+        set_zero_flag(cpu, regs[ins->rd]);
+        break;
+    case OPCODE_XOR:
+        regs[ins->rd] = regs[ins->rs1] ^ regs[ins->rs2];
+        set_zero_flag(cpu, regs[ins->rd]);
+        break;
+    case OPCODE_MOVC:
+        regs[ins->rd] = ins->imm;
+        set_zero_flag(cpu, regs[ins->rd]);
+        break;
+    case OPCODE_CMP:
+        set_zero_flag(cpu, regs[ins->rs1] - regs[ins->rs2]);
+        break;
+    case OPCODE_LOAD:
+        regs[ins->rd] = cpu->data_memory[regs[ins->rs1] + ins->imm];
+        break;
+    case OPCODE_STORE:
+        cpu->data_memory[regs[ins->rs2] + ins->imm] = regs[ins->rs1];
+        break;
+    case OPCODE_LDR:
+        regs[ins->rd] = cpu->data_memory[regs[ins->rs1] + regs[ins->rs2]];
+        break;
+    case OPCODE_STR:
+        cpu->data_memory[regs[ins->rs1] + regs[ins->rs2]] = regs[ins->rs3];
+        break;
+    case OPCODE_BZ:
+        if (cpu->zero_flag == TRUE)
+        {
+            next_pc = cpu->pc + ins->imm;
+        }
+        break;
+    case OPCODE_BNZ:
+        if (cpu->zero_flag == FALSE)
+        {
+            next_pc = cpu->pc + ins->imm;
+        }
+        break;
+    case OPCODE_RDCYCLE:
+        /* No cycles pass in the functional model */
+        regs[ins->rd] = cpu->clock;
+        break;
+    case OPCODE_RDINSTRET:
+        regs[ins->rd] = cpu->insn_completed;
+        break;
+    case OPCODE_AADD:
+        old = cpu->data_memory[regs[ins->rs1]];
+        cpu->data_memory[regs[ins->rs1]] = old + regs[ins->rs2];
+        regs[ins->rd] = old;
+        break;
+    case OPCODE_COREID:
+        regs[ins->rd] = cpu->core_id;
+        break;
+    }
+
+    cpu->pc = next_pc;
+    cpu->insn_completed++;
+    return ins->opcode == OPCODE_HALT;
+}
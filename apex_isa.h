@@ -0,0 +1,16 @@
+/*
+ * apex_isa.h
+ * Contains declarations for the functional model of the APEX ISA
+ *
+ * The functional model executes one instruction at a time on the
+ * architectural state of an APEX_CPU (pc, registers, zero flag and data
+ * memory) without touching the pipeline latches, the queue or the clock.
+ * Results are the same as those of the pipeline.
+ */
+#ifndef _APEX_ISA_H_
+#define _APEX_ISA_H_
+
+#include "apex_cpu.h"
+
+int APEX_isa_step(APEX_CPU *cpu);
+#endif
@@ -0,0 +1,237 @@
+/*
+ * apex_live.c
+ * Contains the live statistics published in shared memory
+ *
+ * The counts are kept in the process and copied to the region on a
+ * refresh, so a cycle costs a few increments and the shared cache line is
+ * only written every LIVE_PUBLISH_CYCLES cycles. The object is unlinked
+ * when the run ends; a viewer that has it mapped still sees the final
+ * values.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+#include "apex_interval.h"
+#include "apex_live.h"
+
+struct APEX_Live
+{
+    APEX_LiveRegion *region;
+    char name[256];
+    uint64_t values[LIVE_NUM_VALUES];
+};
+
+/* Decode outcomes in the order of their values */
+static const int live_decode_values[INTERVAL_DECODE_OUTCOMES] = {
+    LIVE_ISSUED, LIVE_STALL_DATA, LIVE_STALL_BRANCH, LIVE_STALL_FU, LIVE_EMPTY};
+
+static uint64_t
+host_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void
+publish(APEX_Live *live, const APEX_CPU *cpu, int state)
+{
+    APEX_LiveRegion *region = live->region;
+    uint64_t seq = region->seq;
+    int i;
+
+    live->values[LIVE_STATE] = state;
+    live->values[LIVE_CLOCK] = cpu->clock;
+    live->values[LIVE_RETIRED] = cpu->insn_completed;
+    live->values[LIVE_PC] = cpu->pc;
+    live->values[LIVE_FETCHED] = 0;
+    for (i = 0; i < cpu->num_threads; ++i)
+    {
+        live->values[LIVE_FETCHED] += cpu->threads[i].fetched;
+    }
+    live->values[LIVE_HOST_NS] = host_ns();
+
+    /* Odd while the values are inconsistent */
+    __atomic_store_n(&region->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    for (i = 0; i < LIVE_NUM_VALUES; ++i)
+    {
+        __atomic_store_n(&region->values[i], live->values[i], __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&region->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+APEX_Live *
+APEX_live_create(const char *name, const char *program)
+{
+    APEX_Live *live;
+    int fd;
+
+    live = calloc(1, sizeof(APEX_Live));
+    if (!live)
+    {
+        return NULL;
+    }
+    if (name)
+    {
+        snprintf(live->name, sizeof(live->name), "%s%s", name[0] == '/' ? "" : "/", name);
+    }
+    else
+    {
+        snprintf(live->name, sizeof(live->name), "%s%ld", LIVE_NAME_PREFIX, (long)getpid());
+    }
+
+    fd = shm_open(live->name, O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        free(live);
+        return NULL;
+    }
+    if (ftruncate(fd, sizeof(APEX_LiveRegion)))
+    {
+        close(fd);
+        shm_unlink(live->name);
+        free(live);
+        return NULL;
+    }
+    live->region = mmap(NULL, sizeof(APEX_LiveRegion), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (live->region == MAP_FAILED)
+    {
+        shm_unlink(live->name);
+        free(live);
+        return NULL;
+    }
+
+    live->region->version = LIVE_VERSION;
+    live->region->pid = getpid();
+    snprintf(live->region->program, sizeof(live->region->program), "%s", program);
+    /* A reader checks the magic last, once the rest is in place */
+    __atomic_store_n(&live->region->magic, LIVE_MAGIC, __ATOMIC_RELEASE);
+    fprintf(stderr, "APEX_Live: Publishing statistics in %s\n", live->name);
+    return live;
+}
+
+/* Counts a cycle into the private values. A reader polls the shared region
+ * at its own rate, so it is only refreshed every LIVE_PUBLISH_CYCLES cycles
+ * to keep the per-cycle cost to a few additions. */
+void APEX_live_cycle(APEX_Live *live, const APEX_CPU *cpu, int decode_outcome)
+{
+    live->values[live_decode_values[decode_outcome]]++;
+    live->values[LIVE_INT_BUSY] += cpu->integer.has_insn;
+    live->values[LIVE_MUL_BUSY] += cpu->multiplier.has_insn;
+    live->values[LIVE_LS_BUSY] += cpu->load_store.has_insn;
+    if (!(cpu->clock & (LIVE_PUBLISH_CYCLES - 1)))
+    {
+        publish(live, cpu, LIVE_RUNNING);
+    }
+}
+
+/* Publishes the final values and removes the object */
+void APEX_live_close(APEX_Live *live, const APEX_CPU *cpu)
+{
+    int state = LIVE_HALTED;
+    int i;
+
+    for (i = 0; i < cpu->num_threads; ++i)
+    {
+        if (!cpu->threads[i].halted)
+        {
+            state = LIVE_STOPPED;
+        }
+    }
+    publish(live, cpu, state);
+    munmap(live->region, sizeof(APEX_LiveRegion));
+    shm_unlink(live->name);
+    free(live);
+}
+
+/* Maps the region of a running simulator read only, NULL if there is none */
+const APEX_LiveRegion *
+APEX_live_attach(const char *name)
+{
+    APEX_LiveRegion *region;
+    char path[256];
+    struct stat st;
+    int fd;
+
+    snprintf(path, sizeof(path), "%s%s", name[0] == '/' ? "" : "/", name);
+    fd = shm_open(path, O_RDONLY, 0);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+    if (fstat(fd, &st) || st.st_size < (off_t)sizeof(APEX_LiveRegion))
+    {
+        close(fd);
+        return NULL;
+    }
+    region = mmap(NULL, sizeof(APEX_LiveRegion), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (region == MAP_FAILED)
+    {
+        return NULL;
+    }
+    if (__atomic_load_n(&region->magic, __ATOMIC_ACQUIRE) != LIVE_MAGIC || region->version != LIVE_VERSION)
+    {
+        munmap(region, sizeof(APEX_LiveRegion));
+        return NULL;
+    }
+    return region;
+}
+
+/* Reads of a region being written between two checks on the writer */
+#define LIVE_READ_SPINS 1000
+
+/* Copies a consistent set of values, retrying while the writer is inside.
+ * Returns FALSE if the writer died inside an update, which would otherwise
+ * leave the reader spinning forever */
+int APEX_live_read(const APEX_LiveRegion *region, uint64_t *values)
+{
+    struct timespec pause = {0, 1000000L};
+    uint64_t seq;
+    int tries = 0;
+    int i;
+
+    while (TRUE)
+    {
+        seq = __atomic_load_n(&region->seq, __ATOMIC_ACQUIRE);
+        if (!(seq & 1))
+        {
+            for (i = 0; i < LIVE_NUM_VALUES; ++i)
+            {
+                values[i] = __atomic_load_n(&region->values[i], __ATOMIC_RELAXED);
+            }
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&region->seq, __ATOMIC_RELAXED) == seq)
+            {
+                return TRUE;
+            }
+        }
+        if (++tries == LIVE_READ_SPINS)
+        {
+            if (kill(region->pid, 0) && errno == ESRCH)
+            {
+                return FALSE;
+            }
+            nanosleep(&pause, NULL);
+            tries = 0;
+        }
+    }
+}
+
+void APEX_live_detach(const APEX_LiveRegion *region)
+{
+    munmap((void *)region, sizeof(APEX_LiveRegion));
+}
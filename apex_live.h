@@ -0,0 +1,69 @@
+/*
+ * apex_live.h
+ * Contains declarations for the live statistics published in shared memory
+ *
+ * With --live the simulator creates a POSIX shared memory object holding an
+ * APEX_LiveRegion and refreshes its values every LIVE_PUBLISH_CYCLES cycles
+ * and when the run ends. The values are cumulative since the start of the
+ * run. They are written under a sequence lock: the writer makes seq odd,
+ * stores the values and makes seq even again, and a reader retries until it
+ * read the same even seq before and after copying them. The simulator never
+ * waits for a reader.
+ */
+#ifndef _APEX_LIVE_H_
+#define _APEX_LIVE_H_
+
+#include <stdint.h>
+
+#include "apex_cpu.h"
+
+#define LIVE_MAGIC 0x3156494c58455041ull /* "APEXLIV1" */
+#define LIVE_VERSION 1
+
+/* Default object name is LIVE_NAME_PREFIX followed by the pid */
+#define LIVE_NAME_PREFIX "/apex_sim."
+
+/* Cycles between refreshes, a power of two */
+#define LIVE_PUBLISH_CYCLES 16384
+
+/* Values of the region */
+#define LIVE_STATE 0          /* LIVE_RUNNING, LIVE_HALTED or LIVE_STOPPED */
+#define LIVE_CLOCK 1
+#define LIVE_RETIRED 2
+#define LIVE_PC 3
+#define LIVE_FETCHED 4
+#define LIVE_ISSUED 5         /* Cycles decode issued an instruction */
+#define LIVE_STALL_DATA 6     /* Cycles decode waited on a register */
+#define LIVE_STALL_BRANCH 7   /* Cycles decode waited behind an unresolved branch */
+#define LIVE_STALL_FU 8       /* Cycles decode waited on a busy FU */
+#define LIVE_EMPTY 9          /* Cycles decode had no instruction */
+#define LIVE_INT_BUSY 10      /* Cycles each FU held an instruction */
+#define LIVE_MUL_BUSY 11
+#define LIVE_LS_BUSY 12
+#define LIVE_HOST_NS 13       /* Host CLOCK_MONOTONIC time of the refresh */
+#define LIVE_NUM_VALUES 14
+
+#define LIVE_RUNNING 0
+#define LIVE_HALTED 1
+#define LIVE_STOPPED 2
+
+typedef struct APEX_LiveRegion
+{
+    uint64_t magic;
+    uint32_t version;
+    int32_t pid;
+    char program[256];
+    uint64_t seq;
+    uint64_t values[LIVE_NUM_VALUES];
+} APEX_LiveRegion;
+
+typedef struct APEX_Live APEX_Live;
+
+APEX_Live *APEX_live_create(const char *name, const char *program);
+void APEX_live_cycle(APEX_Live *live, const APEX_CPU *cpu, int decode_outcome);
+void APEX_live_close(APEX_Live *live, const APEX_CPU *cpu);
+
+const APEX_LiveRegion *APEX_live_attach(const char *name);
+int APEX_live_read(const APEX_LiveRegion *region, uint64_t *values);
+void APEX_live_detach(const APEX_LiveRegion *region);
+#endif
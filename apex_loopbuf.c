@@ -0,0 +1,113 @@
+/*
+ * apex_loopbuf.c
+ * Contains the loop buffer of the front end
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+#include "apex_loopbuf.h"
+
+struct APEX_Loopbuf
+{
+    int size;
+    int branch_pc; /* -1 while the buffer holds no loop */
+    int target;
+    uint64_t captured; /* One bit per instruction of the body */
+    uint64_t complete;
+
+    long long fetches;
+    long long hits;
+    long long loops;     /* Loops captured */
+    long long taken;     /* Taken backward branches of the loop in the buffer */
+    long long redirects; /* Of those, supplied without the fetch bubble */
+};
+
+APEX_Loopbuf *
+APEX_loopbuf_create(int size)
+{
+    APEX_Loopbuf *lb;
+
+    lb = calloc(1, sizeof(APEX_Loopbuf));
+    if (!lb)
+    {
+        return NULL;
+    }
+    lb->size = size;
+    lb->branch_pc = -1;
+    return lb;
+}
+
+/* Called by fetch for every instruction, returns TRUE when the buffer
+ * supplies it */
+int APEX_loopbuf_fetch(APEX_Loopbuf *lb, int pc)
+{
+    uint64_t bit;
+
+    lb->fetches++;
+    if (pc < lb->target || pc > lb->branch_pc)
+    {
+        return FALSE;
+    }
+    bit = 1ull << ((pc - lb->target) / 4);
+    if (lb->captured & bit)
+    {
+        lb->hits++;
+        return TRUE;
+    }
+    lb->captured |= bit;
+    if (lb->captured == lb->complete)
+    {
+        lb->loops++;
+    }
+    return FALSE;
+}
+
+/* Called for every taken BZ/BNZ, returns TRUE when the buffer supplies the
+ * target in the current cycle */
+int APEX_loopbuf_taken(APEX_Loopbuf *lb, int pc, int target)
+{
+    int body = (pc - target) / 4 + 1;
+
+    if (target > pc || body > lb->size)
+    {
+        return FALSE;
+    }
+    if (pc == lb->branch_pc && target == lb->target)
+    {
+        lb->taken++;
+        if (lb->captured == lb->complete)
+        {
+            lb->redirects++;
+            return TRUE;
+        }
+        return FALSE;
+    }
+
+    /* Another small loop, capture it from its next iteration on */
+    lb->branch_pc = pc;
+    lb->target = target;
+    lb->captured = 0;
+    lb->complete = body == LOOPBUF_MAX_SIZE ? ~0ull : (1ull << body) - 1;
+    lb->taken++;
+    return FALSE;
+}
+
+void APEX_loopbuf_report(const APEX_Loopbuf *lb)
+{
+    FILE *fp = stderr;
+
+    fprintf(fp, "----------\n%s\n----------\n", "Loop Buffer:");
+    fprintf(fp, "size = %d instructions, loops captured = %lld\n", lb->size, lb->loops);
+    fprintf(fp, "fetches = %lld, served by the buffer = %lld (hit rate %.1f%%)\n", lb->fetches, lb->hits,
+            lb->fetches ? 100.0 * lb->hits / lb->fetches : 0.0);
+    fprintf(fp, "loop branches taken = %lld, redirected without a bubble = %lld (%.1f%%)\n", lb->taken,
+            lb->redirects, lb->taken ? 100.0 * lb->redirects / lb->taken : 0.0);
+}
+
+void APEX_loopbuf_destroy(APEX_Loopbuf *lb)
+{
+    free(lb);
+}
@@ -0,0 +1,29 @@
+/*
+ * apex_loopbuf.h
+ * Contains declarations for the loop buffer of the front end
+ *
+ * A taken BZ/BNZ whose target is at most size instructions back starts
+ * capturing the loop body, from the target to the branch, as fetch reads
+ * it from code memory. Once every instruction of the body was captured,
+ * fetching it is served by the buffer and the branch redirect to the top
+ * of the loop is supplied in the cycle the branch resolves, so the cycle
+ * fetch otherwise skips after a taken branch is saved. The buffer holds
+ * the last small loop taken, a taken branch of another small loop
+ * replaces it.
+ */
+#ifndef _APEX_LOOPBUF_H_
+#define _APEX_LOOPBUF_H_
+
+#include "apex_cpu.h"
+
+#define LOOPBUF_MAX_SIZE 64     /* Instructions */
+#define LOOPBUF_DEFAULT_SIZE 16
+
+typedef struct APEX_Loopbuf APEX_Loopbuf;
+
+APEX_Loopbuf *APEX_loopbuf_create(int size);
+int APEX_loopbuf_fetch(APEX_Loopbuf *lb, int pc);
+int APEX_loopbuf_taken(APEX_Loopbuf *lb, int pc, int target);
+void APEX_loopbuf_report(const APEX_Loopbuf *lb);
+void APEX_loopbuf_destroy(APEX_Loopbuf *lb);
+#endif
@@ -15,6 +15,16 @@
 /* Integers */
 #define DATA_MEMORY_SIZE 4096
 
+/* Largest number of cores sharing data memory (--cores) */
+#define MAX_CORES 64
+
+/* Largest number of hardware threads of one core (--smt) */
+#define MAX_THREADS 8
+
+/* Thread picked by fetch with --smt */
+#define SMT_POLICY_RR 0    /* Next thread in turn */
+#define SMT_POLICY_READY 1 /* Next thread in turn whose instruction would not stall in decode */
+
 /* Size of integer register file */
 #define REG_FILE_SIZE 16
 
@@ -39,19 +49,38 @@
 #define OPCODE_ADDL 0x0e
 #define OPCODE_SUBL 0x0f
 #define OPCODE_NOP 0x10
+#define OPCODE_RDCYCLE 0x11
+#define OPCODE_RDINSTRET 0x12
+#define OPCODE_AADD 0x13
+#define OPCODE_FENCE 0x14
+#define OPCODE_COREID 0x15
 #define OPCODE_LDR 0x20
 #define OPCODE_STR 0x30
 
+/* Pipeline stage identifiers, in the order instructions flow through them */
+#define STAGE_FETCH 0
+#define STAGE_DECODE 1
+#define STAGE_INTEGER 2
+#define STAGE_MULTIPLIER 3
+#define STAGE_LOAD_STORE 4
+#define STAGE_WRITEBACK 5
+#define NUM_STAGES 6
+
 /* Numeric simulator command identifiers*/
 #define INITIALIZE 1
 #define SIMULATE 2
 #define SINGLE_STEP 3
 #define DISPLAY 4
 #define SHOWMEM 5
+#define DEBUGGER 6
+#define ESTIMATE 7
 
 /* Set this flag to 1 to enable debug messages */
 #define ENABLE_DEBUG_MESSAGES 0
 
+/* Set this flag to 0 to compile out host-side profiling (--profile) */
+#define ENABLE_HOST_PROFILE 1
+
 /* Set this flag to 1 to enable cycle single-step mode */
 #define ENABLE_SINGLE_STEP 1
 #define ENABLE_MULTIPLE_STEP 0
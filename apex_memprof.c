@@ -0,0 +1,399 @@
+/*
+ * apex_memprof.c
+ * Contains the data memory access profiler
+ *
+ * Reuse distances are computed with a Fenwick tree indexed by access time,
+ * holding a 1 at the time of the latest access to every address. The
+ * number of distinct addresses touched since the previous access to an
+ * address is then a range sum, O(log n) per access. Timestamps are
+ * renumbered when the tree fills up, so memory stays bounded on long runs.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+#include "apex_memprof.h"
+
+/* Number of timestamps the Fenwick tree can hold before being renumbered */
+#define MEMPROF_TREE_SIZE (4 * DATA_MEMORY_SIZE)
+
+/* Reuse distance buckets: 0, 1, 2-3, 4-7, ... */
+#define MEMPROF_REUSE_BUCKETS 15
+
+/* Words per region in the address histogram */
+#define MEMPROF_REGION_SIZE 64
+
+/* Number of most accessed addresses listed in the report */
+#define MEMPROF_TOP_ADDRESSES 10
+
+typedef struct MP_Stride
+{
+    long long count;   /* Executions of the load */
+    long long regular; /* Executions that repeated the previous stride */
+    int last_addr;
+    int stride;
+} MP_Stride;
+
+struct APEX_Memprof
+{
+    long long reads[DATA_MEMORY_SIZE];
+    long long writes[DATA_MEMORY_SIZE];
+    long long accesses;
+    long long out_of_range;
+
+    /* LRU stack reuse distance */
+    int tree[MEMPROF_TREE_SIZE + 1];
+    int last_time[DATA_MEMORY_SIZE]; /* 0 when never accessed */
+    int owner[MEMPROF_TREE_SIZE + 1]; /* Scratch for tree_compact(), kept here so it cannot fail */
+    int now;
+    long long reuse[MEMPROF_REUSE_BUCKETS];
+    long long cold;
+
+    /* Stride of every static load, indexed by instruction number - 1 */
+    MP_Stride *strides;
+    int num_insns;
+    const APEX_Instruction *code_memory;
+
+    /* Working set per interval */
+    int interval;
+    int start_clock; /* Cycle the first interval starts in, the restored one after --restore */
+    int interval_start;
+    int interval_index;
+    int epoch[DATA_MEMORY_SIZE]; /* Last interval the address was touched in, plus one */
+    int distinct;
+    long long interval_accesses;
+    int *ws_distinct;
+    long long *ws_accesses;
+    int ws_count;
+    int ws_capacity;
+};
+
+static void
+tree_add(APEX_Memprof *prof, int i, int value)
+{
+    for (; i <= MEMPROF_TREE_SIZE; i += i & -i)
+    {
+        prof->tree[i] += value;
+    }
+}
+
+static int
+tree_sum(const APEX_Memprof *prof, int i)
+{
+    int sum = 0;
+
+    for (; i > 0; i -= i & -i)
+    {
+        sum += prof->tree[i];
+    }
+    return sum;
+}
+
+/* Renumbers the live timestamps 1..n keeping their order */
+static void
+tree_compact(APEX_Memprof *prof)
+{
+    int *owner = prof->owner;
+    int t, addr, n = 0;
+
+    for (t = 0; t <= MEMPROF_TREE_SIZE; ++t)
+    {
+        owner[t] = -1;
+    }
+    for (addr = 0; addr < DATA_MEMORY_SIZE; ++addr)
+    {
+        if (prof->last_time[addr])
+        {
+            owner[prof->last_time[addr]] = addr;
+        }
+    }
+
+    memset(prof->tree, 0, sizeof(prof->tree));
+    for (t = 1; t <= MEMPROF_TREE_SIZE; ++t)
+    {
+        if (owner[t] >= 0)
+        {
+            prof->last_time[owner[t]] = ++n;
+            tree_add(prof, n, 1);
+        }
+    }
+    prof->now = n;
+}
+
+static int
+reuse_bucket(int distance)
+{
+    int bucket = 0;
+
+    while (distance > 0 && bucket < MEMPROF_REUSE_BUCKETS - 1)
+    {
+        distance >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+/* Closes working set intervals up to the one containing clock */
+static void
+close_intervals(APEX_Memprof *prof, int clock)
+{
+    while (clock >= prof->interval_start + prof->interval)
+    {
+        if (prof->ws_count == prof->ws_capacity)
+        {
+            int capacity = prof->ws_capacity ? prof->ws_capacity * 2 : 256;
+            int *distinct = realloc(prof->ws_distinct, sizeof(int) * capacity);
+            long long *accesses;
+
+            if (!distinct)
+            {
+                return;
+            }
+            prof->ws_distinct = distinct;
+            accesses = realloc(prof->ws_accesses, sizeof(long long) * capacity);
+            if (!accesses)
+            {
+                return;
+            }
+            prof->ws_accesses = accesses;
+            prof->ws_capacity = capacity;
+        }
+        prof->ws_distinct[prof->ws_count] = prof->distinct;
+        prof->ws_accesses[prof->ws_count] = prof->interval_accesses;
+        prof->ws_count++;
+
+        prof->interval_start += prof->interval;
+        prof->interval_index++;
+        prof->distinct = 0;
+        prof->interval_accesses = 0;
+    }
+}
+
+APEX_Memprof *
+APEX_memprof_create(const APEX_CPU *cpu, int interval)
+{
+    APEX_Memprof *prof;
+
+    prof = calloc(1, sizeof(APEX_Memprof));
+    if (!prof)
+    {
+        return NULL;
+    }
+
+    prof->num_insns = cpu->code_memory_size;
+    prof->code_memory = cpu->code_memory;
+    prof->strides = calloc(prof->num_insns, sizeof(MP_Stride));
+    if (!prof->strides)
+    {
+        free(prof);
+        return NULL;
+    }
+
+    prof->interval = interval > 0 ? interval : MEMPROF_DEFAULT_INTERVAL;
+    prof->start_clock = cpu->clock;
+    prof->interval_start = cpu->clock;
+    return prof;
+}
+
+/* Called by the load/store FU once per memory access */
+void APEX_memprof_access(APEX_Memprof *prof, const CPU_Stage *stage, int clock)
+{
+    int addr = stage->memory_address;
+    int is_store = APEX_writes_memory(stage->opcode);
+    MP_Stride *entry;
+    int stride;
+
+    if (addr < 0 || addr >= DATA_MEMORY_SIZE)
+    {
+        prof->out_of_range++;
+        return;
+    }
+    prof->accesses++;
+    if (is_store)
+    {
+        prof->writes[addr]++;
+    }
+    else
+    {
+        prof->reads[addr]++;
+    }
+
+    /* Reuse distance */
+    if (prof->last_time[addr])
+    {
+        prof->reuse[reuse_bucket(tree_sum(prof, prof->now) - tree_sum(prof, prof->last_time[addr]))]++;
+        tree_add(prof, prof->last_time[addr], -1);
+    }
+    else
+    {
+        prof->cold++;
+    }
+    if (prof->now == MEMPROF_TREE_SIZE)
+    {
+        prof->last_time[addr] = 0;
+        tree_compact(prof);
+    }
+    prof->last_time[addr] = ++prof->now;
+    tree_add(prof, prof->now, 1);
+
+    /* Stride of static loads */
+    if (!is_store && stage->number >= 1 && stage->number <= prof->num_insns)
+    {
+        entry = &prof->strides[stage->number - 1];
+        if (entry->count)
+        {
+            stride = addr - entry->last_addr;
+            if (entry->count > 1 && stride == entry->stride)
+            {
+                entry->regular++;
+            }
+            entry->stride = stride;
+        }
+        entry->last_addr = addr;
+        entry->count++;
+    }
+
+    /* Working set */
+    close_intervals(prof, clock);
+    if (prof->epoch[addr] != prof->interval_index + 1)
+    {
+        prof->epoch[addr] = prof->interval_index + 1;
+        prof->distinct++;
+    }
+    prof->interval_accesses++;
+}
+
+/* Prints the profile to stderr */
+void APEX_memprof_report(APEX_Memprof *prof, int clock)
+{
+    FILE *fp = stderr;
+    long long region, total, cumulative = 0;
+    long long top[MEMPROF_TOP_ADDRESSES];
+    int top_addr[MEMPROF_TOP_ADDRESSES];
+    int footprint = 0, ws_max = 0;
+    double ws_sum = 0;
+    int i, j, k;
+
+    close_intervals(prof, clock + 1);
+
+    fprintf(fp, "----------\n%s\n----------\n", "Memory Profile:");
+    fprintf(fp, "accesses = %lld, out of range = %lld\n", prof->accesses, prof->out_of_range);
+
+    /* Address histogram */
+    for (i = 0; i < MEMPROF_TOP_ADDRESSES; ++i)
+    {
+        top[i] = 0;
+        top_addr[i] = -1;
+    }
+    for (i = 0; i < DATA_MEMORY_SIZE; ++i)
+    {
+        total = prof->reads[i] + prof->writes[i];
+        if (!total)
+        {
+            continue;
+        }
+        footprint++;
+        for (j = 0; j < MEMPROF_TOP_ADDRESSES; ++j)
+        {
+            if (total > top[j])
+            {
+                for (k = MEMPROF_TOP_ADDRESSES - 1; k > j; --k)
+                {
+                    top[k] = top[k - 1];
+                    top_addr[k] = top_addr[k - 1];
+                }
+                top[j] = total;
+                top_addr[j] = i;
+                break;
+            }
+        }
+    }
+    fprintf(fp, "footprint = %d words\n", footprint);
+    fprintf(fp, "%-12s %12s %12s\n", "address", "reads", "writes");
+    for (i = 0; i < MEMPROF_TOP_ADDRESSES && top_addr[i] >= 0; ++i)
+    {
+        fprintf(fp, "MEM[%-6d]  %12lld %12lld\n", top_addr[i], prof->reads[top_addr[i]],
+                prof->writes[top_addr[i]]);
+    }
+    fprintf(fp, "%-12s %12s\n", "region", "accesses");
+    for (i = 0; i < DATA_MEMORY_SIZE; i += MEMPROF_REGION_SIZE)
+    {
+        region = 0;
+        for (j = i; j < i + MEMPROF_REGION_SIZE; ++j)
+        {
+            region += prof->reads[j] + prof->writes[j];
+        }
+        if (region)
+        {
+            fprintf(fp, "%5d-%-6d  %12lld\n", i, i + MEMPROF_REGION_SIZE - 1, region);
+        }
+    }
+
+    /* Strides */
+    fprintf(fp, "%-6s %-8s %12s %8s %10s\n", "insn", "pc", "executed", "stride", "regular");
+    for (i = 0; i < prof->num_insns; ++i)
+    {
+        if (prof->strides[i].count)
+        {
+            fprintf(fp, "I%-5d %-8d %12lld %8d %9.1f%%\n", i + 1, 4000 + i * 4,
+                    prof->strides[i].count, prof->strides[i].stride,
+                    prof->strides[i].count > 2
+                        ? 100.0 * prof->strides[i].regular / (prof->strides[i].count - 2)
+                        : 0.0);
+        }
+    }
+
+    /* Reuse distances, cumulative share is the hit rate of an LRU store of that many words */
+    fprintf(fp, "%-14s %12s %10s\n", "reuse distance", "accesses", "cumulative");
+    for (i = 0; i < MEMPROF_REUSE_BUCKETS; ++i)
+    {
+        if (!prof->reuse[i])
+        {
+            continue;
+        }
+        cumulative += prof->reuse[i];
+        if (i == 0)
+        {
+            fprintf(fp, "%-14s", "0");
+        }
+        else if (i == MEMPROF_REUSE_BUCKETS - 1)
+        {
+            fprintf(fp, ">=%-12d", 1 << (i - 1));
+        }
+        else
+        {
+            fprintf(fp, "%6d-%-7d", 1 << (i - 1), (1 << i) - 1);
+        }
+        fprintf(fp, " %12lld %9.1f%%\n", prof->reuse[i],
+                100.0 * cumulative / (prof->accesses ? prof->accesses : 1));
+    }
+    fprintf(fp, "%-14s %12lld\n", "cold", prof->cold);
+
+    /* Working set */
+    for (i = 0; i < prof->ws_count; ++i)
+    {
+        ws_sum += prof->ws_distinct[i];
+        if (prof->ws_distinct[i] > ws_max)
+        {
+            ws_max = prof->ws_distinct[i];
+        }
+    }
+    fprintf(fp, "working set per %d cycles: mean = %.1f words, max = %d words\n", prof->interval,
+            prof->ws_count ? ws_sum / prof->ws_count : 0.0, ws_max);
+    fprintf(fp, "%-12s %12s %12s\n", "cycle", "words", "accesses");
+    for (i = 0; i < prof->ws_count; ++i)
+    {
+        fprintf(fp, "%-12d %12d %12lld\n", prof->start_clock + i * prof->interval, prof->ws_distinct[i],
+                prof->ws_accesses[i]);
+    }
+}
+
+void APEX_memprof_destroy(APEX_Memprof *prof)
+{
+    free(prof->strides);
+    free(prof->ws_distinct);
+    free(prof->ws_accesses);
+    free(prof);
+}
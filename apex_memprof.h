@@ -0,0 +1,24 @@
+/*
+ * apex_memprof.h
+ * Contains declarations for the data memory access profiler
+ *
+ * Every LOAD/STORE/LDR/STR performed by the load/store FU is reported with
+ * its address. The profiler keeps an address histogram, the stride of each
+ * static load, an LRU stack reuse-distance histogram and the working set
+ * size of every interval of a given number of cycles.
+ */
+#ifndef _APEX_MEMPROF_H_
+#define _APEX_MEMPROF_H_
+
+#include "apex_cpu.h"
+
+/* Default working set interval in cycles */
+#define MEMPROF_DEFAULT_INTERVAL 1000
+
+typedef struct APEX_Memprof APEX_Memprof;
+
+APEX_Memprof *APEX_memprof_create(const APEX_CPU *cpu, int interval);
+void APEX_memprof_access(APEX_Memprof *prof, const CPU_Stage *stage, int clock);
+void APEX_memprof_report(APEX_Memprof *prof, int clock);
+void APEX_memprof_destroy(APEX_Memprof *prof);
+#endif
@@ -0,0 +1,427 @@
+/*
+ * apex_microbench.c
+ * Microbenchmark harness for the simulator internals
+ *
+ * Times create_code_memory, APEX_cpu_init, print_memory_file, a single
+ * cycle and every stage function in isolation. The stage functions are
+ * reached through apex_cpu_internal.h.
+ *
+ * Every benchmark is warmed up first, then timed one call per sample.
+ * Cycle and stage samples are taken on consecutive cycles of the program,
+ * so their spread covers the states the pipeline actually goes through.
+ * The cost of reading the clock is measured once and subtracted from every
+ * sample. Results are written to stdout as JSON or CSV.
+ */
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "apex_cpu.h"
+#include "apex_cpu_internal.h"
+#include "apex_macros.h"
+#include "apex_profile.h"
+
+#define MB_DEFAULT_WARMUP 1000
+#define MB_DEFAULT_SAMPLES 10000
+#define MB_DEFAULT_REPEAT 101
+
+/* Functions timed --repeat times are warmed up with this fraction of the
+ * warmup, in calls */
+#define MB_REPEAT_WARMUP_DIVISOR 100
+
+#define MB_FORMAT_JSON 0
+#define MB_FORMAT_CSV 1
+
+typedef struct MB_Result
+{
+    const char *name;
+    int samples;
+    double min;
+    double median;
+    double p90;
+    double p99;
+    double max;
+    double mean;
+} MB_Result;
+
+typedef struct MB_Options
+{
+    const char *filename;
+    int warmup;  /* Cycles run before sampling */
+    int samples; /* Samples of the cycle and stage benchmarks */
+    int repeat;  /* Samples of the whole program benchmarks */
+    int format;
+} MB_Options;
+
+static double timer_overhead;
+
+static int
+compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+/* Nearest-rank percentile of sorted samples */
+static double
+percentile(const double *sorted, int n, double p)
+{
+    int rank = (int)(p / 100.0 * n + 0.999999);
+
+    if (rank < 1)
+    {
+        rank = 1;
+    }
+    if (rank > n)
+    {
+        rank = n;
+    }
+    return sorted[rank - 1];
+}
+
+static void
+summarize(MB_Result *result, const char *name, double *ns, int n)
+{
+    double sum = 0;
+    int i;
+
+    for (i = 0; i < n; ++i)
+    {
+        ns[i] -= timer_overhead;
+        if (ns[i] < 0)
+        {
+            ns[i] = 0;
+        }
+        sum += ns[i];
+    }
+    qsort(ns, n, sizeof(double), compare_double);
+
+    result->name = name;
+    result->samples = n;
+    result->min = ns[0];
+    result->median = percentile(ns, n, 50);
+    result->p90 = percentile(ns, n, 90);
+    result->p99 = percentile(ns, n, 99);
+    result->max = ns[n - 1];
+    result->mean = sum / n;
+}
+
+/* Median cost of two back to back clock reads */
+static double
+measure_timer_overhead(int samples)
+{
+    double *ns = malloc(sizeof(double) * samples);
+    double median;
+    uint64_t t0;
+    int i;
+
+    for (i = 0; i < samples; ++i)
+    {
+        t0 = APEX_profile_now();
+        ns[i] = APEX_profile_now() - t0;
+    }
+    qsort(ns, samples, sizeof(double), compare_double);
+    median = percentile(ns, samples, 50);
+    free(ns);
+    return median;
+}
+
+static APEX_CPU *
+new_cpu(const char *filename)
+{
+    APEX_CPU *cpu = APEX_cpu_init(filename);
+
+    if (!cpu)
+    {
+        fprintf(stderr, "APEX_Error: Unable to initialize CPU\n");
+        exit(1);
+    }
+    cpu->command = SIMULATE;
+    return cpu;
+}
+
+static void
+bench_create_code_memory(const MB_Options *opt, MB_Result *result, double *ns)
+{
+    APEX_Instruction *code;
+    uint64_t t0;
+    int size, i;
+
+    for (i = -opt->warmup / MB_REPEAT_WARMUP_DIVISOR; i < opt->repeat; ++i)
+    {
+        t0 = APEX_profile_now();
+        code = create_code_memory(opt->filename, &size);
+        if (i >= 0)
+        {
+            ns[i] = APEX_profile_now() - t0;
+        }
+        free(code);
+    }
+    summarize(result, "create_code_memory", ns, opt->repeat);
+}
+
+static void
+bench_cpu_init(const MB_Options *opt, MB_Result *result, double *ns)
+{
+    APEX_CPU *cpu;
+    uint64_t t0;
+    int i;
+
+    for (i = -opt->warmup / MB_REPEAT_WARMUP_DIVISOR; i < opt->repeat; ++i)
+    {
+        t0 = APEX_profile_now();
+        cpu = APEX_cpu_init(opt->filename);
+        if (i >= 0)
+        {
+            ns[i] = APEX_profile_now() - t0;
+        }
+        APEX_cpu_stop(cpu);
+    }
+    summarize(result, "APEX_cpu_init", ns, opt->repeat);
+}
+
+/* Runs the warmup cycles first, so the memory has the content of a running
+ * program */
+static void
+bench_print_memory_file(const MB_Options *opt, MB_Result *result, double *ns)
+{
+    APEX_CPU *cpu = new_cpu(opt->filename);
+    uint64_t t0;
+    int saved_stdout, null_fd;
+    int i;
+
+    for (i = 0; i < opt->warmup && !APEX_cpu_cycle(cpu); ++i)
+    {
+        cpu->clock++;
+    }
+
+    /* The formatting is timed, the output is thrown away */
+    fflush(stdout);
+    saved_stdout = dup(STDOUT_FILENO);
+    null_fd = open("/dev/null", O_WRONLY);
+    dup2(null_fd, STDOUT_FILENO);
+
+    for (i = -opt->warmup / MB_REPEAT_WARMUP_DIVISOR; i < opt->repeat; ++i)
+    {
+        t0 = APEX_profile_now();
+        APEX_cpu_print_memory(cpu);
+        fflush(stdout);
+        if (i >= 0)
+        {
+            ns[i] = APEX_profile_now() - t0;
+        }
+    }
+
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+    close(null_fd);
+    APEX_cpu_stop(cpu);
+    summarize(result, "print_memory_file", ns, opt->repeat);
+}
+
+static void
+bench_cpu_cycle(const MB_Options *opt, MB_Result *result, double *ns)
+{
+    APEX_CPU *cpu = new_cpu(opt->filename);
+    uint64_t t0;
+    int halted, i;
+
+    for (i = -opt->warmup; i < opt->samples; ++i)
+    {
+        t0 = APEX_profile_now();
+        halted = APEX_cpu_cycle(cpu);
+        if (i >= 0)
+        {
+            ns[i] = APEX_profile_now() - t0;
+        }
+        cpu->clock++;
+
+        /* Start the program over when it finishes before the last sample */
+        if (halted)
+        {
+            APEX_cpu_stop(cpu);
+            cpu = new_cpu(opt->filename);
+        }
+    }
+    APEX_cpu_stop(cpu);
+    summarize(result, "APEX_cpu_cycle", ns, opt->samples);
+}
+
+/* Same order as APEX_cpu_cycle, with every stage timed on its own */
+static void
+bench_stages(const MB_Options *opt, MB_Result *results, double **ns)
+{
+    APEX_CPU *cpu = new_cpu(opt->filename);
+    uint64_t t[NUM_STAGES + 1];
+    int halted, i, s;
+
+    for (i = -opt->warmup; i < opt->samples; ++i)
+    {
+        t[0] = APEX_profile_now();
+        halted = APEX_writeback(cpu);
+        t[1] = APEX_profile_now();
+        APEX_load_store_FU(cpu);
+        t[2] = APEX_profile_now();
+        APEX_multiplier_FU(cpu);
+        t[3] = APEX_profile_now();
+        APEX_integer_FU(cpu);
+        t[4] = APEX_profile_now();
+        APEX_decode(cpu);
+        t[5] = APEX_profile_now();
+        APEX_fetch(cpu);
+        t[6] = APEX_profile_now();
+
+        if (i >= 0)
+        {
+            ns[STAGE_WRITEBACK][i] = t[1] - t[0];
+            ns[STAGE_LOAD_STORE][i] = t[2] - t[1];
+            ns[STAGE_MULTIPLIER][i] = t[3] - t[2];
+            ns[STAGE_INTEGER][i] = t[4] - t[3];
+            ns[STAGE_DECODE][i] = t[5] - t[4];
+            ns[STAGE_FETCH][i] = t[6] - t[5];
+        }
+        cpu->clock++;
+
+        /* The other stages ran after the halt, so this cycle is not kept */
+        if (halted)
+        {
+            APEX_cpu_stop(cpu);
+            cpu = new_cpu(opt->filename);
+            if (i >= 0)
+            {
+                i--;
+            }
+        }
+    }
+    APEX_cpu_stop(cpu);
+
+    for (s = 0; s < NUM_STAGES; ++s)
+    {
+        summarize(&results[s], APEX_stage_name(s), ns[s], opt->samples);
+    }
+}
+
+static void
+print_results(const MB_Options *opt, const MB_Result *results, int count)
+{
+    int i;
+
+    if (opt->format == MB_FORMAT_CSV)
+    {
+        printf("benchmark,samples,min_ns,median_ns,p90_ns,p99_ns,max_ns,mean_ns\n");
+        for (i = 0; i < count; ++i)
+        {
+            printf("%s,%d,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f\n", results[i].name, results[i].samples,
+                   results[i].min, results[i].median, results[i].p90, results[i].p99, results[i].max,
+                   results[i].mean);
+        }
+        return;
+    }
+
+    printf("{\n");
+    printf("  \"program\": \"%s\",\n", opt->filename);
+    printf("  \"warmup\": %d,\n", opt->warmup);
+    printf("  \"timer_overhead_ns\": %.1f,\n", timer_overhead);
+    printf("  \"results\": [\n");
+    for (i = 0; i < count; ++i)
+    {
+        printf("    {\"benchmark\": \"%s\", \"samples\": %d, \"min_ns\": %.1f, \"median_ns\": %.1f, "
+               "\"p90_ns\": %.1f, \"p99_ns\": %.1f, \"max_ns\": %.1f, \"mean_ns\": %.1f}%s\n",
+               results[i].name, results[i].samples, results[i].min, results[i].median,
+               results[i].p90, results[i].p99, results[i].max, results[i].mean,
+               i + 1 < count ? "," : "");
+    }
+    printf("  ]\n}\n");
+}
+
+static void
+usage(const char *prog)
+{
+    fprintf(stderr,
+            "APEX_Help: Usage %s <input_file> [--warmup=<n>] [--samples=<n>] [--repeat=<n>]\n"
+            "                 [--format=json|csv]\n",
+            prog);
+    exit(1);
+}
+
+int main(int argc, char const *argv[])
+{
+    MB_Options opt;
+    MB_Result results[4 + NUM_STAGES];
+    double *ns[NUM_STAGES];
+    int count = 0;
+    int i;
+
+    opt.filename = NULL;
+    opt.warmup = MB_DEFAULT_WARMUP;
+    opt.samples = MB_DEFAULT_SAMPLES;
+    opt.repeat = MB_DEFAULT_REPEAT;
+    opt.format = MB_FORMAT_JSON;
+
+    for (i = 1; i < argc; ++i)
+    {
+        if (strncmp(argv[i], "--warmup=", 9) == 0)
+        {
+            opt.warmup = atoi(argv[i] + 9);
+        }
+        else if (strncmp(argv[i], "--samples=", 10) == 0)
+        {
+            opt.samples = atoi(argv[i] + 10);
+        }
+        else if (strncmp(argv[i], "--repeat=", 9) == 0)
+        {
+            opt.repeat = atoi(argv[i] + 9);
+        }
+        else if (strcmp(argv[i], "--format=json") == 0)
+        {
+            opt.format = MB_FORMAT_JSON;
+        }
+        else if (strcmp(argv[i], "--format=csv") == 0)
+        {
+            opt.format = MB_FORMAT_CSV;
+        }
+        else if (argv[i][0] != '-' && !opt.filename)
+        {
+            opt.filename = argv[i];
+        }
+        else
+        {
+            usage(argv[0]);
+        }
+    }
+    if (!opt.filename || opt.warmup < 0 || opt.samples < 1 || opt.repeat < 1)
+    {
+        usage(argv[0]);
+    }
+
+    for (i = 0; i < NUM_STAGES; ++i)
+    {
+        ns[i] = malloc(sizeof(double) * (opt.samples > opt.repeat ? opt.samples : opt.repeat));
+        if (!ns[i])
+        {
+            fprintf(stderr, "APEX_Error: Unable to allocate memory\n");
+            exit(1);
+        }
+    }
+
+    timer_overhead = measure_timer_overhead(opt.samples);
+
+    bench_create_code_memory(&opt, &results[count++], ns[0]);
+    bench_cpu_init(&opt, &results[count++], ns[0]);
+    bench_print_memory_file(&opt, &results[count++], ns[0]);
+    bench_cpu_cycle(&opt, &results[count++], ns[0]);
+    bench_stages(&opt, &results[count], ns);
+    count += NUM_STAGES;
+
+    print_results(&opt, results, count);
+
+    for (i = 0; i < NUM_STAGES; ++i)
+    {
+        free(ns[i]);
+    }
+    return 0;
+}
@@ -0,0 +1,232 @@
+/*
+ * apex_multicore.c
+ * Contains the multi-core driver
+ *
+ * Core 0 is the CPU set up by main, the others are copies of it that point
+ * at its data memory. Core 0 runs on the calling thread.
+ */
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+#include "apex_multicore.h"
+
+struct APEX_Multicore
+{
+    int num_cores;
+    int quantum;
+    int ordered; /* Load/store FU entered in core order every cycle */
+    APEX_CPU *cores[MAX_CORES];
+    pthread_t threads[MAX_CORES];
+    pthread_barrier_t barrier;
+
+    atomic_uint turn;                 /* Ticket allowed into the load/store FU */
+    unsigned int ticket[MAX_CORES];   /* Next ticket of each core, cycle * num_cores + core */
+    atomic_int halted_at[MAX_CORES];  /* Quantum a core halted in, 0 while running */
+};
+
+APEX_Multicore *
+APEX_multicore_create(APEX_CPU *cpu, int num_cores, int quantum)
+{
+    APEX_Multicore *mc;
+    int i;
+
+    mc = calloc(1, sizeof(APEX_Multicore));
+    if (!mc)
+    {
+        return NULL;
+    }
+    mc->num_cores = num_cores;
+    mc->quantum = quantum;
+    mc->ordered = (quantum == 1);
+    atomic_init(&mc->turn, 0);
+    pthread_barrier_init(&mc->barrier, NULL, num_cores);
+
+    cpu->core_id = 0;
+    cpu->multicore = mc;
+    mc->cores[0] = cpu;
+    for (i = 1; i < num_cores; ++i)
+    {
+        mc->cores[i] = malloc(sizeof(APEX_CPU));
+        if (!mc->cores[i])
+        {
+            APEX_multicore_destroy(mc);
+            return NULL;
+        }
+        /* Code memory and data memory stay those of core 0 */
+        memcpy(mc->cores[i], cpu, sizeof(APEX_CPU));
+        mc->cores[i]->data_memory = cpu->data_memory;
+        mc->cores[i]->regs = mc->cores[i]->threads[0].regs;
+        mc->cores[i]->state_regs = mc->cores[i]->threads[0].state_regs;
+        mc->cores[i]->instruction_queue = mc->cores[i]->threads[0].instruction_queue;
+        mc->cores[i]->core_id = i;
+    }
+    for (i = 0; i < num_cores; ++i)
+    {
+        mc->ticket[i] = i;
+        atomic_init(&mc->halted_at[i], 0);
+    }
+    return mc;
+}
+
+void APEX_multicore_memory_enter(APEX_CPU *cpu)
+{
+    APEX_Multicore *mc = cpu->multicore;
+
+    if (mc->ordered)
+    {
+        while (atomic_load_explicit(&mc->turn, memory_order_acquire) != mc->ticket[cpu->core_id])
+        {
+            sched_yield();
+        }
+    }
+}
+
+void APEX_multicore_memory_leave(APEX_CPU *cpu)
+{
+    APEX_Multicore *mc = cpu->multicore;
+
+    if (mc->ordered)
+    {
+        atomic_store_explicit(&mc->turn, mc->ticket[cpu->core_id] + 1, memory_order_release);
+        mc->ticket[cpu->core_id] += mc->num_cores;
+    }
+}
+
+/* TRUE once every core had halted by the end of quantum q */
+static int
+all_halted(APEX_Multicore *mc, int q)
+{
+    int i, h;
+
+    for (i = 0; i < mc->num_cores; ++i)
+    {
+        h = atomic_load_explicit(&mc->halted_at[i], memory_order_relaxed);
+        if (h == 0 || h > q)
+        {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+static void *
+core_thread(void *arg)
+{
+    APEX_CPU *cpu = arg;
+    APEX_Multicore *mc = cpu->multicore;
+    int id = cpu->core_id;
+    unsigned int cycle = 0;
+    int halted = FALSE;
+    int q = 0;
+    int i;
+
+    while (TRUE)
+    {
+        for (i = 0; i < mc->quantum; ++i, ++cycle)
+        {
+            if (!halted)
+            {
+                if (APEX_cpu_cycle(cpu))
+                {
+                    halted = TRUE;
+                }
+                else
+                {
+                    cpu->clock++;
+                }
+            }
+            /* Halted cores and a HALT retiring before the load/store FU
+             * still pass the turn on */
+            if (mc->ordered && mc->ticket[id] == cycle * mc->num_cores + id)
+            {
+                APEX_multicore_memory_enter(cpu);
+                APEX_multicore_memory_leave(cpu);
+            }
+        }
+
+        /* Halting is published for the quantum it happened in, so a core
+         * that halts in the next one cannot change what the others decide */
+        q++;
+        if (halted && atomic_load_explicit(&mc->halted_at[id], memory_order_relaxed) == 0)
+        {
+            atomic_store_explicit(&mc->halted_at[id], q, memory_order_relaxed);
+        }
+        pthread_barrier_wait(&mc->barrier);
+        if (all_halted(mc, q))
+        {
+            break;
+        }
+    }
+    return NULL;
+}
+
+void APEX_multicore_run(APEX_Multicore *mc)
+{
+    struct timespec start, end;
+    long long insns = 0;
+    long long core_cycles = 0;
+    int cycles = 0;
+    double host;
+    int i;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 1; i < mc->num_cores; ++i)
+    {
+        if (pthread_create(&mc->threads[i], NULL, core_thread, mc->cores[i]) != 0)
+        {
+            fprintf(stderr, "APEX_Error: Unable to start the thread of core %d\n", i);
+            exit(1);
+        }
+    }
+    core_thread(mc->cores[0]);
+    for (i = 1; i < mc->num_cores; ++i)
+    {
+        pthread_join(mc->threads[i], NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    host = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    for (i = 0; i < mc->num_cores; ++i)
+    {
+        printf("Core %d:\n", i);
+        APEX_cpu_print_registers(mc->cores[i]);
+        insns += mc->cores[i]->insn_completed;
+        core_cycles += mc->cores[i]->clock;
+        if (mc->cores[i]->clock > cycles)
+        {
+            cycles = mc->cores[i]->clock;
+        }
+    }
+    APEX_cpu_print_memory(mc->cores[0]);
+    for (i = 0; i < mc->num_cores; ++i)
+    {
+        printf("APEX_CPU: Core %d Halted, cycles = %d instructions = %d\n", i, mc->cores[i]->clock,
+               mc->cores[i]->insn_completed);
+    }
+    printf("APEX_CPU: Simulation Complete, cycles = %d instructions = %lld\n", cycles, insns);
+
+    fprintf(stderr, "APEX_Multicore: %d cores, quantum %d cycles%s\n", mc->num_cores, mc->quantum,
+            mc->ordered ? ", deterministic" : "");
+    fprintf(stderr, "APEX_Multicore: host time %.3f s, %.0f core-cycles/s\n", host,
+            host > 0 ? core_cycles / host : 0.0);
+}
+
+void APEX_multicore_destroy(APEX_Multicore *mc)
+{
+    int i;
+
+    for (i = 1; i < mc->num_cores; ++i)
+    {
+        free(mc->cores[i]);
+    }
+    mc->cores[0]->multicore = NULL;
+    pthread_barrier_destroy(&mc->barrier);
+    free(mc);
+}
@@ -0,0 +1,26 @@
+/*
+ * apex_multicore.h
+ * Contains declarations for running several APEX cores on shared memory
+ *
+ * Every core runs the same program with its own pipeline and register
+ * file, COREID tells them apart. Data memory is shared. Each core runs on
+ * its own host thread and the cores meet at a barrier every quantum of
+ * cycles. With a quantum of 1 the cores also take turns in the load/store
+ * FU in core order every cycle, which makes the run deterministic; larger
+ * quanta let the threads run freely in between.
+ */
+#ifndef _APEX_MULTICORE_H_
+#define _APEX_MULTICORE_H_
+
+#include "apex_cpu.h"
+
+#define MULTICORE_DEFAULT_QUANTUM 1
+
+typedef struct APEX_Multicore APEX_Multicore;
+
+APEX_Multicore *APEX_multicore_create(APEX_CPU *cpu, int num_cores, int quantum);
+void APEX_multicore_run(APEX_Multicore *mc);
+void APEX_multicore_destroy(APEX_Multicore *mc);
+void APEX_multicore_memory_enter(APEX_CPU *cpu);
+void APEX_multicore_memory_leave(APEX_CPU *cpu);
+#endif
@@ -0,0 +1,337 @@
+/*
+ * apex_multiprog.c
+ * Contains the time-sliced scheduler for multiprogrammed runs
+ *
+ * Program 0 is the one main loaded into the CPU, the others are parsed
+ * here. All of them start at pc 4000 with zeroed registers and memory, so
+ * switching code memory, data memory and registers is all a switch needs
+ * once the pipeline is empty. The clock is global: RDCYCLE reads wall
+ * time, not the time a program was scheduled.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+#include "apex_multiprog.h"
+
+/* A loaded program and what it did on the core */
+typedef struct MP_Program
+{
+    const char *filename;
+    APEX_Instruction *code_memory;
+    int code_memory_size;
+    int memory[DATA_MEMORY_SIZE];
+    int regs[REG_FILE_SIZE];
+    int pc;
+    int zero_flag;
+    int halted;
+    int halt_cycle;
+    long long retired;
+    long long cycles;        /* Cycles scheduled, including its drains */
+    long long slices;
+    long long refill_cycles; /* Cycles from a restore to the first retirement of the slice */
+    long long refilled;      /* Slices that retired anything */
+} MP_Program;
+
+struct APEX_Multiprog
+{
+    APEX_CPU *cpu;
+    int num_programs;
+    int timeslice;
+    int switch_cost;
+    MP_Program *programs[MAX_PROGRAMS];
+    int current;
+
+    /* Current slice */
+    int slice_start;
+    int slice_retired_start;
+    int slice_refilled;
+
+    long long switches;
+    long long drain_cycles;
+    long long switch_cycles;
+    long long squashed;
+};
+
+APEX_Multiprog *
+APEX_multiprog_create(APEX_CPU *cpu, const char *first_file, const char *const *files, int num_files,
+                      int timeslice, int switch_cost)
+{
+    APEX_Multiprog *mp;
+    MP_Program *p;
+    int i;
+
+    mp = calloc(1, sizeof(APEX_Multiprog));
+    if (!mp)
+    {
+        return NULL;
+    }
+    mp->cpu = cpu;
+    mp->timeslice = timeslice;
+    mp->switch_cost = switch_cost;
+
+    for (i = 0; i <= num_files; ++i)
+    {
+        p = calloc(1, sizeof(MP_Program));
+        if (!p)
+        {
+            APEX_multiprog_destroy(mp);
+            return NULL;
+        }
+        mp->programs[mp->num_programs++] = p;
+        p->pc = 4000;
+        if (i == 0)
+        {
+            /* Code memory stays owned by the CPU */
+            p->filename = first_file;
+            p->code_memory = cpu->code_memory;
+            p->code_memory_size = cpu->code_memory_size;
+            memcpy(p->memory, cpu->data_memory, sizeof(int) * DATA_MEMORY_SIZE);
+            memcpy(p->regs, cpu->regs, sizeof(int) * REG_FILE_SIZE);
+            p->pc = cpu->pc;
+            p->zero_flag = cpu->zero_flag;
+        }
+        else
+        {
+            p->filename = files[i - 1];
+            p->code_memory = create_code_memory(p->filename, &p->code_memory_size);
+            if (!p->code_memory)
+            {
+                fprintf(stderr, "APEX_Error: Unable to load program %s\n", p->filename);
+                APEX_multiprog_destroy(mp);
+                return NULL;
+            }
+        }
+    }
+    return mp;
+}
+
+/* Squashes the instruction in decode and drains the issued ones */
+static int
+flush_and_drain(APEX_Multiprog *mp)
+{
+    APEX_CPU *cpu = mp->cpu;
+    int start = cpu->clock;
+    int halted;
+
+    if (cpu->decode.has_insn)
+    {
+        mp->squashed++;
+    }
+    halted = APEX_cpu_flush(cpu);
+    mp->drain_cycles += cpu->clock - start;
+    return halted;
+}
+
+static void
+save_context(APEX_Multiprog *mp, MP_Program *p)
+{
+    APEX_CPU *cpu = mp->cpu;
+
+    p->pc = cpu->pc;
+    p->zero_flag = cpu->zero_flag;
+    memcpy(p->regs, cpu->regs, sizeof(int) * REG_FILE_SIZE);
+}
+
+/* Loads a program into the empty pipeline and starts fetching it */
+static void
+load_context(APEX_Multiprog *mp, int index)
+{
+    APEX_CPU *cpu = mp->cpu;
+    MP_Program *p = mp->programs[index];
+
+    memset(&cpu->fetch, 0, sizeof(CPU_Stage));
+    memset(&cpu->decode, 0, sizeof(CPU_Stage));
+    memset(&cpu->integer, 0, sizeof(CPU_Stage));
+    memset(&cpu->multiplier, 0, sizeof(CPU_Stage));
+    memset(&cpu->load_store, 0, sizeof(CPU_Stage));
+    memset(&cpu->writeback, 0, sizeof(CPU_Stage));
+    memset(cpu->state_regs, 0, sizeof(int) * REG_FILE_SIZE);
+    cpu->Front = 0;
+    cpu->Rear = -1;
+    cpu->queue_count = 0;
+    cpu->fetch_from_next_cycle = FALSE;
+    cpu->threads[0].fetch_done = FALSE;
+    cpu->threads[0].halted = FALSE;
+
+    cpu->pc = p->pc;
+    cpu->zero_flag = p->zero_flag;
+    memcpy(cpu->regs, p->regs, sizeof(int) * REG_FILE_SIZE);
+    cpu->data_memory = p->memory;
+    cpu->code_memory = p->code_memory;
+    cpu->code_memory_size = p->code_memory_size;
+    cpu->fetch.has_insn = TRUE;
+
+    mp->current = index;
+    mp->slice_start = cpu->clock;
+    mp->slice_retired_start = cpu->insn_completed;
+    mp->slice_refilled = FALSE;
+    p->slices++;
+}
+
+/* Charges the slice that just ended to the current program */
+static void
+end_slice(APEX_Multiprog *mp, int halted)
+{
+    APEX_CPU *cpu = mp->cpu;
+    MP_Program *p = mp->programs[mp->current];
+
+    save_context(mp, p);
+    p->cycles += cpu->clock - mp->slice_start;
+    p->retired += cpu->insn_completed - mp->slice_retired_start;
+    if (halted)
+    {
+        p->halted = TRUE;
+        p->halt_cycle = cpu->clock;
+    }
+}
+
+/* Next program in turn that has not halted, -1 if there is none */
+static int
+next_program(const APEX_Multiprog *mp)
+{
+    int i, index;
+
+    for (i = 1; i <= mp->num_programs; ++i)
+    {
+        index = (mp->current + i) % mp->num_programs;
+        if (!mp->programs[index]->halted)
+        {
+            return index;
+        }
+    }
+    return -1;
+}
+
+/* Another program waiting to run, the timer does not preempt a lone program */
+static int
+others_runnable(const APEX_Multiprog *mp)
+{
+    int next = next_program(mp);
+
+    return next >= 0 && next != mp->current;
+}
+
+static void
+context_switch(APEX_Multiprog *mp, int next)
+{
+    mp->cpu->clock += mp->switch_cost;
+    mp->switch_cycles += mp->switch_cost;
+    mp->switches++;
+    load_context(mp, next);
+}
+
+static void
+report(const APEX_Multiprog *mp)
+{
+    const APEX_CPU *cpu = mp->cpu;
+    const MP_Program *p;
+    int cycles = cpu->clock > 0 ? cpu->clock : 1;
+    int i;
+
+    fprintf(stderr, "APEX_Multiprog: %d programs, timeslice %d cycles, switch cost %d cycles\n",
+            mp->num_programs, mp->timeslice, mp->switch_cost);
+    fprintf(stderr, "APEX_Multiprog: throughput IPC %.3f over %d cycles\n", (double)cpu->insn_completed / cycles,
+            cycles);
+    fprintf(stderr, "APEX_Multiprog: %lld context switches, %lld drain cycles, %lld switch cycles "
+                    "(%.2f%% of the run), %lld squashed in decode\n",
+            mp->switches, mp->drain_cycles, mp->switch_cycles,
+            100.0 * (mp->drain_cycles + mp->switch_cycles) / cycles, mp->squashed);
+    for (i = 0; i < mp->num_programs; ++i)
+    {
+        p = mp->programs[i];
+        fprintf(stderr, "APEX_Multiprog: program %d (%s): retired %lld, IPC %.3f while scheduled, "
+                        "%lld slices, %.1f refill cycles per slice, %s %d\n",
+                i, p->filename, p->retired, p->cycles ? (double)p->retired / p->cycles : 0.0, p->slices,
+                p->refilled ? (double)p->refill_cycles / p->refilled : 0.0,
+                p->halted ? "halted at cycle" : "running at cycle", p->halted ? p->halt_cycle : cpu->clock);
+    }
+}
+
+void APEX_multiprog_run(APEX_Multiprog *mp)
+{
+    APEX_CPU *cpu = mp->cpu;
+    MP_Program *p;
+    int next, halted, i;
+
+    load_context(mp, 0);
+    while (TRUE)
+    {
+        halted = APEX_cpu_cycle(cpu);
+        if (!halted)
+        {
+            cpu->clock++;
+            if (!mp->slice_refilled && cpu->insn_completed != mp->slice_retired_start)
+            {
+                p = mp->programs[mp->current];
+                p->refill_cycles += cpu->clock - mp->slice_start;
+                p->refilled++;
+                mp->slice_refilled = TRUE;
+            }
+            /* A slice that retired nothing is extended, or a timeslice
+             * shorter than the refill would squash the same instruction forever */
+            if (cpu->clock - mp->slice_start < mp->timeslice || !mp->slice_refilled || !others_runnable(mp))
+            {
+                continue;
+            }
+
+            /* Timer interrupt */
+            halted = flush_and_drain(mp);
+        }
+
+        end_slice(mp, halted);
+        next = next_program(mp);
+        if (next < 0)
+        {
+            break;
+        }
+        if (halted)
+        {
+            /* The cycle HALT retired in is over for the next program */
+            cpu->clock++;
+        }
+        context_switch(mp, next);
+    }
+
+    for (i = 0; i < mp->num_programs; ++i)
+    {
+        p = mp->programs[i];
+        printf("Program %d (%s):\n", i, p->filename);
+        memcpy(cpu->regs, p->regs, sizeof(int) * REG_FILE_SIZE);
+        cpu->data_memory = p->memory;
+        APEX_cpu_print_state(cpu);
+    }
+    for (i = 0; i < mp->num_programs; ++i)
+    {
+        p = mp->programs[i];
+        printf("APEX_CPU: Program %d Halted at cycle %d, instructions = %lld\n", i, p->halt_cycle, p->retired);
+    }
+    printf("APEX_CPU: Simulation Complete, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
+    report(mp);
+}
+
+void APEX_multiprog_destroy(APEX_Multiprog *mp)
+{
+    APEX_CPU *cpu = mp->cpu;
+    int i;
+
+    /* Give the CPU back its own program before it is freed */
+    if (mp->num_programs > 0)
+    {
+        cpu->code_memory = mp->programs[0]->code_memory;
+        cpu->code_memory_size = mp->programs[0]->code_memory_size;
+        memcpy(cpu->memory_store, mp->programs[0]->memory, sizeof(int) * DATA_MEMORY_SIZE);
+        cpu->data_memory = cpu->memory_store;
+    }
+    for (i = 0; i < mp->num_programs; ++i)
+    {
+        if (i > 0)
+        {
+            free(mp->programs[i]->code_memory);
+        }
+        free(mp->programs[i]);
+    }
+    free(mp);
+}
@@ -0,0 +1,30 @@
+/*
+ * apex_multiprog.h
+ * Contains declarations for multiprogrammed runs on one core
+ *
+ * Several programs are loaded, each with its own code memory, data memory
+ * and registers, and share the pipeline in time slices. When a program's
+ * slice runs out, or it halts, the instruction in decode is squashed, the
+ * instructions already issued to the FUs are drained, its architectural
+ * state is saved and the next program's is loaded into an empty pipeline.
+ * Every switch also costs a fixed number of idle cycles for the save and
+ * restore itself.
+ */
+#ifndef _APEX_MULTIPROG_H_
+#define _APEX_MULTIPROG_H_
+
+#include "apex_cpu.h"
+
+#define MAX_PROGRAMS 16
+
+/* Defaults, in cycles */
+#define MULTIPROG_DEFAULT_TIMESLICE 10000
+#define MULTIPROG_DEFAULT_SWITCH_COST 100
+
+typedef struct APEX_Multiprog APEX_Multiprog;
+
+APEX_Multiprog *APEX_multiprog_create(APEX_CPU *cpu, const char *first_file, const char *const *files,
+                                      int num_files, int timeslice, int switch_cost);
+void APEX_multiprog_run(APEX_Multiprog *mp);
+void APEX_multiprog_destroy(APEX_Multiprog *mp);
+#endif
@@ -0,0 +1,304 @@
+/*
+ * apex_pipeview.c
+ * Contains the pipeline timeline export (Konata / Chrome trace-event)
+ *
+ * Events are written as soon as an instruction leaves a stage, so the only
+ * state kept in memory is one record per instruction in flight, found by
+ * the dynamic id fetch stores in its latch. An instruction
+ * stays in its current stage until a stage function reports it somewhere
+ * else, which covers the cycles it spends stalled without being printed.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+#include "apex_pipeview.h"
+
+/* Output is written through a large stdio buffer */
+#define PIPEVIEW_BUFFER_SIZE (1 << 20)
+
+/* Records for instructions in flight, more than the latches can hold */
+#define PIPEVIEW_MAX_INFLIGHT 16
+
+/* Short stage names shown on the timeline, indexed by STAGE_* identifier.
+ * The Chrome lanes take the full names from APEX_stage_name.
+ */
+static const char *pipeview_stage_names[NUM_STAGES] = {
+    "F", "D", "IntFU", "MulFU", "LSFU", "WB"};
+
+/* In-flight state of one dynamic instruction */
+typedef struct PV_Insn
+{
+    long long id; /* Id in the output, -1 when the record is free */
+    int seq;      /* Dynamic id of the latch */
+    int stage;    /* Stage the instruction currently occupies */
+    int enter;    /* Cycle it entered that stage */
+    int pc;
+    char text[64];
+} PV_Insn;
+
+struct APEX_Pipeview
+{
+    FILE *fp;
+    char *buffer;
+    int format;
+    PV_Insn insns[PIPEVIEW_MAX_INFLIGHT];
+    long long next_id;    /* Next dynamic instruction id */
+    long long retired;    /* Retired instruction count, used as Konata retire id */
+    int last_clock;       /* Last cycle written to the file */
+    int first_event;      /* No comma before the first Chrome event */
+    PV_Insn *pending_wb;  /* Instruction that entered writeback in the last cycle */
+};
+
+static void
+chrome_event(APEX_Pipeview *pv, const PV_Insn *insn, int stage_id, int start, int dur)
+{
+    fprintf(pv->fp,
+            "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,"
+            "\"ts\":%d,\"dur\":%d,\"args\":{\"id\":%lld,\"pc\":%d}}",
+            pv->first_event ? "" : ",\n", insn->text, pipeview_stage_names[stage_id],
+            stage_id, start, dur, insn->id, insn->pc);
+    pv->first_event = FALSE;
+}
+
+/* Ends the stage the instruction is currently in */
+static void
+leave_stage(APEX_Pipeview *pv, PV_Insn *insn, int clock)
+{
+    if (pv->format == PIPEVIEW_KONATA)
+    {
+        fprintf(pv->fp, "E\t%lld\t0\t%s\n", insn->id, pipeview_stage_names[insn->stage]);
+    }
+    else
+    {
+        chrome_event(pv, insn, insn->stage, insn->enter, clock - insn->enter);
+    }
+}
+
+static void
+enter_stage(APEX_Pipeview *pv, PV_Insn *insn, int stage_id, int clock)
+{
+    insn->stage = stage_id;
+    insn->enter = clock;
+
+    if (pv->format == PIPEVIEW_KONATA)
+    {
+        fprintf(pv->fp, "S\t%lld\t0\t%s\n", insn->id, pipeview_stage_names[stage_id]);
+    }
+}
+
+/* Removes the instruction from the pipeline, flushed or retired */
+static void
+finish(APEX_Pipeview *pv, PV_Insn *insn, int clock, int flushed)
+{
+    leave_stage(pv, insn, clock);
+
+    if (pv->format == PIPEVIEW_KONATA)
+    {
+        fprintf(pv->fp, "R\t%lld\t%lld\t%d\n", insn->id, flushed ? 0 : pv->retired, flushed);
+    }
+    else if (flushed)
+    {
+        fprintf(pv->fp,
+                ",\n{\"name\":\"flush %s\",\"ph\":\"i\",\"s\":\"t\",\"pid\":0,\"tid\":%d,\"ts\":%d}",
+                insn->text, insn->stage, clock);
+    }
+
+    if (!flushed)
+    {
+        pv->retired++;
+    }
+    insn->id = -1;
+}
+
+static PV_Insn *
+find_insn(APEX_Pipeview *pv, int seq)
+{
+    int i;
+
+    for (i = 0; i < PIPEVIEW_MAX_INFLIGHT; ++i)
+    {
+        if (pv->insns[i].id >= 0 && pv->insns[i].seq == seq)
+        {
+            return &pv->insns[i];
+        }
+    }
+    return NULL;
+}
+
+/* Takes a free record, or the oldest one when an instruction left the
+ * pipeline without being reported */
+static PV_Insn *
+new_insn(APEX_Pipeview *pv, int clock)
+{
+    PV_Insn *oldest = &pv->insns[0];
+    int i;
+
+    for (i = 0; i < PIPEVIEW_MAX_INFLIGHT; ++i)
+    {
+        if (pv->insns[i].id < 0)
+        {
+            return &pv->insns[i];
+        }
+        if (pv->insns[i].id < oldest->id)
+        {
+            oldest = &pv->insns[i];
+        }
+    }
+    finish(pv, oldest, clock, TRUE);
+    return oldest;
+}
+
+APEX_Pipeview *
+APEX_pipeview_open(const char *filename, const APEX_CPU *cpu)
+{
+    APEX_Pipeview *pv;
+    const char *ext;
+    int i;
+
+    pv = calloc(1, sizeof(APEX_Pipeview));
+    if (!pv)
+    {
+        return NULL;
+    }
+
+    pv->buffer = malloc(PIPEVIEW_BUFFER_SIZE);
+    pv->fp = fopen(filename, "w");
+    if (!pv->buffer || !pv->fp)
+    {
+        if (pv->fp)
+        {
+            fclose(pv->fp);
+        }
+        free(pv->buffer);
+        free(pv);
+        return NULL;
+    }
+    setvbuf(pv->fp, pv->buffer, _IOFBF, PIPEVIEW_BUFFER_SIZE);
+
+    for (i = 0; i < PIPEVIEW_MAX_INFLIGHT; ++i)
+    {
+        pv->insns[i].id = -1;
+    }
+
+    ext = strrchr(filename, '.');
+    pv->format = (ext && strcmp(ext, ".json") == 0) ? PIPEVIEW_CHROME : PIPEVIEW_KONATA;
+    pv->first_event = TRUE;
+    pv->last_clock = cpu->clock;
+
+    if (pv->format == PIPEVIEW_KONATA)
+    {
+        fprintf(pv->fp, "Kanata\t0004\nC=\t%d\n", cpu->clock);
+    }
+    else
+    {
+        fprintf(pv->fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+        for (i = 0; i < NUM_STAGES; ++i)
+        {
+            fprintf(pv->fp,
+                    "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,"
+                    "\"args\":{\"name\":\"%s\"}}",
+                    pv->first_event ? "" : ",\n", i, APEX_stage_name(i));
+            pv->first_event = FALSE;
+        }
+    }
+    return pv;
+}
+
+/* Called at the start of every simulated cycle */
+void APEX_pipeview_cycle(APEX_Pipeview *pv, int clock)
+{
+    if (clock == pv->last_clock)
+    {
+        return;
+    }
+
+    if (pv->format == PIPEVIEW_KONATA)
+    {
+        fprintf(pv->fp, "C\t%d\n", clock - pv->last_clock);
+    }
+    pv->last_clock = clock;
+
+    /* Writeback takes one cycle, retire what entered it last cycle */
+    if (pv->pending_wb)
+    {
+        finish(pv, pv->pending_wb, clock, FALSE);
+        pv->pending_wb = NULL;
+    }
+}
+
+void APEX_pipeview_stage(APEX_Pipeview *pv, int stage_id, const CPU_Stage *stage, int clock)
+{
+    PV_Insn *insn;
+
+    if (stage->seq <= 0)
+    {
+        return;
+    }
+    insn = find_insn(pv, stage->seq);
+
+    if (!insn)
+    {
+        insn = new_insn(pv, clock);
+        insn->id = pv->next_id++;
+        insn->seq = stage->seq;
+        insn->pc = stage->pc;
+        APEX_format_instruction(stage, insn->text, sizeof(insn->text));
+
+        if (pv->format == PIPEVIEW_KONATA)
+        {
+            fprintf(pv->fp, "I\t%lld\t%lld\t0\n", insn->id, insn->id);
+            fprintf(pv->fp, "L\t%lld\t0\t%d: %s\n", insn->id, insn->pc, insn->text);
+        }
+        enter_stage(pv, insn, stage_id, clock);
+    }
+    else if (insn->stage != stage_id)
+    {
+        leave_stage(pv, insn, clock);
+        enter_stage(pv, insn, stage_id, clock);
+    }
+
+    if (stage_id == STAGE_WRITEBACK)
+    {
+        pv->pending_wb = insn;
+    }
+}
+
+/* Called when a branch squashes the instruction held in a latch */
+void APEX_pipeview_flush(APEX_Pipeview *pv, const CPU_Stage *stage, int clock)
+{
+    PV_Insn *insn;
+
+    insn = find_insn(pv, stage->seq);
+    if (insn)
+    {
+        finish(pv, insn, clock, TRUE);
+    }
+}
+
+void APEX_pipeview_close(APEX_Pipeview *pv, int clock)
+{
+    int i;
+
+    /* Retires the HALT that was in writeback when the simulation stopped */
+    APEX_pipeview_cycle(pv, clock + 1);
+
+    for (i = 0; i < PIPEVIEW_MAX_INFLIGHT; ++i)
+    {
+        if (pv->insns[i].id >= 0)
+        {
+            finish(pv, &pv->insns[i], clock + 1, TRUE);
+        }
+    }
+
+    if (pv->format == PIPEVIEW_CHROME)
+    {
+        fprintf(pv->fp, "\n]}\n");
+    }
+
+    fclose(pv->fp);
+    free(pv->buffer);
+    free(pv);
+}
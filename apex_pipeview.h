@@ -0,0 +1,25 @@
+/*
+ * apex_pipeview.h
+ * Contains declarations for the pipeline timeline export
+ *
+ * The timeline records, for every dynamic instruction, the cycle it entered
+ * and left each pipeline stage. It is streamed to a file either in the Konata
+ * (Kanata 0004) log format or, when the file name ends in ".json", in the
+ * Chrome trace-event format understood by Perfetto and chrome://tracing.
+ */
+#ifndef _APEX_PIPEVIEW_H_
+#define _APEX_PIPEVIEW_H_
+
+#include "apex_cpu.h"
+
+#define PIPEVIEW_KONATA 0
+#define PIPEVIEW_CHROME 1
+
+typedef struct APEX_Pipeview APEX_Pipeview;
+
+APEX_Pipeview *APEX_pipeview_open(const char *filename, const APEX_CPU *cpu);
+void APEX_pipeview_cycle(APEX_Pipeview *pv, int clock);
+void APEX_pipeview_stage(APEX_Pipeview *pv, int stage_id, const CPU_Stage *stage, int clock);
+void APEX_pipeview_flush(APEX_Pipeview *pv, const CPU_Stage *stage, int clock);
+void APEX_pipeview_close(APEX_Pipeview *pv, int clock);
+#endif
@@ -0,0 +1,215 @@
+/*
+ * apex_prefetch.c
+ * Contains the stride prefetcher of the load/store FU
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+#include "apex_prefetch.h"
+
+/* Confidence a load needs before it prefetches, out of 3 */
+#define PREFETCH_CONFIDENT 1
+
+typedef struct PF_Entry
+{
+    int pc; /* -1 when unused */
+    int last_addr;
+    int stride;
+    int confidence;
+} PF_Entry;
+
+typedef struct PF_Line
+{
+    int addr; /* -1 when empty */
+    int ready;
+    int used;
+} PF_Line;
+
+struct APEX_Prefetch
+{
+    int degree;
+    int distance;
+    PF_Entry table[PREFETCH_TABLE_SIZE];
+    PF_Line buffer[PREFETCH_BUFFER_SIZE];
+    int next_line; /* FIFO replacement */
+
+    long long loads;
+    long long hits;
+    long long late;
+    long long issued;
+    long long used;
+    long long evicted_unused;
+    long long redundant;
+};
+
+static PF_Line *
+find_line(APEX_Prefetch *pf, int addr)
+{
+    int i;
+
+    for (i = 0; i < PREFETCH_BUFFER_SIZE; ++i)
+    {
+        if (pf->buffer[i].addr == addr)
+        {
+            return &pf->buffer[i];
+        }
+    }
+    return NULL;
+}
+
+static void
+issue(APEX_Prefetch *pf, int addr, int clock)
+{
+    PF_Line *line;
+
+    if (addr < 0 || addr >= DATA_MEMORY_SIZE)
+    {
+        return;
+    }
+    if (find_line(pf, addr))
+    {
+        pf->redundant++;
+        return;
+    }
+    line = &pf->buffer[pf->next_line];
+    pf->next_line = (pf->next_line + 1) % PREFETCH_BUFFER_SIZE;
+    if (line->addr >= 0 && !line->used)
+    {
+        pf->evicted_unused++;
+    }
+    line->addr = addr;
+    line->ready = clock + PREFETCH_FILL_CYCLES;
+    line->used = FALSE;
+    pf->issued++;
+}
+
+APEX_Prefetch *
+APEX_prefetch_create(int degree, int distance)
+{
+    APEX_Prefetch *pf;
+    int i;
+
+    pf = calloc(1, sizeof(APEX_Prefetch));
+    if (!pf)
+    {
+        return NULL;
+    }
+    pf->degree = degree;
+    pf->distance = distance;
+    for (i = 0; i < PREFETCH_TABLE_SIZE; ++i)
+    {
+        pf->table[i].pc = -1;
+    }
+    for (i = 0; i < PREFETCH_BUFFER_SIZE; ++i)
+    {
+        pf->buffer[i].addr = -1;
+    }
+    return pf;
+}
+
+/* Called when a load enters the load/store FU, returns TRUE when the
+ * buffer holds its word ready */
+int APEX_prefetch_lookup(APEX_Prefetch *pf, const CPU_Stage *stage, int clock)
+{
+    PF_Line *line;
+    int addr;
+
+    if (!APEX_is_load(stage->opcode))
+    {
+        return FALSE;
+    }
+    pf->loads++;
+    if (stage->opcode == OPCODE_LOAD)
+    {
+        addr = stage->rs1_value + stage->imm;
+    }
+    else
+    {
+        addr = stage->rs2_value + stage->rs1_value;
+    }
+    line = find_line(pf, addr);
+    if (!line)
+    {
+        return FALSE;
+    }
+    if (!line->used)
+    {
+        line->used = TRUE;
+        pf->used++;
+    }
+    if (line->ready > clock)
+    {
+        pf->late++;
+        return FALSE;
+    }
+    pf->hits++;
+    return TRUE;
+}
+
+/* Called when a load reads data memory */
+void APEX_prefetch_train(APEX_Prefetch *pf, const CPU_Stage *stage, int clock)
+{
+    PF_Entry *entry;
+    int addr = stage->memory_address;
+    int stride, i;
+
+    if (!APEX_is_load(stage->opcode))
+    {
+        return;
+    }
+    entry = &pf->table[(stage->pc / 4) & (PREFETCH_TABLE_SIZE - 1)];
+    if (entry->pc != stage->pc)
+    {
+        entry->pc = stage->pc;
+        entry->last_addr = addr;
+        entry->stride = 0;
+        entry->confidence = 0;
+        return;
+    }
+
+    stride = addr - entry->last_addr;
+    entry->last_addr = addr;
+    if (stride == entry->stride && stride != 0)
+    {
+        if (entry->confidence < 3)
+        {
+            entry->confidence++;
+        }
+    }
+    else if (entry->confidence > 0)
+    {
+        entry->confidence--;
+    }
+    else
+    {
+        entry->stride = stride;
+    }
+
+    if (entry->confidence >= PREFETCH_CONFIDENT)
+    {
+        for (i = 0; i < pf->degree; ++i)
+        {
+            issue(pf, addr + entry->stride * (pf->distance + i), clock);
+        }
+    }
+}
+
+void APEX_prefetch_report(const APEX_Prefetch *pf)
+{
+    FILE *fp = stderr;
+
+    fprintf(fp, "----------\n%s\n----------\n", "Prefetcher:");
+    fprintf(fp, "degree = %d, distance = %d, buffer = %d words\n", pf->degree, pf->distance, PREFETCH_BUFFER_SIZE);
+    fprintf(fp, "loads = %lld, served by the buffer = %lld (coverage %.1f%%), late = %lld\n", pf->loads, pf->hits,
+            pf->loads ? 100.0 * pf->hits / pf->loads : 0.0, pf->late);
+    fprintf(fp, "prefetches = %lld, used = %lld (accuracy %.1f%%), evicted unused = %lld, already buffered = %lld\n",
+            pf->issued, pf->used, pf->issued ? 100.0 * pf->used / pf->issued : 0.0, pf->evicted_unused,
+            pf->redundant);
+}
+
+void APEX_prefetch_destroy(APEX_Prefetch *pf)
+{
+    free(pf);
+}
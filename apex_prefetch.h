@@ -0,0 +1,41 @@
+/*
+ * apex_prefetch.h
+ * Contains declarations for the stride prefetcher of the load/store FU
+ *
+ * A table indexed by the pc of LOAD and LDR keeps the last address and
+ * stride of each one with a 2-bit confidence counter. Once a load repeated
+ * its stride, every execution of it prefetches degree words, the first one
+ * distance strides past its address, into a small FIFO prefetch buffer. A
+ * prefetch becomes ready PREFETCH_FILL_CYCLES after it was issued. A load
+ * whose word is ready in the buffer when it enters the load/store FU
+ * skips the address and tag cycles and reaches memory the next cycle.
+ *
+ * The buffer holds addresses only, values are always read from data
+ * memory, so stores never make it stale. Prefetches do not compete with
+ * the loads and stores for the FU.
+ *
+ * Accuracy is the share of prefetches a load used before they were
+ * evicted, coverage the share of loads served by the buffer, and a late
+ * prefetch one a load reached before it was ready.
+ */
+#ifndef _APEX_PREFETCH_H_
+#define _APEX_PREFETCH_H_
+
+#include "apex_cpu.h"
+
+#define PREFETCH_TABLE_SIZE 64   /* Entries, a power of two */
+#define PREFETCH_BUFFER_SIZE 16  /* Words */
+#define PREFETCH_FILL_CYCLES 4   /* Cycles a prefetch takes, the latency of a load */
+
+/* Defaults */
+#define PREFETCH_DEFAULT_DEGREE 2
+#define PREFETCH_DEFAULT_DISTANCE 1
+
+typedef struct APEX_Prefetch APEX_Prefetch;
+
+APEX_Prefetch *APEX_prefetch_create(int degree, int distance);
+int APEX_prefetch_lookup(APEX_Prefetch *pf, const CPU_Stage *stage, int clock);
+void APEX_prefetch_train(APEX_Prefetch *pf, const CPU_Stage *stage, int clock);
+void APEX_prefetch_report(const APEX_Prefetch *pf);
+void APEX_prefetch_destroy(APEX_Prefetch *pf);
+#endif
@@ -0,0 +1,89 @@
+/*
+ * apex_profile.c
+ * Contains host-side self-profiling of the simulator
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+#include "apex_profile.h"
+
+APEX_Profile *
+APEX_profile_create(const APEX_CPU *cpu, int period)
+{
+    APEX_Profile *profile;
+    int rounded = 1;
+
+    profile = calloc(1, sizeof(APEX_Profile));
+    if (!profile)
+    {
+        return NULL;
+    }
+
+    /* Round the sampling period up to a power of two */
+    if (period < 1)
+    {
+        period = PROFILE_DEFAULT_PERIOD;
+    }
+    while (rounded < period)
+    {
+        rounded <<= 1;
+    }
+    profile->period_mask = rounded - 1;
+    profile->start_clock = cpu->clock;
+    profile->start_insns = cpu->insn_completed;
+    profile->start_ns = APEX_profile_now();
+    return profile;
+}
+
+/* Prints the profile to stderr so the simulator output is left untouched */
+void APEX_profile_report(const APEX_Profile *profile, const APEX_CPU *cpu)
+{
+    uint64_t total_ns = APEX_profile_now() - profile->start_ns;
+    uint64_t stage_total = 0;
+    double seconds = total_ns / 1e9;
+    double scale;
+    int cycles = cpu->clock + 1 - profile->start_clock;
+    int insns = cpu->insn_completed - profile->start_insns;
+    int i;
+
+    if (seconds <= 0)
+    {
+        seconds = 1e-9;
+    }
+
+    fprintf(stderr, "APEX_Profile: host time = %.6f s, sampled 1 in %d cycles\n",
+            seconds, profile->period_mask + 1);
+    fprintf(stderr, "APEX_Profile: %.0f simulated cycles/s, %.0f instructions/s\n",
+            cycles / seconds, insns / seconds);
+
+    if (!profile->sampled_cycles)
+    {
+        return;
+    }
+
+    /* Scale sampled stage time up to the whole run */
+    scale = (double)cycles / profile->sampled_cycles;
+    fprintf(stderr, "APEX_Profile: %-15s %12s %8s\n", "stage", "ns/cycle", "share");
+    for (i = 0; i < NUM_STAGES; ++i)
+    {
+        stage_total += profile->stage_ns[i];
+    }
+    for (i = 0; i < NUM_STAGES; ++i)
+    {
+        fprintf(stderr, "APEX_Profile: %-15s %12.1f %7.1f%%\n", APEX_stage_name(i),
+                (double)profile->stage_ns[i] / profile->sampled_cycles,
+                100.0 * profile->stage_ns[i] * scale / total_ns);
+    }
+
+    /* Whatever is left is the run loop itself, mostly printing state */
+    fprintf(stderr, "APEX_Profile: %-15s %12.1f %7.1f%%\n", "Run loop/output",
+            (total_ns - stage_total * scale) / cycles,
+            100.0 * (total_ns - stage_total * scale) / total_ns);
+}
+
+void APEX_profile_destroy(APEX_Profile *profile)
+{
+    free(profile);
+}
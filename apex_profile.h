@@ -0,0 +1,43 @@
+/*
+ * apex_profile.h
+ * Contains declarations for host-side self-profiling of the simulator
+ *
+ * Host time is sampled around each stage function every
+ * profile period cycles and scaled up, so enabling it costs a few clock
+ * reads per sampled cycle. Building with ENABLE_HOST_PROFILE set to 0
+ * removes the profiling code from the simulation loop entirely.
+ */
+#ifndef _APEX_PROFILE_H_
+#define _APEX_PROFILE_H_
+
+#include <stdint.h>
+#include <time.h>
+
+#include "apex_cpu.h"
+
+/* Default number of cycles between two sampled cycles, a power of two */
+#define PROFILE_DEFAULT_PERIOD 16
+
+typedef struct APEX_Profile
+{
+    int period_mask;                  /* Cycles with (clock & mask) == 0 are sampled */
+    uint64_t start_ns;                /* Host time when the simulation started */
+    int start_clock;                  /* Clock when profiling started, the restored one after --restore */
+    int start_insns;                  /* Instructions retired before profiling started */
+    uint64_t stage_ns[NUM_STAGES];    /* Host time spent in each stage on sampled cycles */
+    uint64_t sampled_cycles;
+} APEX_Profile;
+
+static inline uint64_t
+APEX_profile_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+APEX_Profile *APEX_profile_create(const APEX_CPU *cpu, int period);
+void APEX_profile_report(const APEX_Profile *profile, const APEX_CPU *cpu);
+void APEX_profile_destroy(APEX_Profile *profile);
+#endif
@@ -0,0 +1,146 @@
+/*
+ * apex_sample.c
+ * Contains sampled simulation
+ *
+ * The pipeline keeps no state that outlives the instructions in flight:
+ * there are no caches or predictors to warm. Warming the scoreboard and
+ * the queue therefore means entering every window with the architectural
+ * state left by the functional model and letting a short detailed warm-up
+ * refill the latches, scoreboard and queue before measuring. Leaving a
+ * window, fetch is stopped and the pipeline drained so that cpu->pc is the
+ * next instruction the functional model must execute.
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+#include "apex_isa.h"
+#include "apex_profile.h"
+#include "apex_sample.h"
+
+/* Two-sided 95% Student t quantiles for 1 to 30 degrees of freedom */
+static const double t_quantiles[30] = {
+    12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+    2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+    2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+
+static double
+t_quantile(int dof)
+{
+    return dof <= 30 ? t_quantiles[dof - 1] : 1.960;
+}
+
+/* Empties the latches, scoreboard and queue before a detailed window */
+static void
+pipeline_reset(APEX_CPU *cpu)
+{
+    memset(&cpu->fetch, 0, sizeof(CPU_Stage));
+    memset(&cpu->decode, 0, sizeof(CPU_Stage));
+    memset(&cpu->integer, 0, sizeof(CPU_Stage));
+    memset(&cpu->multiplier, 0, sizeof(CPU_Stage));
+    memset(&cpu->load_store, 0, sizeof(CPU_Stage));
+    memset(&cpu->writeback, 0, sizeof(CPU_Stage));
+    memset(cpu->state_regs, 0, sizeof(int) * REG_FILE_SIZE);
+    cpu->Front = 0;
+    cpu->Rear = -1;
+    cpu->queue_count = 0;
+    cpu->fetch_from_next_cycle = FALSE;
+    cpu->fetch.has_insn = TRUE;
+}
+
+/* Runs cycles until insn_completed reaches target, returns TRUE on HALT */
+static int
+run_detailed(APEX_CPU *cpu, long long target)
+{
+    while (cpu->insn_completed < target)
+    {
+        if (APEX_cpu_cycle(cpu))
+        {
+            return TRUE;
+        }
+        cpu->clock++;
+    }
+    return FALSE;
+}
+
+void APEX_sample_run(APEX_CPU *cpu, int period, int warmup, int window)
+{
+    uint64_t start_ns = APEX_profile_now();
+    double sum = 0, sum_sq = 0;
+    double cpi, mean, stddev, half_width, seconds;
+    long long next = warmup, measure_start;
+    int start_clock, measure_clock, samples = 0, halted = FALSE;
+    int detailed_cycles = 0;
+
+    /* A window and its warm-up must fit in one period */
+    if (warmup + window > period)
+    {
+        warmup = period - window > 0 ? period - window : 0;
+        window = period - warmup;
+    }
+
+    while (!halted)
+    {
+        /* Fast forward to the warm-up of the next window */
+        while (cpu->insn_completed < next - warmup && !halted)
+        {
+            halted = APEX_isa_step(cpu);
+        }
+        if (halted)
+        {
+            break;
+        }
+
+        pipeline_reset(cpu);
+        start_clock = cpu->clock;
+        halted = run_detailed(cpu, next);
+        if (!halted)
+        {
+            measure_start = cpu->insn_completed;
+            measure_clock = cpu->clock;
+
+            halted = run_detailed(cpu, next + window);
+            if (!halted)
+            {
+                /* Only complete windows are kept */
+                cpi = (double)(cpu->clock - measure_clock) / (cpu->insn_completed - measure_start);
+                sum += cpi;
+                sum_sq += cpi * cpi;
+                samples++;
+                halted = APEX_cpu_drain(cpu);
+            }
+        }
+        detailed_cycles += cpu->clock - start_clock;
+        next += period;
+    }
+
+    seconds = (APEX_profile_now() - start_ns) / 1e9;
+    APEX_cpu_print_state(cpu);
+    printf("APEX_CPU: Sampled Simulation Complete, detailed cycles = %d instructions = %d\n",
+           detailed_cycles, cpu->insn_completed);
+
+    if (!samples)
+    {
+        fprintf(stderr, "APEX_Sample: No complete window, the program is shorter than one period\n");
+        return;
+    }
+    mean = sum / samples;
+    stddev = samples > 1 ? sqrt((sum_sq - samples * mean * mean) / (samples - 1)) : 0;
+    if (stddev != stddev)
+    {
+        stddev = 0;
+    }
+    half_width = samples > 1 ? t_quantile(samples - 1) * stddev / sqrt(samples) : 0;
+    fprintf(stderr, "APEX_Sample: %d windows of %d instructions every %d, %d warm-up instructions\n",
+            samples, window, period, warmup);
+    fprintf(stderr, "APEX_Sample: CPI = %.4f +/- %.4f (95%% confidence, +/- %.2f%%)\n", mean,
+            half_width, 100.0 * half_width / mean);
+    fprintf(stderr, "APEX_Sample: estimated cycles = %.0f +/- %.0f\n", mean * cpu->insn_completed,
+            half_width * cpu->insn_completed);
+    fprintf(stderr, "APEX_Sample: %.1f%% of instructions simulated in detail, host time = %.6f s\n",
+            100.0 * samples * (warmup + window) / (cpu->insn_completed ? cpu->insn_completed : 1),
+            seconds);
+}
@@ -0,0 +1,22 @@
+/*
+ * apex_sample.h
+ * Contains declarations for sampled simulation
+ *
+ * The program runs on the functional model and every sampling period a
+ * number of instructions is run on the pipeline: first a detailed warm-up,
+ * then a measured window, then the pipeline is drained and the functional
+ * model takes over again. The CPI of the measured windows gives an
+ * estimate of the CPI of the whole program with a 95% confidence interval.
+ */
+#ifndef _APEX_SAMPLE_H_
+#define _APEX_SAMPLE_H_
+
+#include "apex_cpu.h"
+
+/* Defaults, in retired instructions */
+#define SAMPLE_DEFAULT_PERIOD 10000
+#define SAMPLE_DEFAULT_WARMUP 100
+#define SAMPLE_DEFAULT_WINDOW 1000
+
+void APEX_sample_run(APEX_CPU *cpu, int period, int warmup, int window);
+#endif
@@ -0,0 +1,207 @@
+/*
+ * apex_top.c
+ * Viewer for the live statistics of a running simulator started with --live
+ *
+ * Maps the shared memory object read only and redraws the counts every
+ * interval, with rates and percentages over the whole run and over the last
+ * interval. The simulator is never slowed down by it: reading is a copy
+ * retried while a refresh is in progress.
+ */
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "apex_macros.h"
+#include "apex_live.h"
+
+/* Where the POSIX shared memory objects appear */
+#define TOP_SHM_DIR "/dev/shm"
+#define TOP_DEFAULT_INTERVAL 1000 /* ms */
+
+static const char *state_names[] = {"running", "halted", "stopped"};
+
+/* Finds the object of a running simulator, the newest if there are several */
+static int
+find_object(char *name, size_t size)
+{
+    struct dirent *entry;
+    int found = FALSE;
+    long pid, best = -1;
+    DIR *dir;
+
+    dir = opendir(TOP_SHM_DIR);
+    if (!dir)
+    {
+        return FALSE;
+    }
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if (strncmp(entry->d_name, LIVE_NAME_PREFIX + 1, strlen(LIVE_NAME_PREFIX) - 1) != 0)
+        {
+            continue;
+        }
+        /* Skips a name that would not fit with its leading '/' */
+        if (strlen(entry->d_name) + 2 > size)
+        {
+            continue;
+        }
+        pid = atol(entry->d_name + strlen(LIVE_NAME_PREFIX) - 1);
+        if (!found || pid > best)
+        {
+            snprintf(name, size, "/%s", entry->d_name);
+            best = pid;
+            found = TRUE;
+        }
+    }
+    closedir(dir);
+    return found;
+}
+
+static double
+percent(uint64_t part, uint64_t whole)
+{
+    return whole ? 100.0 * part / whole : 0.0;
+}
+
+static void
+print_values(const APEX_LiveRegion *region, const char *name, const uint64_t *now, const uint64_t *last)
+{
+    uint64_t cycles = now[LIVE_CLOCK];
+    uint64_t recent = now[LIVE_CLOCK] - last[LIVE_CLOCK];
+    uint64_t ns = now[LIVE_HOST_NS] - last[LIVE_HOST_NS];
+    uint64_t d[LIVE_NUM_VALUES];
+    int i;
+
+    for (i = 0; i < LIVE_NUM_VALUES; ++i)
+    {
+        d[i] = now[i] - last[i];
+    }
+    printf("%s  %s  pid %d  %s\n", name, region->program, region->pid,
+           state_names[now[LIVE_STATE] <= LIVE_STOPPED ? now[LIVE_STATE] : LIVE_STOPPED]);
+    printf("Cycles    %14llu   Retired %14llu   Fetched %14llu   PC %llu\n", (unsigned long long)cycles,
+           (unsigned long long)now[LIVE_RETIRED], (unsigned long long)now[LIVE_FETCHED],
+           (unsigned long long)now[LIVE_PC]);
+    printf("IPC       %14.3f   recent  %14.3f   Cycles/s %13.0f\n",
+           cycles ? (double)now[LIVE_RETIRED] / cycles : 0.0, recent ? (double)d[LIVE_RETIRED] / recent : 0.0,
+           ns ? recent * 1e9 / ns : 0.0);
+    printf("\n%-14s %9s %9s\n", "Decode", "run", "recent");
+    printf("%-14s %8.1f%% %8.1f%%\n", "issued", percent(now[LIVE_ISSUED], cycles), percent(d[LIVE_ISSUED], recent));
+    printf("%-14s %8.1f%% %8.1f%%\n", "stall data", percent(now[LIVE_STALL_DATA], cycles),
+           percent(d[LIVE_STALL_DATA], recent));
+    printf("%-14s %8.1f%% %8.1f%%\n", "stall branch", percent(now[LIVE_STALL_BRANCH], cycles),
+           percent(d[LIVE_STALL_BRANCH], recent));
+    printf("%-14s %8.1f%% %8.1f%%\n", "stall FU", percent(now[LIVE_STALL_FU], cycles),
+           percent(d[LIVE_STALL_FU], recent));
+    printf("%-14s %8.1f%% %8.1f%%\n", "empty", percent(now[LIVE_EMPTY], cycles), percent(d[LIVE_EMPTY], recent));
+    printf("\n%-14s %9s %9s\n", "FU busy", "run", "recent");
+    printf("%-14s %8.1f%% %8.1f%%\n", "integer", percent(now[LIVE_INT_BUSY], cycles),
+           percent(d[LIVE_INT_BUSY], recent));
+    printf("%-14s %8.1f%% %8.1f%%\n", "multiplier", percent(now[LIVE_MUL_BUSY], cycles),
+           percent(d[LIVE_MUL_BUSY], recent));
+    printf("%-14s %8.1f%% %8.1f%%\n", "load/store", percent(now[LIVE_LS_BUSY], cycles),
+           percent(d[LIVE_LS_BUSY], recent));
+    fflush(stdout);
+}
+
+int main(int argc, char const *argv[])
+{
+    const APEX_LiveRegion *region;
+    uint64_t now[LIVE_NUM_VALUES], last[LIVE_NUM_VALUES];
+    struct timespec pause;
+    char name[NAME_MAX + 2]; /* '/' and a directory entry */
+    const char *object = NULL;
+    int interval = TOP_DEFAULT_INTERVAL;
+    int once = FALSE;
+    int tty = isatty(fileno(stdout));
+    int i;
+
+    for (i = 1; i < argc; ++i)
+    {
+        if (strncmp(argv[i], "--interval=", 11) == 0)
+        {
+            interval = atoi(argv[i] + 11);
+            if (interval < 1)
+            {
+                fprintf(stderr, "APEX_Error: --interval=<ms> takes a positive interval\n");
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "--once") == 0)
+        {
+            once = TRUE;
+        }
+        else if (strncmp(argv[i], "--", 2) == 0)
+        {
+            fprintf(stderr, "APEX_Error: Unknown option %s\n", argv[i]);
+            exit(1);
+        }
+        else
+        {
+            object = argv[i];
+        }
+    }
+
+    if (!object)
+    {
+        if (!find_object(name, sizeof(name)))
+        {
+            fprintf(stderr, "APEX_Error: No simulator running with --live\n");
+            fprintf(stderr, "Usage: %s [<name>] [--interval=<ms>] [--once]\n", argv[0]);
+            exit(1);
+        }
+        object = name;
+    }
+    region = APEX_live_attach(object);
+    if (!region)
+    {
+        fprintf(stderr, "APEX_Error: Unable to attach to %s\n", object);
+        exit(1);
+    }
+
+    pause.tv_sec = interval / 1000;
+    pause.tv_nsec = (interval % 1000) * 1000000L;
+    if (!APEX_live_read(region, now))
+    {
+        fprintf(stderr, "APEX_Error: The simulator of %s died while publishing\n", object);
+        exit(1);
+    }
+    memcpy(last, now, sizeof(last));
+    while (TRUE)
+    {
+        if (tty && !once)
+        {
+            /* Cursor home and clear the screen */
+            printf("\033[H\033[2J");
+        }
+        print_values(region, object, now, last);
+        if (once || now[LIVE_STATE] != LIVE_RUNNING)
+        {
+            break;
+        }
+        /* A simulator that was killed never publishes its final state */
+        if (kill(region->pid, 0) && errno == ESRCH)
+        {
+            printf("\nThe simulator is gone\n");
+            break;
+        }
+        nanosleep(&pause, NULL);
+        memcpy(last, now, sizeof(last));
+        if (!APEX_live_read(region, now))
+        {
+            printf("\nThe simulator is gone\n");
+            break;
+        }
+        if (!tty)
+        {
+            printf("\n");
+        }
+    }
+    APEX_live_detach(region);
+    return 0;
+}
@@ -0,0 +1,219 @@
+/*
+ * apex_trace.c
+ * Contains the binary per-cycle trace writer
+ *
+ * Records are collected in a block buffer. When the block is full it is
+ * written with a single fwrite, or, in threaded mode, handed to a writer
+ * thread while the simulator keeps filling a second block.
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+#include "apex_trace.h"
+
+struct APEX_Trace
+{
+    FILE *fp;
+    int last_clock;
+    APEX_TraceRecord *buffer; /* Block being filled by the simulator */
+    int count;
+
+    /* Background writer, only used in threaded mode */
+    int threaded;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    APEX_TraceRecord *spare;   /* Block free to be filled next */
+    APEX_TraceRecord *pending; /* Block waiting to be written */
+    int pending_count;
+    int done;
+};
+
+static void *
+trace_writer_thread(void *arg)
+{
+    APEX_Trace *trace = arg;
+    APEX_TraceRecord *block;
+    int count;
+
+    pthread_mutex_lock(&trace->lock);
+    while (TRUE)
+    {
+        while (!trace->pending && !trace->done)
+        {
+            pthread_cond_wait(&trace->cond, &trace->lock);
+        }
+        if (!trace->pending)
+        {
+            break;
+        }
+        block = trace->pending;
+        count = trace->pending_count;
+        pthread_mutex_unlock(&trace->lock);
+
+        fwrite(block, sizeof(APEX_TraceRecord), count, trace->fp);
+
+        pthread_mutex_lock(&trace->lock);
+        trace->pending = NULL;
+        trace->spare = block;
+        pthread_cond_broadcast(&trace->cond);
+    }
+    pthread_mutex_unlock(&trace->lock);
+    return NULL;
+}
+
+/* Writes out the block being filled */
+static void
+trace_flush(APEX_Trace *trace)
+{
+    if (!trace->count)
+    {
+        return;
+    }
+
+    if (!trace->threaded)
+    {
+        fwrite(trace->buffer, sizeof(APEX_TraceRecord), trace->count, trace->fp);
+        trace->count = 0;
+        return;
+    }
+
+    pthread_mutex_lock(&trace->lock);
+    while (trace->pending)
+    {
+        pthread_cond_wait(&trace->cond, &trace->lock);
+    }
+    trace->pending = trace->buffer;
+    trace->pending_count = trace->count;
+    trace->buffer = trace->spare;
+    trace->spare = NULL;
+    pthread_cond_broadcast(&trace->cond);
+    pthread_mutex_unlock(&trace->lock);
+    trace->count = 0;
+}
+
+APEX_Trace *
+APEX_trace_open(const char *filename, const APEX_CPU *cpu, int threaded)
+{
+    APEX_Trace *trace;
+    APEX_TraceHeader header;
+    APEX_TraceState state;
+    APEX_TraceMemWord word;
+    int i;
+
+    trace = calloc(1, sizeof(APEX_Trace));
+    if (!trace)
+    {
+        return NULL;
+    }
+
+    trace->buffer = malloc(sizeof(APEX_TraceRecord) * TRACE_BUFFER_RECORDS);
+    if (threaded)
+    {
+        trace->spare = malloc(sizeof(APEX_TraceRecord) * TRACE_BUFFER_RECORDS);
+    }
+    trace->fp = fopen(filename, "wb");
+    if (!trace->buffer || (threaded && !trace->spare) || !trace->fp)
+    {
+        if (trace->fp)
+        {
+            fclose(trace->fp);
+        }
+        free(trace->buffer);
+        free(trace->spare);
+        free(trace);
+        return NULL;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.version = TRACE_VERSION;
+    header.record_size = sizeof(APEX_TraceRecord);
+    header.code_memory_size = cpu->code_memory_size;
+    header.start_clock = cpu->clock;
+    fwrite(&header, sizeof(header), 1, trace->fp);
+
+    memset(&state, 0, sizeof(state));
+    for (i = 0; i < REG_FILE_SIZE; ++i)
+    {
+        state.regs[i] = cpu->regs[i];
+    }
+    state.zero_flag = cpu->zero_flag;
+    state.insn_completed = cpu->insn_completed;
+    for (i = 0; i < DATA_MEMORY_SIZE; ++i)
+    {
+        state.memory_words += (cpu->data_memory[i] != 0);
+    }
+    fwrite(&state, sizeof(state), 1, trace->fp);
+    for (i = 0; i < DATA_MEMORY_SIZE; ++i)
+    {
+        if (cpu->data_memory[i] != 0)
+        {
+            word.address = i;
+            word.value = cpu->data_memory[i];
+            fwrite(&word, sizeof(word), 1, trace->fp);
+        }
+    }
+    trace->last_clock = cpu->clock;
+
+    if (threaded)
+    {
+        pthread_mutex_init(&trace->lock, NULL);
+        pthread_cond_init(&trace->cond, NULL);
+        if (pthread_create(&trace->thread, NULL, trace_writer_thread, trace) == 0)
+        {
+            trace->threaded = TRUE;
+        }
+    }
+    return trace;
+}
+
+void APEX_trace_record(APEX_Trace *trace, int clock, int type, int arg, int a, int b)
+{
+    APEX_TraceRecord *rec;
+    int delta = clock - trace->last_clock;
+
+    if (delta > 0xFFFF)
+    {
+        APEX_trace_record(trace, trace->last_clock, TRACE_CYCLE, 0, delta, 0);
+        delta = 0;
+    }
+    trace->last_clock = clock;
+
+    rec = &trace->buffer[trace->count];
+    rec->type = type;
+    rec->arg = arg;
+    rec->delta = delta;
+    rec->a = a;
+    rec->b = b;
+
+    if (++trace->count == TRACE_BUFFER_RECORDS)
+    {
+        trace_flush(trace);
+    }
+}
+
+void APEX_trace_close(APEX_Trace *trace)
+{
+    trace_flush(trace);
+
+    if (trace->threaded)
+    {
+        pthread_mutex_lock(&trace->lock);
+        trace->done = TRUE;
+        pthread_cond_broadcast(&trace->cond);
+        pthread_mutex_unlock(&trace->lock);
+        pthread_join(trace->thread, NULL);
+        pthread_mutex_destroy(&trace->lock);
+        pthread_cond_destroy(&trace->cond);
+    }
+
+    fclose(trace->fp);
+    free(trace->buffer);
+    free(trace->spare);
+    free(trace);
+}
@@ -0,0 +1,72 @@
+/*
+ * apex_trace.h
+ * Contains declarations for the binary per-cycle trace
+ *
+ * A trace file is an APEX_TraceHeader, the APEX_TraceState the run started
+ * from and its memory_words non-zero APEX_TraceMemWord entries, followed by
+ * fixed-size APEX_TraceRecord entries in the order the events happened. Each record
+ * carries the number of cycles since the previous record; gaps that do not
+ * fit in 16 bits are written as a separate TRACE_CYCLE record. Values are
+ * stored in host byte order.
+ */
+#ifndef _APEX_TRACE_H_
+#define _APEX_TRACE_H_
+
+#include <stdint.h>
+
+#include "apex_cpu.h"
+
+/* The digit of the magic follows TRACE_VERSION */
+#define TRACE_MAGIC "APEXTRC2"
+#define TRACE_VERSION 2
+
+/* Record types */
+#define TRACE_STAGE 1     /* arg: stage id, a: pc, b: instruction number */
+#define TRACE_REG_WRITE 2 /* arg: register, a: pc, b: value */
+#define TRACE_MEM_WRITE 3 /* a: address, b: value */
+#define TRACE_BRANCH 4    /* arg: taken, a: pc, b: target pc */
+#define TRACE_CYCLE 5     /* a: cycles to add to the running clock */
+
+/* Records are buffered and written in blocks of this many */
+#define TRACE_BUFFER_RECORDS 65536
+
+typedef struct APEX_TraceHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    int32_t code_memory_size;
+    int32_t start_clock;
+} APEX_TraceHeader;
+
+/* Architectural state at start_clock, which is not the reset state after
+ * --restore. The zero flag is kept for tools, apex_tracedump does not show it */
+typedef struct APEX_TraceState
+{
+    int32_t regs[REG_FILE_SIZE];
+    int32_t zero_flag;
+    int32_t insn_completed;
+    int32_t memory_words; /* Number of APEX_TraceMemWord entries that follow */
+} APEX_TraceState;
+
+typedef struct APEX_TraceMemWord
+{
+    int32_t address;
+    int32_t value;
+} APEX_TraceMemWord;
+
+typedef struct APEX_TraceRecord
+{
+    uint8_t type;
+    uint8_t arg;
+    uint16_t delta; /* Cycles since the previous record */
+    int32_t a;
+    int32_t b;
+} APEX_TraceRecord;
+
+typedef struct APEX_Trace APEX_Trace;
+
+APEX_Trace *APEX_trace_open(const char *filename, const APEX_CPU *cpu, int threaded);
+void APEX_trace_record(APEX_Trace *trace, int clock, int type, int arg, int a, int b);
+void APEX_trace_close(APEX_Trace *trace);
+#endif
@@ -0,0 +1,429 @@
+/*
+ * apex_tracedump.c
+ * Offline decoder for the binary traces written with --trace
+ *
+ * Lists the trace records, optionally filtered by cycle range, PC or
+ * register, or replays them to regenerate the output of the display command.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+#include "apex_trace.h"
+
+typedef struct Dump_Options
+{
+    int from;
+    int to;
+    int pc;  /* -1 for any */
+    int reg; /* -1 for any */
+    int display;
+} Dump_Options;
+
+/* Architectural state rebuilt from the initial state and the register and
+ * memory write records */
+static int regs[REG_FILE_SIZE];
+static int data_memory[DATA_MEMORY_SIZE];
+
+static APEX_Instruction *code_memory;
+static int code_memory_size;
+
+static void
+usage(const char *prog)
+{
+    fprintf(stderr,
+            "APEX_Help: Usage %s <trace_file> [--asm=<input_file>] [--from=<cycle>] [--to=<cycle>]\n"
+            "                 [--pc=<pc>] [--reg=<n>] [--display]\n"
+            "  --asm      program the trace was recorded from, needed for instruction text,\n"
+            "             --reg on stage records and --display\n"
+            "  --display  regenerate the output of the display command\n",
+            prog);
+    exit(1);
+}
+
+/* Rebuilds the stage latch an instruction number was fetched into */
+static int
+stage_from_record(const APEX_TraceRecord *rec, CPU_Stage *stage)
+{
+    if (!code_memory || rec->b < 1 || rec->b > code_memory_size)
+    {
+        memset(stage, 0, sizeof(CPU_Stage));
+        stage->pc = rec->a;
+        stage->number = rec->b;
+        return FALSE;
+    }
+
+    APEX_stage_from_instruction(stage, &code_memory[rec->b - 1], rec->a);
+    return TRUE;
+}
+
+static int
+stage_uses_register(const CPU_Stage *stage, int reg)
+{
+    return stage->rd == reg || stage->rs1 == reg || stage->rs2 == reg || stage->rs3 == reg;
+}
+
+static int
+record_matches(const APEX_TraceRecord *rec, int clock, const Dump_Options *opt)
+{
+    CPU_Stage stage;
+
+    if (clock < opt->from || clock > opt->to)
+    {
+        return FALSE;
+    }
+
+    switch (rec->type)
+    {
+    case TRACE_STAGE:
+    {
+        if (opt->pc >= 0 && rec->a != opt->pc)
+        {
+            return FALSE;
+        }
+        if (opt->reg >= 0)
+        {
+            return stage_from_record(rec, &stage) && stage_uses_register(&stage, opt->reg);
+        }
+        return TRUE;
+    }
+    case TRACE_REG_WRITE:
+    {
+        return (opt->pc < 0 || rec->a == opt->pc) && (opt->reg < 0 || rec->arg == opt->reg);
+    }
+    case TRACE_MEM_WRITE:
+    {
+        return opt->pc < 0 && opt->reg < 0;
+    }
+    case TRACE_BRANCH:
+    {
+        return (opt->pc < 0 || rec->a == opt->pc) && opt->reg < 0;
+    }
+    }
+    return FALSE;
+}
+
+static void
+print_record(const APEX_TraceRecord *rec, int clock)
+{
+    CPU_Stage stage;
+    char text[256];
+
+    switch (rec->type)
+    {
+    case TRACE_STAGE:
+    {
+        if (stage_from_record(rec, &stage))
+        {
+            APEX_format_instruction(&stage, text, sizeof(text));
+        }
+        else
+        {
+            snprintf(text, sizeof(text), "I%d", rec->b);
+        }
+        printf("%10d  STAGE   %-15s pc(%d) %s\n", clock,
+               APEX_stage_name(rec->arg), rec->a, text);
+        break;
+    }
+    case TRACE_REG_WRITE:
+    {
+        printf("%10d  REG     R%d = %d  pc(%d)\n", clock, rec->arg, rec->b, rec->a);
+        break;
+    }
+    case TRACE_MEM_WRITE:
+    {
+        printf("%10d  MEM     MEM[%d] = %d\n", clock, rec->a, rec->b);
+        break;
+    }
+    case TRACE_BRANCH:
+    {
+        printf("%10d  BRANCH  pc(%d) -> %d %s\n", clock, rec->a, rec->b,
+               rec->arg ? "taken" : "not taken");
+        break;
+    }
+    }
+}
+
+/* Same format as print_reg_file() in apex_cpu.c */
+static void
+print_reg_file(void)
+{
+    int i;
+
+    printf("----------\n%s\n----------\n", "Registers:");
+    for (i = 0; i < REG_FILE_SIZE / 2; ++i)
+    {
+        printf("R%-3d[%-3d] ", i, regs[i]);
+    }
+    printf("\n");
+    for (i = (REG_FILE_SIZE / 2); i < REG_FILE_SIZE; ++i)
+    {
+        printf("R%-3d[%-3d] ", i, regs[i]);
+    }
+    printf("\n");
+}
+
+/* Same format as print_memory_file() in apex_cpu.c */
+static void
+print_memory_file(void)
+{
+    int i;
+
+    printf("----------\n%s\n----------\n", "Data Memory:");
+    for (i = 0; i < DATA_MEMORY_SIZE; ++i)
+    {
+        if (data_memory[i] != 0)
+        {
+            printf("MEM[%-2d]=%-2d ", i, data_memory[i]);
+        }
+    }
+    printf("\n");
+}
+
+static void
+display_begin_cycle(int clock, const Dump_Options *opt)
+{
+    if (clock >= opt->from && clock <= opt->to)
+    {
+        printf("--------------------------------------------\n");
+        printf("Clock Cycle #: %d\n", clock);
+        printf("--------------------------------------------\n");
+    }
+}
+
+static void
+display_end_cycle(int clock, const Dump_Options *opt)
+{
+    if (clock >= opt->from && clock <= opt->to)
+    {
+        print_reg_file();
+        print_memory_file();
+    }
+}
+
+/* Applies a record to the rebuilt state and prints it the way display does.
+ * Returns TRUE once HALT has retired */
+static int
+display_record(const APEX_TraceRecord *rec, int clock, const Dump_Options *opt, int *retired)
+{
+    CPU_Stage stage;
+    char text[256];
+    int known;
+
+    switch (rec->type)
+    {
+    case TRACE_STAGE:
+    {
+        /* A record the --asm program has no instruction for is shown by
+         * number and never taken for HALT */
+        known = stage_from_record(rec, &stage);
+        if (clock >= opt->from && clock <= opt->to)
+        {
+            if (known)
+            {
+                APEX_format_instruction(&stage, text, sizeof(text));
+            }
+            else
+            {
+                snprintf(text, sizeof(text), "I%d", rec->b);
+            }
+            printf("%-15s: pc(%d) %s\n", APEX_stage_name(rec->arg), stage.pc, text);
+        }
+        if (rec->arg == STAGE_WRITEBACK)
+        {
+            (*retired)++;
+            return known && stage.opcode == OPCODE_HALT;
+        }
+        break;
+    }
+    case TRACE_REG_WRITE:
+    {
+        if (rec->arg < REG_FILE_SIZE)
+        {
+            regs[rec->arg] = rec->b;
+        }
+        break;
+    }
+    case TRACE_MEM_WRITE:
+    {
+        if (rec->a >= 0 && rec->a < DATA_MEMORY_SIZE)
+        {
+            data_memory[rec->a] = rec->b;
+        }
+        break;
+    }
+    }
+    return FALSE;
+}
+
+int main(int argc, char const *argv[])
+{
+    FILE *fp;
+    APEX_TraceHeader header;
+    APEX_TraceState state;
+    APEX_TraceMemWord word;
+    APEX_TraceRecord rec;
+    Dump_Options opt;
+    const char *trace_file = NULL;
+    const char *asm_file = NULL;
+    int clock, next_clock;
+    int retired = 0;
+    int halted = FALSE;
+    int i;
+
+    opt.from = 0;
+    opt.to = 0x7FFFFFFF;
+    opt.pc = -1;
+    opt.reg = -1;
+    opt.display = FALSE;
+
+    for (i = 1; i < argc; ++i)
+    {
+        if (strncmp(argv[i], "--asm=", 6) == 0)
+        {
+            asm_file = argv[i] + 6;
+        }
+        else if (strncmp(argv[i], "--from=", 7) == 0)
+        {
+            opt.from = atoi(argv[i] + 7);
+        }
+        else if (strncmp(argv[i], "--to=", 5) == 0)
+        {
+            opt.to = atoi(argv[i] + 5);
+        }
+        else if (strncmp(argv[i], "--pc=", 5) == 0)
+        {
+            opt.pc = atoi(argv[i] + 5);
+        }
+        else if (strncmp(argv[i], "--reg=", 6) == 0)
+        {
+            opt.reg = atoi(argv[i] + 6 + (argv[i][6] == 'R' || argv[i][6] == 'r'));
+        }
+        else if (strcmp(argv[i], "--display") == 0)
+        {
+            opt.display = TRUE;
+        }
+        else if (argv[i][0] != '-' && !trace_file)
+        {
+            trace_file = argv[i];
+        }
+        else
+        {
+            usage(argv[0]);
+        }
+    }
+
+    if (!trace_file || (opt.display && !asm_file))
+    {
+        usage(argv[0]);
+    }
+
+    if (asm_file)
+    {
+        code_memory = create_code_memory(asm_file, &code_memory_size);
+        if (!code_memory)
+        {
+            fprintf(stderr, "APEX_Error: Unable to read program %s\n", asm_file);
+            exit(1);
+        }
+    }
+
+    fp = fopen(trace_file, "rb");
+    if (!fp)
+    {
+        fprintf(stderr, "APEX_Error: Unable to open trace file %s\n", trace_file);
+        exit(1);
+    }
+    if (fread(&header, sizeof(header), 1, fp) != 1 ||
+        memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != TRACE_VERSION || header.record_size != sizeof(APEX_TraceRecord))
+    {
+        fprintf(stderr, "APEX_Error: %s is not an APEX trace file\n", trace_file);
+        exit(1);
+    }
+    if (fread(&state, sizeof(state), 1, fp) != 1 || state.memory_words < 0)
+    {
+        fprintf(stderr, "APEX_Error: %s is truncated\n", trace_file);
+        exit(1);
+    }
+    for (i = 0; i < REG_FILE_SIZE; ++i)
+    {
+        regs[i] = state.regs[i];
+    }
+    retired = state.insn_completed;
+    for (i = 0; i < state.memory_words; ++i)
+    {
+        if (fread(&word, sizeof(word), 1, fp) != 1)
+        {
+            fprintf(stderr, "APEX_Error: %s is truncated\n", trace_file);
+            exit(1);
+        }
+        if (word.address >= 0 && word.address < DATA_MEMORY_SIZE)
+        {
+            data_memory[word.address] = word.value;
+        }
+    }
+    if (code_memory && header.code_memory_size != code_memory_size)
+    {
+        fprintf(stderr, "APEX_Error: trace was recorded from a program with %d instructions\n",
+                header.code_memory_size);
+        exit(1);
+    }
+
+    clock = header.start_clock;
+    if (opt.display)
+    {
+        display_begin_cycle(clock, &opt);
+    }
+
+    while (!halted && fread(&rec, sizeof(rec), 1, fp) == 1)
+    {
+        next_clock = clock + rec.delta;
+        if (rec.type == TRACE_CYCLE)
+        {
+            next_clock += rec.a;
+        }
+
+        if (!opt.display)
+        {
+            clock = next_clock;
+            if (record_matches(&rec, clock, &opt))
+            {
+                print_record(&rec, clock);
+            }
+            if (clock > opt.to)
+            {
+                break;
+            }
+            continue;
+        }
+
+        while (clock < next_clock)
+        {
+            display_end_cycle(clock, &opt);
+            clock++;
+            display_begin_cycle(clock, &opt);
+        }
+        halted = display_record(&rec, clock, &opt, &retired);
+    }
+
+    if (opt.display)
+    {
+        if (halted)
+        {
+            print_reg_file();
+            print_memory_file();
+            printf("APEX_CPU: Simulation Complete, cycles = %d instructions = %d\n", clock, retired);
+        }
+        else
+        {
+            display_end_cycle(clock, &opt);
+        }
+    }
+
+    fclose(fp);
+    free(code_memory);
+    return 0;
+}
@@ -0,0 +1,32 @@
+MOVC R15,#300
+MOVC R2,#32
+MOVC R12,#-2147483648
+MOVC R13,#1023
+MOVC R1,#0
+MOVC R3,#17
+STORE R3,R1,#0
+MOVC R4,#37
+MUL R3,R3,R4
+ADDL R3,R3,#11
+AND R3,R3,R13
+ADDL R1,R1,#1
+CMP R1,R2
+BNZ #-28
+SUBL R6,R2,#1
+MOVC R1,#0
+LDR R7,R0,R1
+ADDL R8,R1,#1
+LDR R9,R0,R8
+SUB R10,R9,R7
+AND R10,R10,R12
+BZ #12
+STR R9,R0,R1
+STR R7,R0,R8
+ADDL R1,R1,#1
+CMP R1,R6
+BNZ #-40
+SUBL R6,R6,#1
+BNZ #-52
+SUBL R15,R15,#1
+BNZ #-104
+HALT
@@ -0,0 +1,25 @@
+MOVC R1,#0
+MOVC R2,#256
+MOVC R3,#3
+ADDL R4,R1,#1
+STORE R4,R1,#0
+STORE R3,R1,#512
+ADDL R3,R3,#2
+ADDL R1,R1,#1
+CMP R1,R2
+BNZ #-24
+MOVC R15,#400
+MOVC R1,#0
+MOVC R6,#0
+LOAD R7,R1,#0
+LOAD R8,R1,#512
+MUL R9,R7,R8
+ADD R6,R6,R9
+ADDL R1,R1,#1
+CMP R1,R2
+BNZ #-24
+SUBL R15,R15,#1
+BNZ #-40
+MOVC R10,#1024
+STORE R6,R10,#0
+HALT
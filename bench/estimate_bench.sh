@@ -0,0 +1,98 @@
+#!/bin/sh
+#
+# estimate_bench.sh
+# Compares the analytical estimate of every benchmark kernel against the
+# cycle-by-cycle simulation
+#
+# The estimate with functional counts is expected to match the simulation,
+# the gate is on its error. The static estimate guesses how often each
+# loop runs, so its cycle count can be far off: its error is reported for
+# the cycles and for the CPI, which only depends on the block costs and
+# the mix of blocks, and never fails the run.
+#
+# Usage: bench/estimate_bench.sh
+#
+#   ESTIMATE_THRESHOLD=<p> Allowed error of the functional estimate in percent (default 1)
+#
+
+BENCH_DIR=$(dirname "$0")
+SIM=${SIM:-./apex_sim}
+THRESHOLD=${ESTIMATE_THRESHOLD:-1}
+TMP=${TMPDIR:-/tmp}/apex_estimate.$$
+
+status=0
+kernels=0
+sum_functional=0
+sum_static=0
+sum_static_cpi=0
+
+trap 'rm -f "$TMP".out' EXIT
+
+# Signed error of an estimate in percent of the simulated value
+error()
+{
+    awk -v e="$1" -v s="$2" 'BEGIN { printf "%+.2f", s ? 100.0 * (e - s) / s : 0 }'
+}
+
+# Adds the absolute value of an error to a running sum
+add_abs()
+{
+    awk -v s="$1" -v e="$2" 'BEGIN { printf "%.6f", s + (e < 0 ? -e : e) }'
+}
+
+printf '%-14s %10s %6s | %10s %8s | %10s %8s %6s %8s\n' kernel simulated cpi functional error static error cpi error
+
+for asm in "$BENCH_DIR"/*.asm
+do
+    name=$(basename "$asm" .asm)
+
+    if ! "$SIM" "$asm" simulate > "$TMP".out 2>&1
+    then
+        echo "$name: simulator failed"
+        status=1
+        continue
+    fi
+    cycles=$(sed -n 's/.*Simulation Complete, cycles = \([0-9]*\) instructions = .*/\1/p' "$TMP".out)
+    insns=$(sed -n 's/.*Simulation Complete, cycles = [0-9]* instructions = \([0-9]*\).*/\1/p' "$TMP".out)
+    cpi=$(awk -v c="$cycles" -v i="$insns" 'BEGIN { printf "%.3f", i ? c / i : 0 }')
+
+    if ! "$SIM" "$asm" estimate > "$TMP".out 2>&1
+    then
+        echo "$name: estimate failed"
+        status=1
+        continue
+    fi
+    functional=$(sed -n 's/^APEX_Estimate: \([0-9]*\) cycles.*/\1/p' "$TMP".out)
+
+    if ! "$SIM" "$asm" estimate --estimate-static > "$TMP".out 2>&1
+    then
+        echo "$name: static estimate failed"
+        status=1
+        continue
+    fi
+    static=$(sed -n 's/^APEX_Estimate: \([0-9]*\) cycles.*/\1/p' "$TMP".out)
+    static_cpi=$(sed -n 's/^APEX_Estimate: .* CPI \([0-9.]*\) .*/\1/p' "$TMP".out)
+
+    functional_error=$(error "$functional" "$cycles")
+    static_error=$(error "$static" "$cycles")
+    static_cpi_error=$(error "$static_cpi" "$cpi")
+    printf '%-14s %10s %6s | %10s %7s%% | %10s %7s%% %6s %7s%%\n' "$name" "$cycles" "$cpi" "$functional" \
+        "$functional_error" "$static" "$static_error" "$static_cpi" "$static_cpi_error"
+
+    if awk -v e="$functional_error" -v t="$THRESHOLD" 'BEGIN { exit !(e > t || e < -t) }'
+    then
+        echo "$name: functional estimate is off by more than $THRESHOLD%"
+        status=1
+    fi
+    sum_functional=$(add_abs "$sum_functional" "$functional_error")
+    sum_static=$(add_abs "$sum_static" "$static_error")
+    sum_static_cpi=$(add_abs "$sum_static_cpi" "$static_cpi_error")
+    kernels=$((kernels + 1))
+done
+
+if [ $kernels -gt 0 ]
+then
+    awk -v f="$sum_functional" -v s="$sum_static" -v c="$sum_static_cpi" -v n="$kernels" 'BEGIN {
+        printf "Mean absolute error: functional %.2f%%, static %.2f%% (CPI %.2f%%)\n", f / n, s / n, c / n }'
+fi
+exit $status
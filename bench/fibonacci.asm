@@ -0,0 +1,15 @@
+MOVC R15,#5000
+MOVC R2,#40
+MOVC R3,#0
+MOVC R4,#1
+MOVC R1,#0
+STORE R3,R1,#0
+ADD R5,R3,R4
+ADD R3,R4,R0
+ADD R4,R5,R0
+ADDL R1,R1,#1
+CMP R1,R2
+BNZ #-24
+SUBL R15,R15,#1
+BNZ #-44
+HALT
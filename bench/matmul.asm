@@ -0,0 +1,41 @@
+MOVC R1,#0
+MOVC R2,#64
+ADDL R4,R1,#1
+STORE R4,R1,#0
+MOVC R7,#7
+AND R3,R1,R7
+SUBL R3,R3,#3
+STORE R3,R1,#64
+ADDL R1,R1,#1
+CMP R1,R2
+BNZ #-32
+MOVC R15,#200
+MOVC R14,#8
+MOVC R13,#64
+MOVC R1,#0
+MOVC R2,#0
+MOVC R3,#0
+MOVC R5,#0
+MUL R10,R1,R14
+ADD R11,R10,R3
+LDR R8,R0,R11
+MUL R12,R3,R14
+ADD R12,R12,R2
+LDR R9,R13,R12
+MUL R4,R8,R9
+ADD R5,R5,R4
+ADDL R3,R3,#1
+CMP R3,R14
+BNZ #-36
+ADD R11,R10,R2
+ADDL R11,R11,#128
+STR R5,R0,R11
+ADDL R2,R2,#1
+CMP R2,R14
+BNZ #-72
+ADDL R1,R1,#1
+CMP R1,R14
+BNZ #-88
+SUBL R15,R15,#1
+BNZ #-100
+HALT
@@ -0,0 +1,20 @@
+MOVC R1,#0
+MOVC R2,#512
+MOVC R3,#7
+STORE R3,R1,#0
+ADDL R3,R3,#3
+ADDL R1,R1,#1
+CMP R1,R2
+BNZ #-16
+MOVC R15,#600
+MOVC R1,#0
+LOAD R4,R1,#0
+LOAD R5,R1,#1
+STORE R4,R1,#1024
+STORE R5,R1,#1025
+ADDL R1,R1,#2
+CMP R1,R2
+BNZ #-24
+SUBL R15,R15,#1
+BNZ #-36
+HALT
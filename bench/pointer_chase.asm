@@ -0,0 +1,25 @@
+MOVC R1,#0
+MOVC R2,#64
+MOVC R3,#63
+MOVC R13,#256
+MOVC R4,#37
+MUL R5,R1,R4
+ADDL R5,R5,#5
+AND R5,R5,R3
+STR R5,R13,R1
+ADDL R1,R1,#1
+CMP R1,R2
+BNZ #-28
+MOVC R15,#3000
+MOVC R6,#0
+MOVC R7,#0
+MOVC R1,#0
+LDR R6,R13,R6
+ADD R7,R7,R6
+ADDL R1,R1,#1
+CMP R1,R2
+BNZ #-16
+SUBL R15,R15,#1
+BNZ #-28
+STORE R7,R0,#0
+HALT
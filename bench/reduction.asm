@@ -0,0 +1,34 @@
+MOVC R1,#0
+MOVC R2,#256
+MOVC R3,#1
+MOVC R9,#2047
+MOVC R11,#13
+STORE R3,R1,#0
+MUL R3,R3,R11
+ADDL R3,R3,#5
+AND R3,R3,R9
+ADDL R1,R1,#1
+CMP R1,R2
+BNZ #-24
+MOVC R15,#600
+MOVC R1,#0
+MOVC R4,#0
+MOVC R5,#0
+MOVC R6,#-1
+MOVC R7,#0
+LOAD R8,R1,#0
+ADD R4,R4,R8
+EXOR R5,R5,R8
+AND R6,R6,R8
+OR R7,R7,R8
+ADDL R1,R1,#1
+CMP R1,R2
+BNZ #-28
+SUBL R15,R15,#1
+BNZ #-56
+MOVC R10,#512
+STORE R4,R10,#0
+STORE R5,R10,#1
+STORE R6,R10,#2
+STORE R7,R10,#3
+HALT
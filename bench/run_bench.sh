@@ -0,0 +1,127 @@
+#!/bin/sh
+#
+# run_bench.sh
+# Runs the APEX benchmark kernels, checks their final register and memory
+# state and their cycle and instruction counts against bench/baseline.txt,
+# and compares host throughput against the baseline
+#
+# The final state and the counts do not depend on the host, any change
+# fails the run. The throughput does, so it only fails the run when
+# BENCH_THRESHOLD is given, on a baseline recorded on the same machine. The
+# gate is then on the geometric mean of the throughput ratios over all
+# kernels, a single kernel runs too briefly to be compared on its own
+#
+# Usage: bench/run_bench.sh [--update]
+#
+#   --update            Write the measured numbers to bench/baseline.txt
+#   BENCH_RUNS=<n>      Runs per kernel, the fastest one is kept (default 5)
+#   BENCH_THRESHOLD=<p> Allowed drop of the mean throughput in percent (no gate by default)
+#
+
+BENCH_DIR=$(dirname "$0")
+SIM=${SIM:-./apex_sim}
+RUNS=${BENCH_RUNS:-5}
+THRESHOLD=$BENCH_THRESHOLD
+BASELINE=$BENCH_DIR/baseline.txt
+RESULTS=$BENCH_DIR/results.txt
+TMP=${TMPDIR:-/tmp}/apex_bench.$$
+UPDATE=0
+
+status=0
+log_sum=0
+compared=0
+
+if [ "$1" = "--update" ]
+then
+    UPDATE=1
+fi
+
+trap 'rm -f "$TMP".out "$TMP".err "$TMP".state' EXIT
+
+# Final state of a simulate run as R<n>=<value> and MEM[<addr>]=<value> lines
+final_state()
+{
+    grep -o 'R[0-9]\+ *\[-\?[0-9]\+ *\]' "$1" | sed 's/ *\[/=/; s/ *\]//'
+    grep -o 'MEM\[[0-9]\+ *\]=-\?[0-9]\+' "$1" | sed 's/ *\]/]/'
+}
+
+printf '# kernel cycles instructions cpi cycles_per_sec\n' > "$RESULTS"
+printf '%-14s %10s %10s %6s %14s %14s %8s\n' kernel cycles insns cpi cycles/s baseline change
+
+for asm in "$BENCH_DIR"/*.asm
+do
+    name=$(basename "$asm" .asm)
+    best=0
+    run=0
+
+    while [ $run -lt "$RUNS" ]
+    do
+        # A large sampling period keeps the profiler out of the measurement
+        if ! "$SIM" "$asm" simulate --profile=65536 > "$TMP".out 2> "$TMP".err
+        then
+            echo "$name: simulator failed"
+            status=1
+            continue 2
+        fi
+        rate=$(sed -n 's/^APEX_Profile: \([0-9]*\) simulated cycles\/s.*/\1/p' "$TMP".err)
+        if [ "${rate:-0}" -gt "$best" ]
+        then
+            best=$rate
+        fi
+        run=$((run + 1))
+    done
+
+    final_state "$TMP".out > "$TMP".state
+    if ! diff "$BENCH_DIR/$name.expected" "$TMP".state > /dev/null
+    then
+        echo "$name: final state differs from $name.expected"
+        diff "$BENCH_DIR/$name.expected" "$TMP".state | head -10
+        status=1
+    fi
+
+    cycles=$(sed -n 's/.*Simulation Complete, cycles = \([0-9]*\) instructions = .*/\1/p' "$TMP".out)
+    insns=$(sed -n 's/.*Simulation Complete, cycles = [0-9]* instructions = \([0-9]*\).*/\1/p' "$TMP".out)
+    cpi=$(awk -v c="$cycles" -v i="$insns" 'BEGIN { printf "%.3f", i ? c / i : 0 }')
+    echo "$name $cycles $insns $cpi $best" >> "$RESULTS"
+
+    base=$(awk -v k="$name" '$1 == k { print $5 }' "$BASELINE" 2> /dev/null)
+    base_cycles=$(awk -v k="$name" '$1 == k { print $2 }' "$BASELINE" 2> /dev/null)
+    base_insns=$(awk -v k="$name" '$1 == k { print $3 }' "$BASELINE" 2> /dev/null)
+    if [ -z "$base" ]
+    then
+        printf '%-14s %10s %10s %6s %14s %14s %8s\n' "$name" "$cycles" "$insns" "$cpi" "$best" - -
+        continue
+    fi
+    change=$(awk -v b="$base" -v r="$best" 'BEGIN { printf "%+.1f%%", 100.0 * (r - b) / b }')
+    printf '%-14s %10s %10s %6s %14s %14s %8s\n' "$name" "$cycles" "$insns" "$cpi" "$best" "$base" "$change"
+
+    # The counts only change with the pipeline model, --update records the new ones
+    if [ "$cycles" != "$base_cycles" ] || [ "$insns" != "$base_insns" ]
+    then
+        echo "$name: cycles and instructions changed from $base_cycles and $base_insns to $cycles and $insns"
+        if [ $UPDATE -eq 0 ]
+        then
+            status=1
+        fi
+    fi
+    log_sum=$(awk -v s="$log_sum" -v b="$base" -v r="$best" 'BEGIN { printf "%.9f", s + log(r / b) }')
+    compared=$((compared + 1))
+done
+
+if [ $compared -gt 0 ]
+then
+    change=$(awk -v s="$log_sum" -v n="$compared" 'BEGIN { printf "%+.1f", 100.0 * (exp(s / n) - 1) }')
+    echo "Mean throughput change against the baseline: $change%"
+    if [ $UPDATE -eq 0 ] && [ -n "$THRESHOLD" ] && awk -v c="$change" -v t="$THRESHOLD" 'BEGIN { exit !(c < -t) }'
+    then
+        echo "Throughput regressed more than $THRESHOLD% against the baseline"
+        status=1
+    fi
+fi
+
+if [ $UPDATE -eq 1 ] && [ $status -eq 0 ]
+then
+    cp "$RESULTS" "$BASELINE"
+    echo "Baseline written to $BASELINE"
+fi
+exit $status
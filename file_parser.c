@@ -134,6 +134,31 @@ set_opcode_str(const char *opcode_str)
         return OPCODE_NOP;
     }
 
+    if (strcmp(opcode_str, "RDCYCLE") == 0)
+    {
+        return OPCODE_RDCYCLE;
+    }
+
+    if (strcmp(opcode_str, "RDINSTRET") == 0)
+    {
+        return OPCODE_RDINSTRET;
+    }
+
+    if (strcmp(opcode_str, "AADD") == 0)
+    {
+        return OPCODE_AADD;
+    }
+
+    if (strcmp(opcode_str, "FENCE") == 0)
+    {
+        return OPCODE_FENCE;
+    }
+
+    if (strcmp(opcode_str, "COREID") == 0)
+    {
+        return OPCODE_COREID;
+    }
+
     if (strcmp(opcode_str, "HALT") == 0)
     {
         return OPCODE_HALT;
@@ -148,13 +173,14 @@ split_opcode_from_insn_string(char *buffer, char tokens[2][128])
 {
     int token_num = 0;
 
-    char *token = strtok(buffer, " ");
+    /* The line ending is a separator too, so "HALT\n" is read as HALT */
+    char *token = strtok(buffer, " \r\n");
 
-    while (token != NULL)
+    while (token != NULL && token_num < 2)
     {
         strcpy(tokens[token_num], token);
         token_num++;
-        token = strtok(NULL, " ");
+        token = strtok(NULL, " \r\n");
     }
 }
 
@@ -312,6 +338,22 @@ create_APEX_instruction(APEX_Instruction *ins, char *buffer, int number)
         ins->imm = get_num_from_string(tokens[0]);
         break;
     }
+
+    case OPCODE_RDCYCLE:
+    case OPCODE_RDINSTRET:
+    case OPCODE_COREID:
+    {
+        ins->rd = get_num_from_string(tokens[0]);
+        break;
+    }
+
+    case OPCODE_AADD:
+    {
+        ins->rd = get_num_from_string(tokens[0]);
+        ins->rs1 = get_num_from_string(tokens[1]);
+        ins->rs2 = get_num_from_string(tokens[2]);
+        break;
+    }
     }
     ins->number = number + 1;
     /* Fill in rest of the instructions accordingly */
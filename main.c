@@ -9,43 +9,514 @@
 #include <stdlib.h>
 #include <string.h>
 #include "apex_cpu.h"
+#include "apex_pipeview.h"
+#include "apex_trace.h"
+#include "apex_profile.h"
+#include "apex_depgraph.h"
+#include "apex_memprof.h"
+#include "apex_interval.h"
+#include "apex_live.h"
+#include "apex_energy.h"
+#include "apex_prefetch.h"
+#include "apex_loopbuf.h"
+#include "apex_estimate.h"
+#include "apex_checkpoint.h"
+#include "apex_sample.h"
+#include "apex_checker.h"
+#include "apex_multicore.h"
+#include "apex_multiprog.h"
+#include "apex_debug.h"
+#include "apex_gdbstub.h"
+#include "apex_cache.h"
+
+/* Options and commands the run was given, one bit each, see option_names */
+#define OPT_PIPEVIEW (1u << 0)
+#define OPT_TRACE (1u << 1)
+#define OPT_PROFILE (1u << 2)
+#define OPT_CRITPATH (1u << 3)
+#define OPT_MEMPROF (1u << 4)
+#define OPT_STATS (1u << 5)
+#define OPT_LIVE (1u << 6)
+#define OPT_ENERGY (1u << 7)
+#define OPT_ENERGY_TABLE (1u << 8)
+#define OPT_PREFETCH (1u << 9)
+#define OPT_LOOP_BUFFER (1u << 10)
+#define OPT_ESTIMATE_STATIC (1u << 11)
+#define OPT_CHECKPOINT (1u << 12)
+#define OPT_CHECKPOINT_AT (1u << 13)
+#define OPT_RESTORE (1u << 14)
+#define OPT_SAMPLE (1u << 15)
+#define OPT_CHECK (1u << 16)
+#define OPT_CORES (1u << 17)
+#define OPT_SMT (1u << 18)
+#define OPT_PROGRAMS (1u << 19)
+#define OPT_TIMESLICE (1u << 20)
+#define OPT_GDB (1u << 21)
+#define OPT_CACHE (1u << 22)
+#define OPT_SIMULATE (1u << 23)
+#define OPT_CYCLES (1u << 24)
+#define OPT_SHOWMEM (1u << 25)
+#define OPT_DEBUG (1u << 26)
+#define OPT_ESTIMATE (1u << 27)
+#define OPT_TRACE_THREAD (1u << 28)
+#define OPT_STATS_EVERY (1u << 29)
+#define NUM_OPTS 30
+
+/* The tools that follow a single pipeline through the run */
+#define OPT_TOOLS \
+    (OPT_PIPEVIEW | OPT_TRACE | OPT_PROFILE | OPT_CRITPATH | OPT_MEMPROF | OPT_STATS | OPT_LIVE | OPT_ENERGY | \
+     OPT_PREFETCH | OPT_LOOP_BUFFER)
+
+static const char *option_names[NUM_OPTS] = {
+    "--pipeview", "--trace", "--profile", "--critpath", "--memprof", "--stats", "--live", "--energy",
+    "--energy-table", "--prefetch", "--loop-buffer", "--estimate-static", "--checkpoint", "--checkpoint-at",
+    "--restore", "--sample", "--check", "--cores", "--smt", "--programs", "--timeslice", "--gdb", "--cache",
+    "simulate", "a cycle count", "show_mem", "debug", "estimate", "--trace-thread", "--stats-every"};
+
+typedef struct Option_Rule
+{
+    unsigned int option;
+    unsigned int conflicts; /* Options and commands it cannot be combined with */
+    unsigned int requires;  /* One of these must be given too, 0 for none */
+} Option_Rule;
+
+static const Option_Rule option_rules[] = {
+    /* Checkpoints leave out the prefetcher and loop buffer, a restored run would start them cold */
+    {OPT_PREFETCH, OPT_CHECKPOINT | OPT_RESTORE, 0},
+    {OPT_LOOP_BUFFER, OPT_CHECKPOINT | OPT_RESTORE, 0},
+    {OPT_CHECKPOINT, 0, OPT_CHECKPOINT_AT},
+    {OPT_CHECKPOINT_AT, 0, OPT_CHECKPOINT},
+    {OPT_ENERGY_TABLE, 0, OPT_ENERGY},
+    {OPT_TRACE_THREAD, 0, OPT_TRACE},
+    {OPT_STATS_EVERY, 0, OPT_STATS},
+    /* Sampling skips instructions functionally, there would be nothing to compare */
+    {OPT_CHECK, OPT_SAMPLE, 0},
+    /* Its cycles are not the run's: fast-forwarding skips the checkpoint cycle, and the
+     * pipeline reset before every window drops the instructions the view follows */
+    {OPT_SAMPLE, OPT_CHECKPOINT | OPT_PIPEVIEW, 0},
+    /* These follow a single architectural state */
+    {OPT_SMT,
+     OPT_CORES | OPT_SAMPLE | OPT_CHECK | OPT_CHECKPOINT | OPT_RESTORE | OPT_PIPEVIEW | OPT_TRACE | OPT_CRITPATH, 0},
+    /* The per-core tools and the checker assume memory only one core writes,
+     * and the cores always run to HALT */
+    {OPT_CORES, OPT_CYCLES | OPT_SAMPLE | OPT_CHECK | OPT_CHECKPOINT | OPT_RESTORE | OPT_TOOLS, OPT_SIMULATE},
+    /* The per-program state of the tools would follow whichever program runs,
+     * and the scheduler runs every program to HALT */
+    {OPT_PROGRAMS,
+     OPT_CYCLES | OPT_CORES | OPT_SMT | OPT_SAMPLE | OPT_CHECK | OPT_CHECKPOINT | OPT_RESTORE | OPT_TOOLS,
+     OPT_SIMULATE},
+    {OPT_TIMESLICE, 0, OPT_PROGRAMS},
+    /* The debugger runs its own loop on a single pipeline */
+    {OPT_DEBUG, OPT_PROGRAMS | OPT_CORES | OPT_SMT | OPT_SAMPLE | OPT_CHECKPOINT, 0},
+    /* Nothing runs on the pipeline, and the model is the one without the optional units */
+    {OPT_ESTIMATE,
+     OPT_PROGRAMS | OPT_CORES | OPT_SMT | OPT_SAMPLE | OPT_CHECK | OPT_CHECKPOINT | OPT_RESTORE | OPT_TOOLS | OPT_GDB |
+         OPT_CACHE,
+     0},
+    {OPT_ESTIMATE_STATIC, 0, OPT_ESTIMATE},
+    /* The debugger owns the run, stopping it with an empty pipeline */
+    {OPT_GDB, OPT_PROGRAMS | OPT_CORES | OPT_SMT | OPT_SAMPLE | OPT_CHECK, OPT_SIMULATE},
+    /* The result is all such a run prints, and it always ends by halting */
+    {OPT_CACHE,
+     OPT_CYCLES | OPT_PROGRAMS | OPT_CORES | OPT_SMT | OPT_SAMPLE | OPT_CHECK | OPT_CHECKPOINT | OPT_TOOLS | OPT_GDB,
+     OPT_SIMULATE | OPT_SHOWMEM},
+};
+
+/* Name of the lowest option or command set in mask */
+static const char *
+option_name(unsigned int mask)
+{
+    int i;
+
+    for (i = 0; i < NUM_OPTS; ++i)
+    {
+        if (mask & (1u << i))
+        {
+            return option_names[i];
+        }
+    }
+    return "?";
+}
+
+/* Rejects the options that cannot go together. Runs before any file is
+ * opened or thread started, so a rejected run leaves nothing behind.
+ */
+static void
+check_options(unsigned int given)
+{
+    const Option_Rule *rule;
+    unsigned int conflict;
+    int i;
+
+    if ((given & OPT_PROFILE) && !ENABLE_HOST_PROFILE)
+    {
+        fprintf(stderr, "APEX_Error: Host profiling was compiled out (ENABLE_HOST_PROFILE)\n");
+        exit(1);
+    }
+
+    for (rule = option_rules; rule < option_rules + sizeof(option_rules) / sizeof(option_rules[0]); ++rule)
+    {
+        if (!(given & rule->option))
+        {
+            continue;
+        }
+        conflict = given & rule->conflicts;
+        if (conflict)
+        {
+            fprintf(stderr, "APEX_Error: %s cannot be combined with %s\n", option_name(rule->option),
+                    option_name(conflict));
+            exit(1);
+        }
+        if (rule->requires && !(given & rule->requires))
+        {
+            fprintf(stderr, "APEX_Error: %s goes with", option_name(rule->option));
+            for (i = 0; i < NUM_OPTS; ++i)
+            {
+                if (rule->requires & (1u << i))
+                {
+                    fprintf(stderr, " %s%s", option_names[i], (rule->requires >> (i + 1)) ? " or" : "");
+                }
+            }
+            fprintf(stderr, "\n");
+            exit(1);
+        }
+    }
+}
 
 int main(int argc, char const *argv[])
 {
     APEX_CPU *cpu;
     int command = 0;
     int command_2 = 0;
+    int i;
+    int nargs = 0;
+    const char *args[4] = {NULL, NULL, NULL, NULL};
+    const char *pipeview_file = NULL;
+    const char *trace_file = NULL;
+    int trace_threaded = FALSE;
+    int profile_period = -1;
+    int critpath = FALSE;
+    const char *critpath_file = NULL;
+    int memprof_interval = -1;
+    const char *stats_file = NULL;
+    int stats_period = INTERVAL_DEFAULT_PERIOD;
+    int stats_period_set = FALSE;
+    int live = FALSE;
+    const char *live_name = NULL;
+    int energy_interval = -1;
+    const char *energy_table = NULL;
+    int prefetch = FALSE;
+    int prefetch_degree = PREFETCH_DEFAULT_DEGREE;
+    int prefetch_distance = PREFETCH_DEFAULT_DISTANCE;
+    int loop_buffer = 0;
+    int estimate_static = FALSE;
+    const char *checkpoint_file = NULL;
+    int checkpoint_at = -1;
+    const char *restore_file = NULL;
+    int sample_period = 0;
+    int sample_warmup = SAMPLE_DEFAULT_WARMUP;
+    int sample_window = SAMPLE_DEFAULT_WINDOW;
+    int check = FALSE;
+    int check_threaded = TRUE;
+    int num_cores = 1;
+    int num_threads = 1;
+    int smt_policy = SMT_POLICY_READY;
+    int quantum = MULTICORE_DEFAULT_QUANTUM;
+    APEX_Multicore *multicore = NULL;
+    char *program_list = NULL;
+    const char *programs[MAX_PROGRAMS];
+    int num_programs = 0;
+    int timeslice = MULTIPROG_DEFAULT_TIMESLICE;
+    int switch_cost = MULTIPROG_DEFAULT_SWITCH_COST;
+    int timeslice_set = FALSE;
+    APEX_Multiprog *multiprog = NULL;
+    const char *gdb_address = NULL;
+    const char *cache_dir = NULL;
+    uint64_t cache_key = 0;
+    int cache_hit = FALSE;
+    char *file;
+    unsigned int given = 0;
 
     fprintf(stderr, "APEX CPU Pipeline Simulator v%0.1lf\n", VERSION);
 
+    /* Options start with "--" and may appear anywhere after the program name,
+     * everything else is a positional argument */
+    for (i = 0; i < argc; ++i)
+    {
+        if (strncmp(argv[i], "--pipeview=", 11) == 0)
+        {
+            pipeview_file = argv[i] + 11;
+        }
+        else if (strncmp(argv[i], "--trace=", 8) == 0)
+        {
+            trace_file = argv[i] + 8;
+        }
+        else if (strcmp(argv[i], "--trace-thread") == 0)
+        {
+            trace_threaded = TRUE;
+        }
+        else if (strcmp(argv[i], "--profile") == 0)
+        {
+            profile_period = PROFILE_DEFAULT_PERIOD;
+        }
+        else if (strncmp(argv[i], "--profile=", 10) == 0)
+        {
+            profile_period = atoi(argv[i] + 10);
+            if (profile_period < 1)
+            {
+                fprintf(stderr, "APEX_Error: --profile=<period> takes a positive period\n");
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "--critpath") == 0)
+        {
+            critpath = TRUE;
+        }
+        else if (strncmp(argv[i], "--critpath=", 11) == 0)
+        {
+            critpath = TRUE;
+            critpath_file = argv[i] + 11;
+        }
+        else if (strcmp(argv[i], "--memprof") == 0)
+        {
+            memprof_interval = MEMPROF_DEFAULT_INTERVAL;
+        }
+        else if (strncmp(argv[i], "--memprof=", 10) == 0)
+        {
+            memprof_interval = atoi(argv[i] + 10);
+        }
+        else if (strncmp(argv[i], "--stats=", 8) == 0)
+        {
+            stats_file = argv[i] + 8;
+        }
+        else if (strncmp(argv[i], "--stats-every=", 14) == 0)
+        {
+            stats_period = atoi(argv[i] + 14);
+            stats_period_set = TRUE;
+            if (stats_period < 1)
+            {
+                fprintf(stderr, "APEX_Error: --stats-every=<cycles> takes a positive interval\n");
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "--energy") == 0)
+        {
+            energy_interval = ENERGY_DEFAULT_INTERVAL;
+        }
+        else if (strncmp(argv[i], "--energy=", 9) == 0)
+        {
+            energy_interval = atoi(argv[i] + 9);
+        }
+        else if (strncmp(argv[i], "--energy-table=", 15) == 0)
+        {
+            energy_table = argv[i] + 15;
+        }
+        else if (strcmp(argv[i], "--prefetch") == 0)
+        {
+            prefetch = TRUE;
+        }
+        else if (strncmp(argv[i], "--prefetch=", 11) == 0)
+        {
+            prefetch = TRUE;
+            sscanf(argv[i] + 11, "%d,%d", &prefetch_degree, &prefetch_distance);
+            if (prefetch_degree < 1 || prefetch_distance < 1)
+            {
+                fprintf(stderr, "APEX_Error: --prefetch=<degree>[,<distance>] takes positive values\n");
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "--loop-buffer") == 0)
+        {
+            loop_buffer = LOOPBUF_DEFAULT_SIZE;
+        }
+        else if (strncmp(argv[i], "--loop-buffer=", 14) == 0)
+        {
+            loop_buffer = atoi(argv[i] + 14);
+            if (loop_buffer < 1 || loop_buffer > LOOPBUF_MAX_SIZE)
+            {
+                fprintf(stderr, "APEX_Error: --loop-buffer=<instructions> takes 1 to %d\n", LOOPBUF_MAX_SIZE);
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "--estimate-static") == 0)
+        {
+            estimate_static = TRUE;
+        }
+        else if (strcmp(argv[i], "--live") == 0)
+        {
+            live = TRUE;
+        }
+        else if (strncmp(argv[i], "--live=", 7) == 0)
+        {
+            live = TRUE;
+            live_name = argv[i] + 7;
+        }
+        else if (strncmp(argv[i], "--checkpoint=", 13) == 0)
+        {
+            checkpoint_file = argv[i] + 13;
+        }
+        else if (strncmp(argv[i], "--checkpoint-at=", 16) == 0)
+        {
+            checkpoint_at = atoi(argv[i] + 16);
+        }
+        else if (strncmp(argv[i], "--restore=", 10) == 0)
+        {
+            restore_file = argv[i] + 10;
+        }
+        else if (strcmp(argv[i], "--sample") == 0)
+        {
+            sample_period = SAMPLE_DEFAULT_PERIOD;
+        }
+        else if (strncmp(argv[i], "--sample=", 9) == 0)
+        {
+            sscanf(argv[i] + 9, "%d,%d,%d", &sample_period, &sample_warmup, &sample_window);
+            if (sample_period < 1 || sample_warmup < 0 || sample_window < 1)
+            {
+                fprintf(stderr, "APEX_Error: --sample=<period>[,<warmup>,<window>] takes positive counts\n");
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "--check") == 0)
+        {
+            check = TRUE;
+        }
+        else if (strcmp(argv[i], "--check=inline") == 0)
+        {
+            check = TRUE;
+            check_threaded = FALSE;
+        }
+        else if (strncmp(argv[i], "--cores=", 8) == 0)
+        {
+            sscanf(argv[i] + 8, "%d,%d", &num_cores, &quantum);
+            if (num_cores < 1 || num_cores > MAX_CORES || quantum < 1)
+            {
+                fprintf(stderr, "APEX_Error: --cores=<n>[,<quantum>] takes 1 to %d cores and a positive quantum\n",
+                        MAX_CORES);
+                exit(1);
+            }
+        }
+        else if (strncmp(argv[i], "--smt=", 6) == 0)
+        {
+            num_threads = atoi(argv[i] + 6);
+            if (strstr(argv[i], ",rr"))
+            {
+                smt_policy = SMT_POLICY_RR;
+            }
+            else if (strchr(argv[i], ',') && !strstr(argv[i], ",ready"))
+            {
+                fprintf(stderr, "APEX_Error: --smt=<threads>[,rr|ready] has an unknown fetch policy\n");
+                exit(1);
+            }
+            if (num_threads < 1 || num_threads > MAX_THREADS)
+            {
+                fprintf(stderr, "APEX_Error: --smt takes 1 to %d threads\n", MAX_THREADS);
+                exit(1);
+            }
+        }
+        else if (strncmp(argv[i], "--programs=", 11) == 0)
+        {
+            /* Kept for the whole run, the names point into it */
+            program_list = strdup(argv[i] + 11);
+            for (file = strtok(program_list, ","); file; file = strtok(NULL, ","))
+            {
+                if (num_programs == MAX_PROGRAMS - 1)
+                {
+                    fprintf(stderr, "APEX_Error: --programs takes up to %d more programs\n", MAX_PROGRAMS - 1);
+                    exit(1);
+                }
+                programs[num_programs++] = file;
+            }
+        }
+        else if (strncmp(argv[i], "--timeslice=", 12) == 0)
+        {
+            timeslice_set = TRUE;
+            sscanf(argv[i] + 12, "%d,%d", &timeslice, &switch_cost);
+            if (timeslice < 1 || switch_cost < 0)
+            {
+                fprintf(stderr, "APEX_Error: --timeslice=<cycles>[,<switch cost>] takes a positive timeslice\n");
+                exit(1);
+            }
+        }
+        else if (strncmp(argv[i], "--gdb=", 6) == 0)
+        {
+            gdb_address = argv[i] + 6;
+        }
+        else if (strncmp(argv[i], "--cache=", 8) == 0)
+        {
+            cache_dir = argv[i] + 8;
+        }
+        else if (strncmp(argv[i], "--", 2) == 0)
+        {
+            fprintf(stderr, "APEX_Error: Unknown option %s\n", argv[i]);
+            exit(1);
+        }
+        else if (nargs < 4)
+        {
+            args[nargs++] = argv[i];
+        }
+    }
+
     /* if (argc != 4)
     {
         fprintf(stderr, "APEX_Help: Usage %s <input_file>\n", argv[0]);
         exit(1);
     }*/
 
-    if ((argc == 3) || (argc == 4))
+    if ((nargs == 3) || (nargs == 4))
     {
-        command = APEX_cpu_simulator(argv[2]);
+        command = APEX_cpu_simulator(args[2]);
         if (!command)
         {
             fprintf(stderr, "APEX_Error: Unable to find simulator command\n");
             exit(1);
         }
 
-        if (argc == 4)
+        if (nargs == 4)
         {
             if (command == SHOWMEM)
             {
-                command_2 = atoi(argv[3]);
+                command_2 = atoi(args[3]);
             }
             else
             {
-                command_2 = atoi(argv[3]) - 1;
+                command_2 = atoi(args[3]) - 1;
             }
         }
     }
-    cpu = APEX_cpu_init(argv[1]);
+
+    given |= pipeview_file ? OPT_PIPEVIEW : 0;
+    given |= trace_file ? OPT_TRACE : 0;
+    given |= trace_threaded ? OPT_TRACE_THREAD : 0;
+    given |= (profile_period >= 0) ? OPT_PROFILE : 0;
+    given |= critpath ? OPT_CRITPATH : 0;
+    given |= (memprof_interval >= 0) ? OPT_MEMPROF : 0;
+    given |= stats_file ? OPT_STATS : 0;
+    given |= stats_period_set ? OPT_STATS_EVERY : 0;
+    given |= live ? OPT_LIVE : 0;
+    given |= (energy_interval >= 0) ? OPT_ENERGY : 0;
+    given |= energy_table ? OPT_ENERGY_TABLE : 0;
+    given |= prefetch ? OPT_PREFETCH : 0;
+    given |= loop_buffer ? OPT_LOOP_BUFFER : 0;
+    given |= estimate_static ? OPT_ESTIMATE_STATIC : 0;
+    given |= checkpoint_file ? OPT_CHECKPOINT : 0;
+    given |= (checkpoint_at >= 0) ? OPT_CHECKPOINT_AT : 0;
+    given |= restore_file ? OPT_RESTORE : 0;
+    given |= sample_period ? OPT_SAMPLE : 0;
+    given |= check ? OPT_CHECK : 0;
+    given |= (num_cores > 1) ? OPT_CORES : 0;
+    given |= (num_threads > 1) ? OPT_SMT : 0;
+    given |= num_programs ? OPT_PROGRAMS : 0;
+    given |= timeslice_set ? OPT_TIMESLICE : 0;
+    given |= gdb_address ? OPT_GDB : 0;
+    given |= cache_dir ? OPT_CACHE : 0;
+    given |= (command == SIMULATE) ? OPT_SIMULATE : 0;
+    given |= (command != SHOWMEM && command_2) ? OPT_CYCLES : 0;
+    given |= (command == SHOWMEM) ? OPT_SHOWMEM : 0;
+    given |= (command == DEBUGGER) ? OPT_DEBUG : 0;
+    given |= (command == ESTIMATE) ? OPT_ESTIMATE : 0;
+    check_options(given);
+
+    cpu = APEX_cpu_init(args[1]);
     if (!cpu)
     {
         fprintf(stderr, "APEX_Error: Unable to initialize CPU\n");
@@ -58,11 +529,202 @@ int main(int argc, char const *argv[])
         cpu->single_step = ENABLE_SINGLE_STEP;
     }
 
+    /* Restored before the other options so they start from the restored cycle */
+    if (restore_file && APEX_checkpoint_restore(cpu, restore_file))
+    {
+        exit(1);
+    }
+
+    if (checkpoint_file)
+    {
+        cpu->checkpoint_file = checkpoint_file;
+        cpu->checkpoint_at = checkpoint_at;
+    }
+
+    if (pipeview_file)
+    {
+        cpu->pipeview = APEX_pipeview_open(pipeview_file, cpu);
+        if (!cpu->pipeview)
+        {
+            fprintf(stderr, "APEX_Error: Unable to open pipeline view file %s\n", pipeview_file);
+            exit(1);
+        }
+    }
+
+    if (trace_file)
+    {
+        cpu->trace = APEX_trace_open(trace_file, cpu, trace_threaded);
+        if (!cpu->trace)
+        {
+            fprintf(stderr, "APEX_Error: Unable to open trace file %s\n", trace_file);
+            exit(1);
+        }
+    }
+
+    if (profile_period >= 0)
+    {
+        cpu->profile = APEX_profile_create(cpu, profile_period);
+    }
+
+    if (critpath)
+    {
+        cpu->depgraph = APEX_depgraph_create(cpu, critpath_file);
+    }
+
+    if (memprof_interval >= 0)
+    {
+        cpu->memprof = APEX_memprof_create(cpu, memprof_interval);
+    }
+
+    if (stats_file)
+    {
+        cpu->interval = APEX_interval_open(stats_file, cpu, stats_period);
+        if (!cpu->interval)
+        {
+            fprintf(stderr, "APEX_Error: Unable to open interval statistics file %s\n", stats_file);
+            exit(1);
+        }
+    }
+
+    if (energy_interval >= 0)
+    {
+        cpu->energy = APEX_energy_create(cpu, energy_interval, energy_table);
+        if (!cpu->energy)
+        {
+            fprintf(stderr, "APEX_Error: Unable to set up the energy model\n");
+            exit(1);
+        }
+    }
+
+    if (prefetch)
+    {
+        cpu->prefetch = APEX_prefetch_create(prefetch_degree, prefetch_distance);
+        if (!cpu->prefetch)
+        {
+            fprintf(stderr, "APEX_Error: Unable to set up the prefetcher\n");
+            exit(1);
+        }
+    }
+
+    if (loop_buffer)
+    {
+        cpu->loopbuf = APEX_loopbuf_create(loop_buffer);
+        if (!cpu->loopbuf)
+        {
+            fprintf(stderr, "APEX_Error: Unable to set up the loop buffer\n");
+            exit(1);
+        }
+    }
+
+    if (live)
+    {
+        cpu->live = APEX_live_create(live_name, args[1]);
+        if (!cpu->live)
+        {
+            fprintf(stderr, "APEX_Error: Unable to create the live statistics object\n");
+            exit(1);
+        }
+    }
+
+    if (check)
+    {
+        cpu->checker = APEX_checker_create(cpu, check_threaded);
+        if (!cpu->checker)
+        {
+            fprintf(stderr, "APEX_Error: Unable to start the lockstep checker\n");
+            exit(1);
+        }
+    }
+
+    if (num_threads > 1)
+    {
+        APEX_cpu_set_threads(cpu, num_threads, smt_policy);
+    }
+
+    if (num_cores > 1)
+    {
+        multicore = APEX_multicore_create(cpu, num_cores, quantum);
+        if (!multicore)
+        {
+            fprintf(stderr, "APEX_Error: Unable to create %d cores\n", num_cores);
+            exit(1);
+        }
+    }
+
+    if (num_programs)
+    {
+        multiprog = APEX_multiprog_create(cpu, args[1], programs, num_programs, timeslice, switch_cost);
+        if (!multiprog)
+        {
+            fprintf(stderr, "APEX_Error: Unable to load the programs\n");
+            exit(1);
+        }
+    }
+
+    if (cache_dir)
+    {
+        cache_key = APEX_cache_key(cpu);
+        if (APEX_cache_lookup(cache_dir, cache_key, cpu) == 0)
+        {
+            fprintf(stderr, "APEX_Cache: Result %016llx read from %s\n", (unsigned long long)cache_key, cache_dir);
+            cache_hit = TRUE;
+        }
+    }
+
     //   if ((strcmp(argv[2], "initiate") == 0) || (strcmp(argv[2], "simulate") == 0) || (strcmp(argv[2], "display") == 0) || (strcmp(argv[2], "single_step") == 0) || (strcmp(argv[2], "showmem") == 0))
     if (cpu->command != INITIALIZE)
     {
-        APEX_cpu_run(cpu);
+        if (cache_hit)
+        {
+            APEX_cpu_print_result(cpu);
+        }
+        else if (multiprog)
+        {
+            APEX_multiprog_run(multiprog);
+            APEX_multiprog_destroy(multiprog);
+        }
+        else if (multicore)
+        {
+            APEX_multicore_run(multicore);
+            APEX_multicore_destroy(multicore);
+        }
+        else if (gdb_address)
+        {
+            if (APEX_gdbstub_run(cpu, gdb_address))
+            {
+                exit(1);
+            }
+        }
+        else if (cpu->command == DEBUGGER)
+        {
+            APEX_debug_run(cpu);
+        }
+        else if (cpu->command == ESTIMATE)
+        {
+            if (APEX_estimate_run(cpu, estimate_static))
+            {
+                exit(1);
+            }
+        }
+        else if (sample_period)
+        {
+            APEX_sample_run(cpu, sample_period, sample_warmup, sample_window);
+        }
+        else
+        {
+            APEX_cpu_run(cpu);
+            if (cache_dir && APEX_cache_store(cache_dir, cache_key, cpu))
+            {
+                fprintf(stderr, "APEX_Error: Unable to write the result to %s\n", cache_dir);
+            }
+            else if (cache_dir)
+            {
+                fprintf(stderr, "APEX_Cache: Result %016llx written to %s\n", (unsigned long long)cache_key,
+                        cache_dir);
+            }
+        }
         APEX_cpu_stop(cpu);
     }
+    free(program_list);
     return 0;
-}
\ No newline at end of file
+}